@@ -0,0 +1,768 @@
+/*
+*  op_benchmark.cpp:
+*  micro benchmark of the CPU executes
+*  (1) for every op, a batch of nodes of the same type is built on synthetic
+*      inputs, so that Graph::compute merges them into one execute
+*  (2) each repetition generates a fresh execute for the batch and times its
+*      forward and backward, as Graph::compute and Graph::backward do, cases
+*      of inference only (e.g. uni_int8, lookup_pq) time forward alone
+*  (3) flops and bytes are modeled per op from the shapes (params read once
+*      per batch), they are estimates rather than counters
+*  (4) where the hardware counters can be read (see PerfCounters.h), the
+*      cycles, instructions, cache misses and branch misses of forward and
+*      backward are read in a pass after the timed one and reported per
+*      repetition, with the IPC and the bytes missed per modeled flop, to
+*      tell compute bound ops from memory bound ones, they are null
+*      otherwise
+*  Results are written to stdout as JSON, progress and errors to stderr.
+*
+*  usage: op_benchmark [--ops uni,bi,...] [--batches 1,16,128]
+*                      [--dims 32,128,512] [--len 16] [--min-time 0.05]
+*                      [--counters 1]
+*/
+
+#include "N3LDG.h"
+#include "PerfCounters.h"
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// everything the nodes of one benchmark case point to
+struct Case {
+    Graph graph;
+    vector<PNode> batch;
+    vector<std::unique_ptr<Node>> nodes;
+    vector<std::shared_ptr<void>> params;
+    vector<std::unique_ptr<Alphabet>> alphabets;
+    double forward_flops = 0, backward_flops = 0;
+    double forward_bytes = 0, backward_bytes = 0;
+    bool inference = false; // forward only, e.g. with quantized params
+
+    template<typename T>
+    T *param() {
+        T *p = new T;
+        params.push_back(std::shared_ptr<void>(p));
+        return p;
+    }
+
+    template<typename T>
+    T *node() {
+        T *p = new T;
+        nodes.push_back(std::unique_ptr<Node>(p));
+        return p;
+    }
+
+    PNode input(int dim) {
+        BucketNode *x = node<BucketNode>();
+        x->init(dim, -1);
+        x->val.random(1.0);
+        x->forward(&graph);
+        return x;
+    }
+
+    Alphabet *alphabet(int size) {
+        Alphabet *alpha = new Alphabet;
+        for (int i = 0; i < size; i++) {
+            alpha->from_string("f" + std::to_string(i));
+        }
+        alpha->from_string(unknownkey);
+        alpha->set_fixed_flag(true);
+        alphabets.push_back(std::unique_ptr<Alphabet>(alpha));
+        return alpha;
+    }
+};
+
+struct Shape {
+    int batch;
+    int dim;
+    int len; // inputs per node for pooling, attention, biaffine and sparse ops,
+             // tokens per sentence for multi head attention
+};
+
+typedef std::function<void(Case &, const Shape &)> Builder;
+
+const double F = sizeof(dtype);
+
+// W x (+ b) for each of the inputs of every node, then the activation
+void linearCost(Case &c, const Shape &s, int inputs, bool activated) {
+    double w = (double)s.dim * s.dim * inputs;
+    double elems = (double)s.batch * s.dim;
+    c.forward_flops = 2 * w * s.batch + (activated ? 2 * elems : 0);
+    c.backward_flops = 4 * w * s.batch + (activated ? 2 * elems : 0);
+    c.forward_bytes = F * (w + elems * inputs + elems);
+    c.backward_bytes = F * (2 * w + 2 * elems * inputs + elems);
+}
+
+void buildUni(Case &c, const Shape &s) {
+    UniParams *param = c.param<UniParams>();
+    param->initial(s.dim, s.dim);
+    for (int i = 0; i < s.batch; i++) {
+        UniNode *n = c.node<UniNode>();
+        n->setParam(param);
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, c.input(s.dim));
+    }
+    linearCost(c, s, 1, true);
+}
+
+// as uni with int8 weights, see Param::quantize
+void buildUniInt8(Case &c, const Shape &s) {
+    buildUni(c, s);
+    static_cast<UniParams*>(c.params.back().get())->quantize();
+    c.inference = true;
+    c.forward_bytes -= (F - 1) * s.dim * s.dim;
+    c.backward_flops = c.backward_bytes = 0;
+}
+
+// as uni with bf16 weights, see Param::toHalf
+void buildUniBF16(Case &c, const Shape &s) {
+    buildUni(c, s);
+    static_cast<UniParams*>(c.params.back().get())->toHalf(HalfMat::BF16);
+    c.inference = true;
+    c.forward_bytes -= (F - 2) * s.dim * s.dim;
+    c.backward_flops = c.backward_bytes = 0;
+}
+
+void buildBi(Case &c, const Shape &s) {
+    BiParams *param = c.param<BiParams>();
+    param->initial(s.dim, s.dim, s.dim);
+    for (int i = 0; i < s.batch; i++) {
+        BiNode *n = c.node<BiNode>();
+        n->setParam(param);
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, c.input(s.dim), c.input(s.dim));
+    }
+    linearCost(c, s, 2, true);
+}
+
+// TriNode declares compute and backward with extra tensors only, and can not
+// be instantiated, so the linear variant stands for the tri ops
+void buildTri(Case &c, const Shape &s) {
+    TriParams *param = c.param<TriParams>();
+    param->initial(s.dim, s.dim, s.dim, s.dim);
+    for (int i = 0; i < s.batch; i++) {
+        LinearTriNode *n = c.node<LinearTriNode>();
+        n->setParam(param);
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, c.input(s.dim), c.input(s.dim), c.input(s.dim));
+    }
+    linearCost(c, s, 3, false);
+}
+
+void buildFour(Case &c, const Shape &s) {
+    FourParams *param = c.param<FourParams>();
+    param->initial(s.dim, s.dim, s.dim, s.dim, s.dim);
+    for (int i = 0; i < s.batch; i++) {
+        FourNode *n = c.node<FourNode>();
+        n->setParam(param);
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, c.input(s.dim), c.input(s.dim), c.input(s.dim),
+                c.input(s.dim));
+    }
+    linearCost(c, s, 4, true);
+}
+
+void buildLinear(Case &c, const Shape &s) {
+    UniParams *param = c.param<UniParams>();
+    param->initial(s.dim, s.dim, false);
+    for (int i = 0; i < s.batch; i++) {
+        LinearNode *n = c.node<LinearNode>();
+        n->setParam(param);
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, c.input(s.dim));
+    }
+    linearCost(c, s, 1, false);
+}
+
+// nodes reading N inputs of dim elementwise, writing out elements each
+void elementwise(Case &c, const Shape &s, int inputs, int out, double flops_per_out) {
+    double elems = (double)s.batch * out;
+    c.forward_flops = elems * flops_per_out;
+    c.backward_flops = elems * flops_per_out;
+    c.forward_bytes = F * ((double)s.batch * inputs * s.dim + elems);
+    c.backward_bytes = F * (2.0 * s.batch * inputs * s.dim + elems);
+}
+
+void buildConcat(Case &c, const Shape &s) {
+    for (int i = 0; i < s.batch; i++) {
+        ConcatNode *n = c.node<ConcatNode>();
+        n->init(2 * s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, c.input(s.dim), c.input(s.dim));
+    }
+    elementwise(c, s, 2, 2 * s.dim, 0);
+}
+
+// W x of the window x[i-1], x[i], x[i+1] of every input, as a tagger does
+void buildWindowUni(Case &c, const Shape &s) {
+    UniParams *param = c.param<UniParams>();
+    param->initial(s.dim, 3 * s.dim);
+    WindowBuilder *window = c.param<WindowBuilder>();
+    window->init(s.dim, 1);
+    vector<PNode> xs;
+    for (int i = 0; i < s.batch; i++) {
+        xs.push_back(c.input(s.dim));
+    }
+    window->forward(&c.graph, xs);
+    for (int i = 0; i < s.batch; i++) {
+        UniNode *n = c.node<UniNode>();
+        n->setParam(param);
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, window->_outputs[i]);
+    }
+    linearCost(c, s, 3, true);
+}
+
+// the same window as a single conv1d node per input
+void buildConv1D(Case &c, const Shape &s) {
+    Conv1DParams *param = c.param<Conv1DParams>();
+    param->initial(s.dim, s.dim, 3);
+    Conv1DBuilder *conv = c.param<Conv1DBuilder>();
+    conv->init(param, 1, 1);
+    vector<PNode> xs;
+    for (int i = 0; i < s.batch; i++) {
+        xs.push_back(c.input(s.dim));
+    }
+    conv->forward(&c.graph, xs);
+    for (Conv1DNode *n : conv->_outputs) {
+        c.batch.push_back(n);
+    }
+    linearCost(c, s, 3, true);
+}
+
+template<typename Pool>
+void buildPooling(Case &c, const Shape &s) {
+    for (int i = 0; i < s.batch; i++) {
+        Pool *n = c.node<Pool>();
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        vector<PNode> xs;
+        for (int k = 0; k < s.len; k++) {
+            xs.push_back(c.input(s.dim));
+        }
+        n->forward(&c.graph, xs);
+    }
+    elementwise(c, s, s.len, s.dim, s.len);
+}
+
+void buildPAdd(Case &c, const Shape &s) {
+    for (int i = 0; i < s.batch; i++) {
+        PAddNode *n = c.node<PAddNode>();
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, c.input(s.dim), c.input(s.dim), c.input(s.dim));
+    }
+    elementwise(c, s, 3, s.dim, 2);
+}
+
+void buildPMulti(Case &c, const Shape &s) {
+    for (int i = 0; i < s.batch; i++) {
+        PMultiNode *n = c.node<PMultiNode>();
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, c.input(s.dim), c.input(s.dim));
+    }
+    elementwise(c, s, 2, s.dim, 1);
+    c.backward_flops *= 2;
+}
+
+void buildLookup(Case &c, const Shape &s) {
+    const int vocabulary = 10000;
+    LookupTable *table = c.param<LookupTable>();
+    table->initial(c.alphabet(vocabulary), s.dim, true);
+    for (int i = 0; i < s.batch; i++) {
+        LookupNode *n = c.node<LookupNode>();
+        n->setParam(table);
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, "f" + std::to_string(i * 7919 % vocabulary));
+    }
+    double elems = (double)s.batch * s.dim;
+    c.forward_bytes = F * 2 * elems;
+    c.backward_bytes = F * 3 * elems;
+    c.backward_flops = elems;
+}
+
+// as lookup with a bf16 table, see SparseParam::toHalf
+void buildLookupBF16(Case &c, const Shape &s) {
+    buildLookup(c, s);
+    static_cast<LookupTable*>(c.params.back().get())->E.toHalf(HalfMat::BF16);
+    c.inference = true;
+    c.forward_bytes -= (F - 2) * (double)s.batch * s.dim;
+    c.backward_flops = c.backward_bytes = 0;
+}
+
+// as lookup with a product quantized table of 4 values per code, or more
+// when dim is not a multiple of 4, see LookupTable::compress, the codebooks
+// are learned on a small sample
+void buildLookupPQ(Case &c, const Shape &s) {
+    buildLookup(c, s);
+    LookupTable *table = static_cast<LookupTable*>(c.params.back().get());
+    // the subspaces must divide dim
+    int subspaces = std::max(1, s.dim / 4);
+    while (s.dim % subspaces != 0) {
+        subspaces--;
+    }
+    table->compress(subspaces, 4, 4096);
+    c.inference = true;
+    c.forward_bytes = F * (double)s.batch * s.dim + (double)s.batch * subspaces;
+    c.backward_flops = c.backward_bytes = 0;
+}
+
+template<typename Attention>
+void buildAttention(Case &c, const Shape &s, int weight_dim) {
+    for (int i = 0; i < s.batch; i++) {
+        Attention *n = c.node<Attention>();
+        n->setParam(s.len);
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        vector<PNode> xs, as;
+        for (int k = 0; k < s.len; k++) {
+            xs.push_back(c.input(s.dim));
+            as.push_back(c.input(weight_dim));
+        }
+        n->forward(&c.graph, xs, as);
+    }
+    double weights = (double)s.batch * s.len * weight_dim;
+    double inputs = (double)s.batch * s.len * s.dim;
+    c.forward_flops = 3 * weights + 2 * inputs;
+    c.backward_flops = 4 * weights + 4 * inputs;
+    c.forward_bytes = F * (weights + inputs + (double)s.batch * s.dim);
+    c.backward_bytes = F * (2 * weights + 2 * inputs + (double)s.batch * s.dim);
+}
+
+// self attention over batch sentences of len tokens, a node per token
+void buildMultiHeadAttention(Case &c, const Shape &s) {
+    // 4 heads, or fewer when dim is not a multiple of 4
+    int heads = s.dim % 4 == 0 ? 4 : (s.dim % 2 == 0 ? 2 : 1);
+    MultiHeadAttentionParams *param = c.param<MultiHeadAttentionParams>();
+    param->initial(s.dim, s.dim, s.dim, s.dim, s.dim, heads);
+    for (int i = 0; i < s.batch; i++) {
+        vector<PNode> xs;
+        for (int k = 0; k < s.len; k++) {
+            xs.push_back(c.input(s.dim));
+        }
+        for (int k = 0; k < s.len; k++) {
+            MultiHeadAttentionNode *n = c.node<MultiHeadAttentionNode>();
+            n->init(s.dim, -1);
+            n->setParam(param);
+            c.batch.push_back(n);
+            n->forward(&c.graph, xs[k], xs);
+        }
+    }
+    double tokens = (double)s.batch * s.len;
+    double projections = 2 * 4 * tokens * s.dim * s.dim;
+    double scores = 2 * 2 * tokens * s.len * s.dim;
+    c.forward_flops = projections + scores;
+    c.backward_flops = 2 * projections + 2 * scores;
+    c.forward_bytes = F * (4 * (double)s.dim * s.dim + 2 * tokens * s.dim +
+            heads * tokens * s.len);
+    c.backward_bytes = 2 * c.forward_bytes;
+}
+
+// one node scores all len x len pairs of a sentence
+void buildBiaffine(Case &c, const Shape &s) {
+    BiaffineParams *param = c.param<BiaffineParams>();
+    param->initial(s.dim + 1, s.dim + 1, true); // inputs are expanded by a 1
+    for (int i = 0; i < s.batch; i++) {
+        BiaffineNode *n = c.node<BiaffineNode>();
+        n->setParam(param, true, true);
+        n->init(s.len);
+        c.batch.push_back(n);
+        vector<PNode> x1, x2;
+        for (int k = 0; k < s.len; k++) {
+            x1.push_back(c.input(s.dim));
+            x2.push_back(c.input(s.dim));
+        }
+        n->forward(&c.graph, x1, x2);
+        // the scores have no loss vector, their losses are set here instead
+        for (int k = 0; k < n->classDim; k++) {
+            n->losses[k].random(1.0);
+        }
+    }
+    double d = s.dim + 1;
+    double n = s.len;
+    c.forward_flops = s.batch * (2 * n * d * d + 2 * n * n * d);
+    c.backward_flops = 2 * c.forward_flops;
+    c.forward_bytes = F * (d * d + s.batch * (2 * n * s.dim + n * n));
+    c.backward_bytes = F * (2 * d * d + s.batch * (4 * n * s.dim + n * n));
+}
+
+// every node sums len rows of a sparse table
+template<typename Node, typename Params>
+void buildSparse(Case &c, const Shape &s) {
+    const int features = 10000;
+    Params *param = c.param<Params>();
+    param->initial(c.alphabet(features), s.dim);
+    for (int i = 0; i < s.batch; i++) {
+        Node *n = c.node<Node>();
+        n->setParam(param);
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        vector<string> xs;
+        for (int k = 0; k < s.len; k++) {
+            xs.push_back("f" + std::to_string((i * s.len + k) * 7919 % features));
+        }
+        n->forward(&c.graph, xs);
+    }
+    double rows = (double)s.batch * s.len * s.dim;
+    c.forward_flops = rows;
+    c.backward_flops = rows;
+    c.forward_bytes = F * (rows + (double)s.batch * s.dim);
+    c.backward_bytes = F * (2 * rows + (double)s.batch * s.dim);
+}
+
+// label specific weights, nodes spread over the labels
+void buildTransfer(Case &c, const Shape &s) {
+    const int labels = 40;
+    TransferParams *param = c.param<TransferParams>();
+    param->initial(c.alphabet(labels), s.dim, s.dim);
+    for (int i = 0; i < s.batch; i++) {
+        TransferNode *n = c.node<TransferNode>();
+        n->setParam(param);
+        n->init(s.dim, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, c.input(s.dim), "f" + std::to_string(i % labels));
+    }
+    // every label used reads its own W
+    double used = std::min(s.batch, labels);
+    linearCost(c, s, 1, false);
+    c.forward_bytes += F * (used - 1) * s.dim * s.dim;
+    c.backward_bytes += 2 * F * (used - 1) * s.dim * s.dim;
+}
+
+// a scalar score of one action row against the input
+void buildAction(Case &c, const Shape &s) {
+    const int actions = 100;
+    ActionParams *param = c.param<ActionParams>();
+    param->initial(c.alphabet(actions), s.dim);
+    for (int i = 0; i < s.batch; i++) {
+        ActionNode *n = c.node<ActionNode>();
+        n->setParam(param);
+        n->init(1, -1);
+        c.batch.push_back(n);
+        n->forward(&c.graph, "f" + std::to_string(i % actions), c.input(s.dim));
+    }
+    double elems = (double)s.batch * s.dim;
+    c.forward_flops = 2 * elems;
+    c.backward_flops = 4 * elems;
+    c.forward_bytes = F * 2 * elems;
+    c.backward_bytes = F * 4 * elems;
+}
+
+struct Op {
+    string name;
+    Builder build;
+};
+
+vector<Op> allOps() {
+    return {
+        {"uni", buildUni},
+        {"uni_int8", buildUniInt8},
+        {"uni_bf16", buildUniBF16},
+        {"bi", buildBi},
+        {"tri", buildTri},
+        {"four", buildFour},
+        {"linear", buildLinear},
+        {"concat", buildConcat},
+        {"window_uni", buildWindowUni},
+        {"conv1d", buildConv1D},
+        {"max_pool", buildPooling<MaxPoolNode>},
+        {"min_pool", buildPooling<MinPoolNode>},
+        {"sum_pool", buildPooling<SumPoolNode>},
+        {"avg_pool", buildPooling<AvgPoolNode>},
+        {"padd", buildPAdd},
+        {"pmulti", buildPMulti},
+        {"lookup", buildLookup},
+        {"lookup_bf16", buildLookupBF16},
+        {"lookup_pq", buildLookupPQ},
+        {"attention_softmax", [](Case &c, const Shape &s) {
+            buildAttention<AttentionSoftMaxNode>(c, s, 1);
+        }},
+        {"attention_softmax_v", [](Case &c, const Shape &s) {
+            buildAttention<AttentionSoftMaxVNode>(c, s, s.dim);
+        }},
+        {"multi_head_attention", buildMultiHeadAttention},
+        {"biaffine", buildBiaffine},
+        {"sparse", buildSparse<SparseNode, SparseParams>},
+        {"ap", buildSparse<APNode, APParams>},
+        {"transfer", buildTransfer},
+        {"action", buildAction},
+    };
+}
+
+const double CACHE_LINE = 64;
+
+struct Timing {
+    double forward_ns = 0;
+    double backward_ns = 0;
+    int reps = 0;
+    PerfCounters::Counts forward, backward; // per repetition
+};
+
+void addCounts(PerfCounters::Counts &sum, const PerfCounters::Counts &counts) {
+    for (int k = 0; k < PerfCounters::COUNTERS; k++) {
+        sum.value[k] += counts.value[k];
+        sum.valid[k] = counts.valid[k];
+    }
+}
+
+Timing run(Case &c, double min_time, PerfCounters &perf) {
+    typedef std::chrono::steady_clock Clock;
+    // inputs and a first pass of the batch, which also warms the caches
+    c.graph.compute();
+    for (PNode n : c.batch) {
+        n->loss.random(1.0);
+    }
+
+    Timing t;
+    double total = 0;
+    while (total < min_time * 1e9 || t.reps < 3) {
+        Clock::time_point begin = Clock::now();
+        PExecute e = c.batch.at(0)->generate(!c.inference, 1.0);
+        e->batch = c.batch;
+        e->forward();
+        Clock::time_point middle = Clock::now();
+        if (!c.inference) {
+            e->backward();
+        }
+        Clock::time_point end = Clock::now();
+        delete e;
+
+        double f = std::chrono::duration<double, std::nano>(middle - begin).count();
+        double b = std::chrono::duration<double, std::nano>(end - middle).count();
+        t.forward_ns += f;
+        t.backward_ns += b;
+        total += f + b;
+        t.reps++;
+    }
+    t.forward_ns /= t.reps;
+    t.backward_ns /= t.reps;
+
+    // the counters are read in a pass of their own, as a read is a system
+    // call that would add to the times of the small ops
+    PerfCounters::Sample before, between, after;
+    for (int rep = 0; perf.any() && rep < t.reps; rep++) {
+        PExecute e = c.batch.at(0)->generate(!c.inference, 1.0);
+        e->batch = c.batch;
+        perf.read(before);
+        e->forward();
+        perf.read(between);
+        if (!c.inference) {
+            e->backward();
+        }
+        perf.read(after);
+        delete e;
+        addCounts(t.forward, perf.counts(before, between));
+        if (!c.inference) {
+            addCounts(t.backward, perf.counts(between, after));
+        }
+    }
+    for (int k = 0; k < PerfCounters::COUNTERS; k++) {
+        t.forward.value[k] /= t.reps;
+        t.backward.value[k] /= t.reps;
+    }
+    return t;
+}
+
+// 0 for passes without flops (e.g. the backward of inference cases)
+double bytesPerFlop(double bytes, double flops) {
+    return flops > 0 ? bytes / flops : 0;
+}
+
+// a JSON number, null for a pass that was not run or a value that is not
+// finite (e.g. a rate over a time of 0)
+string json(double value, bool run = true) {
+    if (!run || !std::isfinite(value)) {
+        return "null";
+    }
+    std::stringstream ss;
+    ss << value;
+    return ss.str();
+}
+
+// the counters of a pass as a JSON object, null when none was read
+string countersJson(const PerfCounters::Counts &counts, double flops) {
+    std::stringstream ss;
+    bool any = false;
+    for (int k = 0; k < PerfCounters::COUNTERS; k++) {
+        if (counts.valid[k]) {
+            ss << (any ? ", " : "{") << "\"" << PerfCounters::name(k) << "\": " <<
+                counts.value[k];
+            any = true;
+        }
+    }
+    if (!any) {
+        return "null";
+    }
+    if (counts.valid[PerfCounters::CYCLES] && counts.valid[PerfCounters::INSTRUCTIONS]) {
+        ss << ", \"ipc\": " << counts.ipc();
+    }
+    if (counts.valid[PerfCounters::CACHE_MISSES] && flops > 0) {
+        ss << ", \"miss_bytes_per_flop\": " <<
+            counts.value[PerfCounters::CACHE_MISSES] * CACHE_LINE / flops;
+    }
+    ss << "}";
+    return ss.str();
+}
+
+vector<int> parseInts(const string &s) {
+    vector<int> result;
+    std::stringstream ss(s);
+    string item;
+    while (std::getline(ss, item, ',')) {
+        result.push_back(atoi(item.c_str()));
+    }
+    return result;
+}
+
+vector<string> parseNames(const string &s) {
+    vector<string> result;
+    std::stringstream ss(s);
+    string item;
+    while (std::getline(ss, item, ',')) {
+        result.push_back(item);
+    }
+    return result;
+}
+
+void usage() {
+    std::cerr << "usage: op_benchmark [--ops uni,bi,...] [--batches 1,16,128]"
+        " [--dims 32,128,512] [--len 16] [--min-time 0.05] [--counters 1]" << std::endl;
+    std::cerr << "ops:";
+    for (const Op &op : allOps()) {
+        std::cerr << " " << op.name;
+    }
+    std::cerr << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    vector<int> batches = {1, 16, 128};
+    vector<int> dims = {32, 128, 512};
+    vector<string> names;
+    int len = 16;
+    double min_time = 0.05;
+    bool counters = true;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+        string value = argv[++i];
+        if (arg == "--ops") {
+            names = parseNames(value);
+        } else if (arg == "--batches") {
+            batches = parseInts(value);
+        } else if (arg == "--dims") {
+            dims = parseInts(value);
+        } else if (arg == "--len") {
+            len = atoi(value.c_str());
+        } else if (arg == "--min-time") {
+            min_time = atof(value.c_str());
+        } else if (arg == "--counters") {
+            counters = atoi(value.c_str()) != 0;
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    vector<Op> ops;
+    for (const Op &op : allOps()) {
+        bool selected = names.empty();
+        for (const string &name : names) {
+            selected = selected || name == op.name;
+        }
+        if (selected) {
+            ops.push_back(op);
+        }
+    }
+    if (ops.empty()) {
+        usage();
+        return 1;
+    }
+
+    PerfCounters perf;
+    if (counters && !perf.open()) {
+        std::cerr << "hardware counters unavailable (" << perf.why() << "), timing only" <<
+            std::endl;
+    } else if (counters && !perf.why().empty()) {
+        std::cerr << "some hardware counters unavailable (" << perf.why() << ")" << std::endl;
+    }
+
+    srand(0);
+    std::cout << "{\"dtype_bytes\": " << sizeof(dtype) << ", \"len\": " << len
+        << ", \"counters\": [";
+    bool first_counter = true;
+    for (int k = 0; k < PerfCounters::COUNTERS; k++) {
+        if (perf.available(k)) {
+            std::cout << (first_counter ? "" : ", ") << "\"" << PerfCounters::name(k) << "\"";
+            first_counter = false;
+        }
+    }
+    std::cout << "], \"results\": [";
+    bool first = true;
+    for (const Op &op : ops) {
+        for (int dim : dims) {
+            for (int batch : batches) {
+                std::cerr << op.name << " batch=" << batch << " dim=" << dim
+                    << std::endl;
+                Shape shape = {batch, dim, len};
+                std::unique_ptr<Case> c(new Case);
+                c->graph.clearValue(true);
+                op.build(*c, shape);
+                Timing t = run(*c, min_time, perf);
+
+                double elements = 0;
+                for (PNode n : c->batch) {
+                    elements += n->dim;
+                }
+                // inference cases have no backward, all its fields are null
+                bool backward = !c->inference;
+                std::cout << (first ? "" : ",") << "\n  {\"op\": \"" << op.name
+                    << "\", \"batch\": " << batch << ", \"dim\": " << dim
+                    << ", \"reps\": " << t.reps
+                    << ", \"forward_ns\": " << json(t.forward_ns)
+                    << ", \"backward_ns\": " << json(t.backward_ns, backward)
+                    << ", \"forward_ns_per_element\": " << json(t.forward_ns / elements)
+                    << ", \"backward_ns_per_element\": "
+                    << json(t.backward_ns / elements, backward)
+                    << ", \"forward_gflops\": " << json(c->forward_flops / t.forward_ns)
+                    << ", \"backward_gflops\": "
+                    << json(c->backward_flops / t.backward_ns, backward)
+                    << ", \"forward_bytes\": " << json(c->forward_bytes)
+                    << ", \"backward_bytes\": " << json(c->backward_bytes, backward)
+                    << ", \"forward_gbytes_per_s\": " << json(c->forward_bytes / t.forward_ns)
+                    << ", \"backward_gbytes_per_s\": "
+                    << json(c->backward_bytes / t.backward_ns, backward)
+                    << ", \"forward_bytes_per_flop\": "
+                    << json(bytesPerFlop(c->forward_bytes, c->forward_flops))
+                    << ", \"backward_bytes_per_flop\": "
+                    << json(bytesPerFlop(c->backward_bytes, c->backward_flops), backward)
+                    << ", \"forward_counters\": " << countersJson(t.forward, c->forward_flops)
+                    << ", \"backward_counters\": " << countersJson(t.backward, c->backward_flops)
+                    << "}";
+                first = false;
+            }
+        }
+    }
+    std::cout << "\n]}" << std::endl;
+    return 0;
+}
@@ -21,12 +21,14 @@ struct APParams {
     PAlphabet elems;
     int nVSize;
     int nDim;
+    bool hashed; // see initialHashed
 
   public:
     APParams() {
         nVSize = 0;
         nDim = 0;
         elems = NULL;
+        hashed = false;
     }
 
     inline void exportAdaParams(ModelUpdate& ada) {
@@ -46,6 +48,7 @@ struct APParams {
     inline void initial(PAlphabet alpha, int nOSize, int base = 1) {
         assert(base >= 1);
         elems = alpha;
+        hashed = false;
         nVSize = base * elems->size();
         if (base > 1) {
             std::cout << "nVSize: " << nVSize << ", Alpha Size = " << elems->size()  << ", Require more Alpha."<< std::endl;
@@ -54,7 +57,28 @@ struct APParams {
         initialWeights(nOSize);
     }
 
+    // feature hashing, no alphabet: a feature takes the row of its hash
+    // (see hash_string) modulo buckets, so features never seen before get
+    // a row too, and colliding features share theirs
+    inline void initialHashed(int buckets, int nOSize) {
+        elems = NULL;
+        hashed = true;
+        nVSize = buckets;
+        initialWeights(nOSize);
+    }
+
+    // the row of a feature hash, for callers that hash their features once
+    inline int hashedId(uint64_t hash) const {
+        return hash % nVSize;
+    }
+
     inline int getFeatureId(const string& strFeat) {
+        if (hashed) {
+            return hashedId(hash_string(strFeat));
+        }
+        if (W.frozen) {
+            return elems->find(strFeat);
+        }
         int idx = elems->from_string(strFeat);
         if(!elems->m_b_fixed && elems->m_size >= nVSize) {
             std::cout << "AP Alphabet stopped collecting features" << std::endl;
@@ -93,10 +117,18 @@ class APNode : public Node {
   public:
     //notice the output
     void forward(Graph *cg, const vector<string>& x) {
-        int featId;
         int featSize = x.size();
+        vector<int> ids(featSize);
         for (int idx = 0; idx < featSize; idx++) {
-            featId = param->getFeatureId(x[idx]);
+            ids[idx] = param->getFeatureId(x[idx]);
+        }
+        forward(cg, ids);
+    }
+
+    // ids are those of getFeatureId (e.g. converted once by str2id), the
+    // negative ones are skipped
+    void forward(Graph *cg, const vector<int>& ids) {
+        for (int featId : ids) {
             if (featId >= 0) {
                 ins.push_back(featId);
             }
@@ -105,6 +137,17 @@ class APNode : public Node {
         cg->addNode(this);
         bTrain = cg->train;
     }
+
+    // features given by their hashes, the params must be hashed
+    void forward(Graph *cg, const vector<uint64_t>& hashes) {
+        assert(param->hashed);
+        int featSize = hashes.size();
+        vector<int> ids(featSize);
+        for (int idx = 0; idx < featSize; idx++) {
+            ids[idx] = param->hashedId(hashes[idx]);
+        }
+        forward(cg, ids);
+    }
   public:
     inline void compute() {
         param->W.value(ins, val, bTrain);
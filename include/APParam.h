@@ -34,6 +34,7 @@ struct APParam : BaseParam {
     }
 
     inline void clearGrad() {
+        checkMutable("clearGrad");
         int inDim = indexers.size();
         for (int index = 0; index < inDim; index++) {
             if (!indexers[index]) continue;
@@ -53,6 +54,7 @@ struct APParam : BaseParam {
     }
 
     inline void updateAdagrad(dtype alpha, dtype reg, dtype eps) {
+        checkMutable("updateAdagrad");
         max_update++;
         int inDim = indexers.size();
         for (int index = 0; index < inDim; index++) {
@@ -66,6 +68,7 @@ struct APParam : BaseParam {
     }
 
     inline void updateAdam(dtype belta1, dtype belta2, dtype alpha, dtype reg, dtype eps) {
+        checkMutable("updateAdam");
         max_update++;
         int inDim = indexers.size();
         for (int index = 0; index < inDim; index++) {
@@ -114,6 +117,7 @@ struct APParam : BaseParam {
     }
 
     inline void rescaleGrad(dtype scale) {
+        checkMutable("rescaleGrad");
         int inDim = indexers.size();
         for (int index = 0; index < inDim; index++) {
             if (!indexers[index]) continue;
@@ -124,6 +128,7 @@ struct APParam : BaseParam {
     }
 
     inline void sumWeight(int featId) {
+        checkMutable("sumWeight");
         if (last_update[featId] < max_update) {
             int times = max_update - last_update[featId];
             for (int idx = 0; idx < val.col; idx++) {
@@ -133,6 +138,18 @@ struct APParam : BaseParam {
         }
     }
 
+    // the averaged weights of every feature are final once frozen, so that
+    // value() reads aux without touching last_update
+    inline void freeze() {
+        if (frozen) {
+            return;
+        }
+        for (int featId = 0; featId < val.row; featId++) {
+            sumWeight(featId);
+        }
+        frozen = true;
+    }
+
     inline void value(const int& featId, Tensor1D& out, const bool& bTrain) {
         if (out.dim != val.col) {
             std::cout << "warning: output dim not equal lookup param dim." << std::endl;
@@ -142,7 +159,9 @@ struct APParam : BaseParam {
                 out[idx] = val[featId][idx];
             }
         } else {
-            sumWeight(featId);
+            if (!frozen) {
+                sumWeight(featId);
+            }
             for (int idx = 0; idx < val.col; idx++) {
                 out[idx] = aux[featId][idx];
             }
@@ -165,7 +184,9 @@ struct APParam : BaseParam {
         } else {
             for (int i = 0; i < featNum; i++) {
                 featId = featIds[i];
-                sumWeight(featId);
+                if (!frozen) {
+                    sumWeight(featId);
+                }
                 for (int idx = 0; idx < val.col; idx++) {
                     out[idx] += aux[featId][idx];
                 }
@@ -174,6 +195,7 @@ struct APParam : BaseParam {
     }
 
     inline void loss(const int& featId, const Tensor1D& loss) {
+        checkMutable("loss");
         if (loss.dim != val.col) {
             std::cout << "warning: loss dim not equal lookup param dim." << std::endl;
         }
@@ -184,6 +206,7 @@ struct APParam : BaseParam {
     }
 
     inline void loss(const vector<int>& featIds, const Tensor1D& loss) {
+        checkMutable("loss");
         if (loss.dim != val.col) {
             std::cout << "warning: loss dim not equal lookup param dim." << std::endl;
         }
@@ -52,6 +52,9 @@ class ActionParams {
     }
 
     inline int getFeatureId(const string& strFeat) {
+        if (W.frozen) {
+            return elems->find(strFeat);
+        }
         int idx = elems->from_string(strFeat);
         return idx;
     }
@@ -92,7 +95,12 @@ class ActionNode : public Node {
   public:
     //notice the output
     void forward(Graph *cg, const string& ac, PNode x) {
-        actid = param->getFeatureId(ac);
+        forward(cg, param->getFeatureId(ac), x);
+    }
+
+    // id is that of getFeatureId (e.g. converted once by str2id)
+    void forward(Graph *cg, int id, PNode x) {
+        actid = id;
         in = x;
         degree = 0;
         in->addParent(this);
@@ -106,8 +114,9 @@ class ActionNode : public Node {
         }
         val[0] = 0;
         if (actid >= 0) {
+            const dtype *w = param->W.valRow(actid);
             for (int idx = 0; idx < in->dim; idx++) {
-                val[0] += in->val[idx] * param->W.val[actid][idx];
+                val[0] += in->val[idx] * w[idx];
             }
         } else {
             std::cout << "unknown action" << std::endl;
@@ -117,9 +126,11 @@ class ActionNode : public Node {
     //no output losses
     void backward() {
         if (actid >= 0) {
+            dtype *grad = param->W.gradRow(actid);
+            const dtype *w = param->W.valRow(actid);
             for (int idx = 0; idx < in->dim; idx++) {
-                in->loss[idx] += loss[0] * param->W.val[actid][idx];
-                param->W.grad[actid][idx] += loss[0] * in->val[idx];
+                in->loss[idx] += loss[0] * w[idx];
+                grad[idx] += loss[0] * in->val[idx];
             }
             param->W.indexers[actid] = true;
         }
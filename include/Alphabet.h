@@ -2,6 +2,17 @@
 #define _ALPHABET_
 
 #include "MyLib.h"
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 /*
  please check to ensure that m_size not exceeds the upbound of int
@@ -10,6 +21,12 @@
 /*
   This class serializes feature from string to int.
   Index starts from 0.
+
+  A fixed alphabet can be frozen (see freeze), the strings are then kept in
+  one arena and found through a flat open addressing table, instead of the
+  node based unordered_map and a heap allocation per string. The frozen
+  form is also a binary file (see save_binary), which load_binary maps as
+  it is. The file is in the byte order of the machine.
 */
 
 /**
@@ -28,6 +45,7 @@ class basic_quark {
     IdToString m_id_to_string;
     bool m_b_fixed;
     int m_size;
+    bool m_b_frozen;
 
   public:
     /**
@@ -51,6 +69,9 @@ class basic_quark {
      *  @return           Associated ID for the string value.
      */
     int operator[](const std::string& str) {
+        if (m_b_frozen) {
+            return frozen_find(str.data(), str.size());
+        }
         StringToId::const_iterator it = m_string_to_id.find(str);
         if (it != m_string_to_id.end()) {
             return it->second;
@@ -71,11 +92,14 @@ class basic_quark {
      * Convert ID value into the associated string value.
      *  @param  qid         ID.
      *  @param  def         Default value if the ID was out of range.
-     *  @return           String value associated with the ID.
+     *  @return           String value associated with the ID, a copy as a
+     *                    frozen alphabet keeps no std::string.
      */
-    const std::string& from_id(const int& qid, const std::string& def = "") const {
+    std::string from_id(const int& qid, const std::string& def = "") const {
         if (qid < 0 || m_size <= qid) {
             return def;
+        } else if (m_b_frozen) {
+            return std::string(m_arena + m_offsets[qid], m_offsets[qid + 1] - m_offsets[qid]);
         } else {
             return m_id_to_string[qid];
         }
@@ -89,6 +113,9 @@ class basic_quark {
      *  @return           ID if any, otherwise -1.
      */
     int from_string(const std::string& str) {
+        if (m_b_frozen) {
+            return frozen_find(str.data(), str.size());
+        }
         StringToId::const_iterator it = m_string_to_id.find(str);
         if (it != m_string_to_id.end()) {
             return it->second;
@@ -104,14 +131,133 @@ class basic_quark {
         }
     }
 
+    /**
+     * Look up a string without ever adding it, safe to call from many
+     * threads as long as nobody modifies the alphabet.
+     *  @param  str         String value.
+     *  @return           ID if any, otherwise -1.
+     */
+    int find(const std::string& str) const {
+        if (m_b_frozen) {
+            return frozen_find(str.data(), str.size());
+        }
+        StringToId::const_iterator it = m_string_to_id.find(str);
+        return it == m_string_to_id.end() ? -1 : it->second;
+    }
+
+    /**
+     * As find, for len chars at str, with no std::string built when frozen.
+     */
+    int find(const char* str, size_t len) const {
+        if (m_b_frozen) {
+            return frozen_find(str, len);
+        }
+        return find(std::string(str, len));
+    }
+
+    int find(const char* str) const {
+        return find(str, strlen(str));
+    }
+
+#if __cplusplus >= 201703L
+    int find(std::string_view str) const {
+        return find(str.data(), str.size());
+    }
+#endif
+
+    /**
+     * Freeze a fixed alphabet: the strings move to one arena indexed by a
+     * flat hash table, the maps are freed. Lookups are then read only and
+     * safe from many threads. set_fixed_flag(false) thaws it.
+     */
+    void freeze() {
+        if (m_b_frozen) {
+            return;
+        }
+        m_frozen = pack(m_frozen_bytes);
+        point();
+        StringToId().swap(m_string_to_id);
+        IdToString().swap(m_id_to_string);
+        m_b_fixed = true;
+        m_b_frozen = true;
+    }
+
+    bool is_frozen() const {
+        return m_b_frozen;
+    }
+
+    /**
+     * Write the frozen form of the alphabet, frozen or not, to path.
+     */
+    void save_binary(const std::string& path) const {
+        size_t bytes = m_frozen_bytes;
+        std::shared_ptr<const char> data = m_b_frozen ? m_frozen : pack(bytes);
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (fp == NULL || fwrite(data.get(), 1, bytes, fp) != bytes) {
+            std::cout << "Alphabet: cannot write " << path << std::endl;
+            abort();
+        }
+        fclose(fp);
+    }
+
+    /**
+     * Map a file of save_binary as a frozen alphabet, nothing is parsed or
+     * copied, pages are read on use.
+     */
+    void load_binary(const std::string& path) {
+        clear();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+            std::cout << "Alphabet: cannot read " << path << std::endl;
+            abort();
+        }
+        size_t bytes = st.st_size;
+        void* base = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            std::cout << "Alphabet: cannot map " << path << std::endl;
+            abort();
+        }
+        m_frozen = std::shared_ptr<const char>((const char*)base, [bytes](const char* p) {
+            munmap((void*)p, bytes);
+        });
+        m_frozen_bytes = bytes;
+        const Header* header = (const Header*)base;
+        // the counts are checked before frozen_size, which a corrupt header
+        // would overflow, and so that lookups end on an empty slot
+        uint64_t slots = header->slots;
+        bool valid = memcmp(header->magic, magic(), sizeof(header->magic)) == 0 &&
+            header->size <= (uint64_t)INT_MAX && header->arena <= bytes &&
+            slots >= 2 && (slots & (slots - 1)) == 0 && slots <= bytes / sizeof(Slot) &&
+            3 * slots >= 4 * header->size;
+        if (!valid || frozen_size(header->size, slots, header->arena) != bytes) {
+            std::cout << "Alphabet: " << path << " is not an alphabet of save_binary" << std::endl;
+            abort();
+        }
+        point();
+        m_b_fixed = true;
+        m_b_frozen = true;
+    }
+
     void clear() {
         m_string_to_id.clear();
         m_id_to_string.clear();
         m_b_fixed = false;
         m_size = 0;
+        m_b_frozen = false;
+        m_frozen.reset();
+        m_frozen_bytes = 0;
+        m_offsets = NULL;
+        m_slots = NULL;
+        m_arena = NULL;
+        m_mask = 0;
     }
 
     void set_fixed_flag(bool bfixed) {
+        if (!bfixed && m_b_frozen) {
+            thaw();
+        }
         m_b_fixed = bfixed;
         if (!m_b_fixed && m_size >= max_capacity) {
             m_b_fixed = true;
@@ -150,7 +296,7 @@ class basic_quark {
     void write(std::ofstream &outf) const {
         outf << m_size << std::endl;
         for (int i = 0; i < m_size; i++) {
-            outf << m_id_to_string[i] << " " << i << std::endl;
+            outf << from_id(i) << " " << i << std::endl;
         }
     }
 
@@ -194,6 +340,130 @@ class basic_quark {
         }
     }
 
+  private:
+    static const char* magic() {
+        return "N3LDGAB1";
+    }
+
+    // the frozen form, in memory as in the file: the header, then the
+    // offsets of the strings in the arena (m_size + 1), the slots, the arena
+    struct Header {
+        char magic[8];
+        uint64_t size;
+        uint64_t slots; // a power of 2, at least 4 / 3 of the strings
+        uint64_t arena;
+    };
+
+    // a slot holds where its string is, so that a lookup reads the slot
+    // and the string only
+    struct Slot {
+        uint32_t hash; // the high half of the hash of the string
+        int32_t id; // -1 when empty
+        uint64_t chars; // offset in the arena << LENGTH_BITS | length
+    };
+
+    static const int LENGTH_BITS = 24;
+
+    std::shared_ptr<const char> m_frozen; // owned or mapped, shared by copies
+    size_t m_frozen_bytes = 0;
+    const uint64_t* m_offsets = NULL;
+    const Slot* m_slots = NULL;
+    const char* m_arena = NULL;
+    uint64_t m_mask = 0;
+
+    static size_t frozen_size(uint64_t size, uint64_t slots, uint64_t arena) {
+        return sizeof(Header) + (size + 1) * sizeof(uint64_t) + slots * sizeof(Slot) + arena;
+    }
+
+    inline int frozen_find(const char* str, size_t len) const {
+        uint64_t h = hash_string(str, len);
+        uint32_t tag = h >> 32;
+        for (uint64_t k = h & m_mask;; k = (k + 1) & m_mask) {
+            const Slot& slot = m_slots[k];
+            if (slot.id < 0) {
+                return -1;
+            }
+            if (slot.hash == tag && (slot.chars & ((1 << LENGTH_BITS) - 1)) == len &&
+                    memcmp(m_arena + (slot.chars >> LENGTH_BITS), str, len) == 0) {
+                return slot.id;
+            }
+        }
+    }
+
+    // builds the frozen form of the strings of m_id_to_string
+    std::shared_ptr<const char> pack(size_t& bytes) const {
+        uint64_t arena = 0;
+        for (const std::string& str : m_id_to_string) {
+            if (str.size() >= (1 << LENGTH_BITS)) {
+                std::cout << "Alphabet: cannot freeze a string of " << str.size() << " chars" << std::endl;
+                abort();
+            }
+            arena += str.size();
+        }
+        // loads of at most 3 / 4, probes mostly stay in a cache line
+        uint64_t slots = 2;
+        while (3 * slots < 4 * (uint64_t)m_size) {
+            slots <<= 1;
+        }
+        bytes = frozen_size(m_size, slots, arena);
+        // uint64_t storage, for the alignment of the header and offsets
+        uint64_t* data = new uint64_t[(bytes + 7) / 8];
+        char* base = (char*)data;
+        Header* header = (Header*)base;
+        memcpy(header->magic, magic(), sizeof(header->magic));
+        header->size = m_size;
+        header->slots = slots;
+        header->arena = arena;
+        uint64_t* offsets = (uint64_t*)(base + sizeof(Header));
+        Slot* table = (Slot*)(offsets + m_size + 1);
+        char* chars = (char*)(table + slots);
+        for (uint64_t k = 0; k < slots; k++) {
+            table[k].hash = 0;
+            table[k].id = -1;
+            table[k].chars = 0;
+        }
+        offsets[0] = 0;
+        for (int i = 0; i < m_size; i++) {
+            const std::string& str = m_id_to_string[i];
+            memcpy(chars + offsets[i], str.data(), str.size());
+            offsets[i + 1] = offsets[i] + str.size();
+            uint64_t h = hash_string(str);
+            uint64_t k = h & (slots - 1);
+            while (table[k].id >= 0) {
+                k = (k + 1) & (slots - 1);
+            }
+            table[k].hash = h >> 32;
+            table[k].id = i;
+            table[k].chars = offsets[i] << LENGTH_BITS | str.size();
+        }
+        return std::shared_ptr<const char>(base, [data](const char*) {
+            delete[] data;
+        });
+    }
+
+    // points into m_frozen
+    void point() {
+        const char* base = m_frozen.get();
+        const Header* header = (const Header*)base;
+        m_size = header->size;
+        m_offsets = (const uint64_t*)(base + sizeof(Header));
+        m_slots = (const Slot*)(m_offsets + m_size + 1);
+        m_arena = (const char*)(m_slots + header->slots);
+        m_mask = header->slots - 1;
+    }
+
+    // back to the maps, so that strings can be added again
+    void thaw() {
+        int size = m_size;
+        IdToString strings;
+        for (int i = 0; i < size; i++) {
+            strings.push_back(from_id(i));
+        }
+        clear();
+        for (const std::string& str : strings) {
+            from_string(str);
+        }
+    }
 };
 
 typedef basic_quark Alphabet;
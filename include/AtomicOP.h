@@ -71,6 +71,16 @@ class ActivateNode :public Node {
         in->loss.vec() += loss.vec() * in->val.vec().binaryExpr(val.vec(), ptr_fun(derivate));
     }
 
+#if !USE_GPU
+    bool toElementwise(ElementwiseOp &op) const override {
+        op.kind = ElementwiseOp::ACTIVATE;
+        op.ins = {in};
+        op.activate = activate;
+        op.derivate = derivate;
+        return true;
+    }
+#endif
+
   public:
     inline PExecute generate(bool bTrain, dtype cur_drop_factor);
 
@@ -147,6 +157,16 @@ class TanhNode :public Node {
         in->loss.vec() += loss.vec() * in->val.vec().binaryExpr(val.vec(), ptr_fun(dtanh));
     }
 
+#if !USE_GPU
+    bool toElementwise(ElementwiseOp &op) const override {
+        op.kind = ElementwiseOp::ACTIVATE;
+        op.ins = {in};
+        op.activate = ftanh;
+        op.derivate = dtanh;
+        return true;
+    }
+#endif
+
   public:
     inline PExecute generate(bool bTrain, dtype cur_drop_factor);
 
@@ -343,6 +363,16 @@ class SigmoidNode :public Node {
         in->loss.vec() += loss.vec() * in->val.vec().binaryExpr(val.vec(), ptr_fun(dsigmoid));
     }
 
+#if !USE_GPU
+    bool toElementwise(ElementwiseOp &op) const override {
+        op.kind = ElementwiseOp::ACTIVATE;
+        op.ins = {in};
+        op.activate = fsigmoid;
+        op.derivate = dsigmoid;
+        return true;
+    }
+#endif
+
   public:
     inline PExecute generate(bool bTrain, dtype cur_drop_factor);
 
@@ -401,15 +431,6 @@ public:
     void  forward() {
         int count = batch.size();
         //#pragma omp parallel for
-        n3ldg_cuda::Profiler &profiler = n3ldg_cuda::Profiler::Ins();
-        profiler.BeginEvent("Sigmoid no-batch backward");
-        for (int idx = 0; idx < count; idx++) {
-            batch[idx]->backward_drop();
-            batch[idx]->backward();
-        }
-        profiler.EndEvent();
-
-        profiler.BeginEvent("Sigmoid batch backward");
 
         sumDim = 0;
         for (int idx = 0; idx < count; idx++) {
@@ -439,7 +460,6 @@ public:
             offset += ptr->dim;
             ptr->forward_drop(bTrain, drop_factor);
         }
-        profiler.EndEvent();
     }
 #endif
 
@@ -477,15 +497,6 @@ public:
     void backward() {
         int count = batch.size();
         //#pragma omp parallel for
-        n3ldg_cuda::Profiler &profiler = n3ldg_cuda::Profiler::Ins();
-        profiler.BeginEvent("Sigmoid no-batch backward");
-        for (int idx = 0; idx < count; idx++) {
-            batch[idx]->backward_drop();
-            batch[idx]->backward();
-        }
-        profiler.EndEvent();
-
-        profiler.BeginEvent("Sigmoid batch backward");
 
         Tensor1D lx, ly;
         lx.init(sumDim);
@@ -511,8 +522,6 @@ public:
             }
             offset += ptr->dim;
         }
-        profiler.EndEvent();
-
     }
 #endif
 };
@@ -564,6 +573,16 @@ class ReluNode :public Node {
         in->loss.vec() += loss.vec() * in->val.vec().binaryExpr(val.vec(), ptr_fun(drelu));
     }
 
+#if !USE_GPU
+    bool toElementwise(ElementwiseOp &op) const override {
+        op.kind = ElementwiseOp::ACTIVATE;
+        op.ins = {in};
+        op.activate = frelu;
+        op.derivate = drelu;
+        return true;
+    }
+#endif
+
   public:
     inline PExecute generate(bool bTrain, dtype cur_drop_factor);
 
@@ -729,6 +748,14 @@ class PSubNode : public Node {
         in2->loss.vec() -= loss.vec();
     }
 
+#if !USE_GPU
+    bool toElementwise(ElementwiseOp &op) const override {
+        op.kind = ElementwiseOp::SUB;
+        op.ins = {in1, in2};
+        return true;
+    }
+#endif
+
   public:
     // better to rewrite for deep understanding
     inline bool typeEqual(PNode other) {
@@ -817,6 +844,14 @@ class PDotNode : public Node {
         }
     }
 
+#if !USE_GPU
+    bool toElementwise(ElementwiseOp &op) const override {
+        op.kind = ElementwiseOp::DOT;
+        op.ins = {in1, in2};
+        return true;
+    }
+#endif
+
   public:
     // better to rewrite for deep understanding
     inline bool typeEqual(PNode other) {
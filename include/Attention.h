@@ -51,7 +51,7 @@ class AttentionBuilder {
     int _nHiddenDim;
     int _nGuideDim;
 
-    vector<BiNode> _weights;
+    vector<BiNode*> _weights;
     AttentionSoftMaxNode _hidden;
 
     AttentionParams* _param;
@@ -66,11 +66,6 @@ class AttentionBuilder {
     }
 
   public:
-    inline void resize(int maxsize) {
-        _weights.resize(maxsize);
-        _hidden.setParam(maxsize);
-    }
-
     inline void clear() {
         _weights.clear();
     }
@@ -81,14 +76,13 @@ class AttentionBuilder {
         _nHiddenDim = _param->hidden_dim;
         _nGuideDim = _param->guide_dim;
 
-        int maxsize = _weights.size();
-        for (int idx = 0; idx < maxsize; idx++) {
-            _weights[idx].setParam(&_param->bi_atten);
-            _weights[idx].init(1, -1);
-        }
         _hidden.init(_nHiddenDim, -1);
     }
 
+    // no-op, forward takes the nodes from Graph::newNode
+    N3LDG_DEPRECATED inline void resize(int) {
+    }
+
   public:
     inline void forward(Graph *cg, const vector<PNode>& x, PNode guide) {
         if (x.size() == 0) {
@@ -101,12 +95,17 @@ class AttentionBuilder {
             return;
         }
 
+        _weights.resize(_nSize);
         vector<PNode> aligns;
         for (int idx = 0; idx < _nSize; idx++) {
-            _weights[idx].forward(cg, x[idx], guide);
-            aligns.push_back(&_weights[idx]);
+            _weights[idx] = cg->newNode<BiNode>(1);
+            _weights[idx]->setParam(&_param->bi_atten);
+            _weights[idx]->setFunctions(&ftanh, &dtanh);
+            _weights[idx]->forward(cg, x[idx], guide);
+            aligns.push_back(_weights[idx]);
         }
 
+        _hidden.setParam(_nSize);
         _hidden.forward(cg, x, aligns);
     }
 
@@ -149,7 +148,7 @@ class AttentionVBuilder {
     int _nHiddenDim;
     int _nGuideDim;
 
-    vector<BiNode> _weights;
+    vector<BiNode*> _weights;
     AttentionSoftMaxVNode _hidden;
     AttentionVParams* _param;
 
@@ -163,11 +162,6 @@ class AttentionVBuilder {
     }
 
   public:
-    inline void resize(int maxsize) {
-        _weights.resize(maxsize);
-        _hidden.setParam(maxsize);
-    }
-
     inline void clear() {
         _weights.clear();
     }
@@ -178,14 +172,13 @@ class AttentionVBuilder {
         _nHiddenDim = _param->hidden_dim;
         _nGuideDim = _param->guide_dim;
 
-        int maxsize = _weights.size();
-        for (int idx = 0; idx < maxsize; idx++) {
-            _weights[idx].setParam(&_param->bi_atten);
-            _weights[idx].init(_nHiddenDim, -1);
-        }
         _hidden.init(_nHiddenDim, -1);
     }
 
+    // no-op, forward takes the nodes from Graph::newNode
+    N3LDG_DEPRECATED inline void resize(int) {
+    }
+
   public:
     inline void forward(Graph *cg, const vector<PNode>& x, PNode guide) {
         if (x.size() == 0) {
@@ -198,11 +191,17 @@ class AttentionVBuilder {
             return;
         }
 
+        _weights.resize(_nSize);
         vector<PNode> aligns;
         for (int idx = 0; idx < _nSize; idx++) {
-            _weights[idx].forward(cg, x[idx], guide);
-            aligns.push_back(&_weights[idx]);
+            _weights[idx] = cg->newNode<BiNode>(_nHiddenDim);
+            _weights[idx]->setParam(&_param->bi_atten);
+            _weights[idx]->setFunctions(&ftanh, &dtanh);
+            _weights[idx]->forward(cg, x[idx], guide);
+            aligns.push_back(_weights[idx]);
         }
+
+        _hidden.setParam(_nSize);
         _hidden.forward(cg, x, aligns);
     }
 };
@@ -240,7 +239,7 @@ class SelfAttentionBuilder {
     int _nSize;
     int _nHiddenDim;
 
-    vector<UniNode> _weights;
+    vector<UniNode*> _weights;
     AttentionSoftMaxNode _hidden;
 
     SelfAttentionParams* _param;
@@ -255,11 +254,6 @@ class SelfAttentionBuilder {
     }
 
   public:
-    inline void resize(int maxsize) {
-        _weights.resize(maxsize);
-        _hidden.setParam(maxsize);
-    }
-
     inline void clear() {
         _weights.clear();
     }
@@ -269,14 +263,13 @@ class SelfAttentionBuilder {
         _param = paramInit;
         _nHiddenDim = _param->hidden_dim;
 
-        int maxsize = _weights.size();
-        for (int idx = 0; idx < maxsize; idx++) {
-            _weights[idx].setParam(&_param->uni_atten);
-            _weights[idx].init(1, -1);
-        }
         _hidden.init(_nHiddenDim, -1);
     }
 
+    // no-op, forward takes the nodes from Graph::newNode
+    N3LDG_DEPRECATED inline void resize(int) {
+    }
+
   public:
     inline void forward(Graph *cg, const vector<PNode>& x) {
         if (x.size() == 0) {
@@ -289,12 +282,17 @@ class SelfAttentionBuilder {
             return;
         }
 
+        _weights.resize(_nSize);
         vector<PNode> aligns;
         for (int idx = 0; idx < _nSize; idx++) {
-            _weights[idx].forward(cg, x[idx]);
-            aligns.push_back(&_weights[idx]);
+            _weights[idx] = cg->newNode<UniNode>(1);
+            _weights[idx]->setParam(&_param->uni_atten);
+            _weights[idx]->setFunctions(&ftanh, &dtanh);
+            _weights[idx]->forward(cg, x[idx]);
+            aligns.push_back(_weights[idx]);
         }
 
+        _hidden.setParam(_nSize);
         _hidden.forward(cg, x, aligns);
     }
 
@@ -334,7 +332,7 @@ class SelfAttentionVBuilder {
     int _nSize;
     int _nHiddenDim;
 
-    vector<UniNode> _weights;
+    vector<UniNode*> _weights;
     AttentionSoftMaxVNode _hidden;
     SelfAttentionVParams* _param;
 
@@ -348,11 +346,6 @@ class SelfAttentionVBuilder {
     }
 
   public:
-    inline void resize(int maxsize) {
-        _weights.resize(maxsize);
-        _hidden.setParam(maxsize);
-    }
-
     inline void clear() {
         _weights.clear();
     }
@@ -362,14 +355,13 @@ class SelfAttentionVBuilder {
         _param = paramInit;
         _nHiddenDim = _param->hidden_dim;
 
-        int maxsize = _weights.size();
-        for (int idx = 0; idx < maxsize; idx++) {
-            _weights[idx].setParam(&_param->uni_atten);
-            _weights[idx].init(_nHiddenDim, -1);
-        }
         _hidden.init(_nHiddenDim, -1);
     }
 
+    // no-op, forward takes the nodes from Graph::newNode
+    N3LDG_DEPRECATED inline void resize(int) {
+    }
+
   public:
     inline void forward(Graph *cg, const vector<PNode>& x) {
         if (x.size() == 0) {
@@ -382,11 +374,17 @@ class SelfAttentionVBuilder {
             return;
         }
 
+        _weights.resize(_nSize);
         vector<PNode> aligns;
         for (int idx = 0; idx < _nSize; idx++) {
-            _weights[idx].forward(cg, x[idx]);
-            aligns.push_back(&_weights[idx]);
+            _weights[idx] = cg->newNode<UniNode>(_nHiddenDim);
+            _weights[idx]->setParam(&_param->uni_atten);
+            _weights[idx]->setFunctions(&ftanh, &dtanh);
+            _weights[idx]->forward(cg, x[idx]);
+            aligns.push_back(_weights[idx]);
         }
+
+        _hidden.setParam(_nSize);
         _hidden.forward(cg, x, aligns);
     }
 };
@@ -60,7 +60,9 @@ public:
         sum = 0;
     }
 
+    // only grows, builders call it with the input size before forward
     inline void setParam(int maxsize) {
+        if (maxsize <= (int)masks.size()) return;
         masks.resize(maxsize);
         mask_losses.resize(maxsize);
         unnormed_masks.resize(maxsize);
@@ -117,9 +119,14 @@ public:
     inline void compute() {
         int nSize = ins.size();
 
+        // the max score is subtracted so that fexp never overflows
+        dtype max_score = unnormeds[0]->val[0];
+        for (int i = 1; i < nSize; ++i) {
+            max_score = std::max(max_score, unnormeds[i]->val[0]);
+        }
         sum = 0;
         for (int i = 0; i < nSize; ++i) {
-            unnormed_masks[i] = fexp(unnormeds[i]->val[0]);
+            unnormed_masks[i] = fexp(unnormeds[i]->val[0] - max_score);
             sum += unnormed_masks[i];
         }
 
@@ -135,24 +142,20 @@ public:
 
     void backward() {
         int nSize = ins.size();
+        dtype weighted = 0;
         for (int i = 0; i < nSize; i++) {
             ins[i]->loss.vec() += loss.vec() * masks[i];
             mask_losses[i] = 0;
             for (int idx = 0; idx < dim; idx++) {
                 mask_losses[i] += loss[idx] * ins[i]->val[idx];
             }
+            weighted += masks[i] * mask_losses[i];
         }
 
+        // softmax jacobian times mask_losses, m_i * (ml_i - sum_j m_j * ml_j)
         for (int i = 0; i < nSize; i++) {
-            for (int j = 0; j < nSize; j++) {
-                unnormeds[i]->loss[0] -= masks[i] * masks[j] * mask_losses[j];
-                if (i == j) {
-                    unnormeds[i]->loss[0] += masks[i] * mask_losses[i];
-                }
-            }
+            unnormeds[i]->loss[0] += masks[i] * (mask_losses[i] - weighted);
         }
-
-
     }
 
 };
@@ -264,23 +267,73 @@ public:
     }
 };
 #else
+// the scores of the batch are packed, those of the idx-th node at
+// [offsets[idx], offsets[idx + 1]), so that fexp runs over all of them at once
 class AttentionSoftMaxExecute : public Execute {
   public:
+    int dim;
+    std::vector<int> offsets;
+    Tensor1D mask;
+
     inline void  forward() {
         int count = batch.size();
-        //#pragma omp parallel for
+        offsets.resize(count + 1);
+        offsets[0] = 0;
+        for (int idx = 0; idx < count; idx++) {
+            AttentionSoftMaxNode* ptr = (AttentionSoftMaxNode*)batch[idx];
+            offsets[idx + 1] = offsets[idx] + ptr->ins.size();
+        }
+        mask.init(offsets[count]);
+
+        // the max score of each node is subtracted so that fexp never overflows
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->compute();
-            batch[idx]->forward_drop(bTrain, drop_factor);
+            AttentionSoftMaxNode* ptr = (AttentionSoftMaxNode*)batch[idx];
+            int nSize = ptr->ins.size();
+            dtype max_score = ptr->unnormeds[0]->val[0];
+            for (int i = 1; i < nSize; i++) {
+                max_score = std::max(max_score, ptr->unnormeds[i]->val[0]);
+            }
+            for (int i = 0; i < nSize; i++) {
+                mask[offsets[idx] + i] = ptr->unnormeds[i]->val[0] - max_score;
+            }
+        }
+        mask.mat() = mask.mat().array().exp().matrix();
+
+        for (int idx = 0; idx < count; idx++) {
+            AttentionSoftMaxNode* ptr = (AttentionSoftMaxNode*)batch[idx];
+            int nSize = ptr->ins.size();
+            dtype *m = mask.v + offsets[idx];
+            ptr->sum = 0;
+            for (int i = 0; i < nSize; i++) {
+                ptr->sum += m[i];
+            }
+            ptr->val.zero();
+            for (int i = 0; i < nSize; i++) {
+                m[i] /= ptr->sum;
+                ptr->masks[i] = m[i];
+                ptr->val.vec() += ptr->ins[i]->val.vec() * m[i];
+            }
+            ptr->forward_drop(bTrain, drop_factor);
         }
     }
 
     inline void backward() {
         int count = batch.size();
-        //#pragma omp parallel for
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->backward_drop();
-            batch[idx]->backward();
+            AttentionSoftMaxNode* ptr = (AttentionSoftMaxNode*)batch[idx];
+            ptr->backward_drop();
+            int nSize = ptr->ins.size();
+            dtype *m = mask.v + offsets[idx];
+            // O(n) jacobian vector product of softmax
+            dtype weighted = 0;
+            for (int i = 0; i < nSize; i++) {
+                ptr->mask_losses[i] = ptr->ins[i]->val.mat().cwiseProduct(ptr->loss.mat()).sum();
+                weighted += m[i] * ptr->mask_losses[i];
+            }
+            for (int i = 0; i < nSize; i++) {
+                ptr->ins[i]->loss.vec() += ptr->loss.vec() * m[i];
+                ptr->unnormeds[i]->loss[0] += m[i] * (ptr->mask_losses[i] - weighted);
+            }
         }
     }
 };
@@ -291,9 +344,7 @@ inline PExecute AttentionSoftMaxNode::generate(bool bTrain, dtype cur_drop_facto
     exec->batch.push_back(this);
     exec->bTrain = bTrain;
     exec->drop_factor = cur_drop_factor;
-#if USE_GPU
     exec->dim = dim;
-#endif
     return exec;
 }
 
@@ -330,10 +381,23 @@ class AttentionSoftMaxVNode : public Node {
 #endif
     }
 
+    // only grows, builders call it with the input size before forward
     inline void setParam(int maxsize) {
-        masks.resize(maxsize);
-        mask_losses.resize(maxsize);
-        unnormed_masks.resize(maxsize);
+        int count = masks.size();
+        if (maxsize <= count) return;
+        // tensors are not copyable, so they are allocated again after init
+        vector<Tensor1D> new_masks(maxsize), new_mask_losses(maxsize);
+        vector<Tensor1D> new_unnormed_masks(maxsize);
+        if (dim > 0) {
+            for (int idx = 0; idx < maxsize; idx++) {
+                new_masks[idx].init(dim);
+                new_mask_losses[idx].init(dim);
+                new_unnormed_masks[idx].init(dim);
+            }
+        }
+        masks.swap(new_masks);
+        mask_losses.swap(new_mask_losses);
+        unnormed_masks.swap(new_unnormed_masks);
     }
 
 
@@ -397,9 +461,16 @@ class AttentionSoftMaxVNode : public Node {
     inline void compute() {
         int nSize = ins.size();
 
+        // the max score of each dim is subtracted so that fexp never overflows
+        Tensor1D max_scores;
+        max_scores.init(dim);
+        max_scores.vec() = unnormeds[0]->val.vec();
+        for (int i = 1; i < nSize; ++i) {
+            max_scores.vec() = max_scores.vec().cwiseMax(unnormeds[i]->val.vec());
+        }
         sum.zero();
         for (int i = 0; i < nSize; ++i) {
-            unnormed_masks[i].vec() = unnormeds[i]->val.vec().unaryExpr(ptr_fun(fexp));
+            unnormed_masks[i].vec() = (unnormeds[i]->val.vec() - max_scores.vec()).unaryExpr(ptr_fun(fexp));
             sum.vec() += unnormed_masks[i].vec();
         }
 
@@ -415,23 +486,18 @@ class AttentionSoftMaxVNode : public Node {
 
     void backward() {
         int nSize = ins.size();
+        Tensor1D weighted;
+        weighted.init(dim);
         for (int i = 0; i < nSize; i++) {
             ins[i]->loss.vec() += loss.vec() * masks[i].vec();
             mask_losses[i].vec() = loss.vec() * ins[i]->val.vec();
+            weighted.vec() += masks[i].vec() * mask_losses[i].vec();
         }
 
-        for (int idx = 0; idx < dim; idx++) {
-            for (int i = 0; i < nSize; i++) {
-                for (int j = 0; j < nSize; j++) {
-                    unnormeds[i]->loss[idx] -= masks[i][idx] * masks[j][idx] * mask_losses[j][idx];
-                    if (i == j) {
-                        unnormeds[i]->loss[idx] += masks[i][idx] * mask_losses[i][idx];
-                    }
-                }
-            }
+        // softmax jacobian of each dim times mask_losses
+        for (int i = 0; i < nSize; i++) {
+            unnormeds[i]->loss.vec() += masks[i].vec() * (mask_losses[i].vec() - weighted.vec());
         }
-
-
     }
 
 };
@@ -550,23 +616,54 @@ public:
     }
 };
 #else
+// a softmax for each dim, computed in the mask buffers of the nodes, which
+// are kept across graphs, a packed copy costs more than it saves here
 class AttentionSoftMaxVExecute : public Execute {
   public:
+    int dim;
+
     inline void  forward() {
         int count = batch.size();
-        //#pragma omp parallel for
+        Matrix<dtype, 1, Dynamic> max_scores(dim);
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->compute();
-            batch[idx]->forward_drop(bTrain, drop_factor);
+            AttentionSoftMaxVNode* ptr = (AttentionSoftMaxVNode*)batch[idx];
+            int nSize = ptr->ins.size();
+            // the max score of each dim is subtracted so that fexp never overflows
+            max_scores = ptr->unnormeds[0]->val.tmat();
+            for (int i = 1; i < nSize; i++) {
+                max_scores = max_scores.cwiseMax(ptr->unnormeds[i]->val.tmat());
+            }
+            ptr->sum.zero();
+            for (int i = 0; i < nSize; i++) {
+                ptr->masks[i].tmat() = (ptr->unnormeds[i]->val.tmat() - max_scores).array().exp().matrix();
+                ptr->sum.tmat() += ptr->masks[i].tmat();
+            }
+            ptr->val.zero();
+            for (int i = 0; i < nSize; i++) {
+                ptr->masks[i].tmat().array() /= ptr->sum.tmat().array();
+                ptr->val.tmat() += ptr->masks[i].tmat().cwiseProduct(ptr->ins[i]->val.tmat());
+            }
+            ptr->forward_drop(bTrain, drop_factor);
         }
     }
 
     inline void backward() {
         int count = batch.size();
-        //#pragma omp parallel for
+        Matrix<dtype, 1, Dynamic> weighted(dim);
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->backward_drop();
-            batch[idx]->backward();
+            AttentionSoftMaxVNode* ptr = (AttentionSoftMaxVNode*)batch[idx];
+            ptr->backward_drop();
+            int nSize = ptr->ins.size();
+            // O(n) jacobian vector product of softmax, for each dim
+            weighted.setZero();
+            for (int i = 0; i < nSize; i++) {
+                ptr->mask_losses[i].tmat() = ptr->loss.tmat().cwiseProduct(ptr->ins[i]->val.tmat());
+                weighted += ptr->masks[i].tmat().cwiseProduct(ptr->mask_losses[i].tmat());
+            }
+            for (int i = 0; i < nSize; i++) {
+                ptr->ins[i]->loss.tmat() += ptr->loss.tmat().cwiseProduct(ptr->masks[i].tmat());
+                ptr->unnormeds[i]->loss.tmat() += ptr->masks[i].tmat().cwiseProduct(ptr->mask_losses[i].tmat() - weighted);
+            }
         }
     }
 };
@@ -577,9 +674,7 @@ inline PExecute AttentionSoftMaxVNode::generate(bool bTrain, dtype cur_drop_fact
     exec->batch.push_back(this);
     exec->bTrain = bTrain;
     exec->drop_factor = cur_drop_factor;
-#if USE_GPU
     exec->dim = dim;
-#endif
     return exec;
 }
 
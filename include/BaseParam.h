@@ -17,6 +17,9 @@
 struct BaseParam {
     Tensor2D val;
     Tensor2D grad;
+    // a frozen param is read only, graphs of different threads can share it
+    // during inference, see ModelUpdate::freeze
+    bool frozen = false;
   public:
     virtual inline void initial(int outDim, int inDim) = 0;
     virtual inline void updateAdagrad(dtype alpha, dtype reg, dtype eps) = 0;
@@ -31,6 +34,21 @@ struct BaseParam {
     virtual inline void rescaleGrad(dtype scale) = 0;
     virtual inline void save(std::ofstream &os)const = 0;
     virtual inline void load(std::ifstream &is) = 0;
+
+    virtual inline void freeze() {
+        frozen = true;
+    }
+
+    inline void unfreeze() {
+        frozen = false;
+    }
+
+    inline void checkMutable(const char *operation) const {
+        if (frozen) {
+            std::cout << operation << " called on a frozen param" << std::endl;
+            abort();
+        }
+    }
 #if USE_GPU
     virtual void copyFromHostToDevice() {
         val.copyFromHostToDevice();
@@ -46,6 +46,25 @@ class BiParams {
         }
     }
 
+#if !USE_GPU
+    // int8 weights for inference, the bias stays as it is, see Param::quantize
+    inline void quantize(bool keepVal = false) {
+        W1.quantize(keepVal);
+        W2.quantize(keepVal);
+    }
+
+    // 16 bit weights for inference, see Param::toHalf
+    inline void toHalf(HalfMat::Format format = HalfMat::BF16, bool keepVal = false) {
+        W1.toHalf(format, keepVal);
+        W2.toHalf(format, keepVal);
+    }
+
+    // the executes multiply by Param::multiply rather than by val
+    inline bool isCompressed() const {
+        return W1.isCompressed() || W2.isCompressed();
+    }
+#endif
+
     inline void save(std::ofstream &os) const {
         os << bUseB << std::endl;
         W1.save(os);
@@ -223,7 +242,16 @@ class LinearBiNode : public Node {
 
   public:
     inline void compute() {
+#if !USE_GPU
+        if (param->isCompressed()) {
+            param->W1.multiply(in1->val.v, 1, val.v, false);
+            param->W2.multiply(in2->val.v, 1, val.v, true);
+        } else {
+            val.mat() = param->W1.val.mat() * in1->val.mat() + param->W2.val.mat() * in2->val.mat();
+        }
+#else
         val.mat() = param->W1.val.mat() * in1->val.mat() + param->W2.val.mat() * in2->val.mat();
+#endif
 
         if (param->bUseB) {
             val.vec() += param->b.val.vec();
@@ -269,6 +297,11 @@ class BiExecute :public Execute {
     BiParams* param;
     dtype(*activate)(const dtype&);   // activation function
     dtype(*derivate)(const dtype&, const dtype&);  // derivation function of activation function
+
+    double flops() const override {
+        return weightFlops(inDim1 + inDim2, outDim);
+    }
+
 #if USE_GPU
     void forward() {
         int count = batch.size();
@@ -381,7 +414,12 @@ class BiExecute :public Execute {
             }
         }
 
-        ty.mat() = param->W1.val.mat() * x1.mat() + param->W2.val.mat() * x2.mat();
+        if (param->isCompressed()) {
+            param->W1.multiply(x1.v, count, ty.v, false);
+            param->W2.multiply(x2.v, count, ty.v, true);
+        } else {
+            ty.mat() = param->W1.val.mat() * x1.mat() + param->W2.val.mat() * x2.mat();
+        }
 
         if (param->bUseB) {
             ty.vec() = ty.vec() + b.vec();
@@ -555,6 +593,12 @@ inline PExecute BiNode::generate(bool bTrain, dtype cur_drop_factor) {
 
 class LinearBiExecute :public Execute {
   public:
+    // the nodes of a batch share their param
+    double flops() const override {
+        BiParams *param = static_cast<LinearBiNode*>(batch.at(0))->param;
+        return weightFlops(param->W1.inDim() + param->W2.inDim(), param->W1.outDim());
+    }
+
     inline void  forward() {
         int count = batch.size();
         //#pragma omp parallel for
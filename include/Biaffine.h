@@ -72,20 +72,21 @@ class BiaffineParams {
     }
 };
 
+// scores every pair of in1 x in2 for each class,
+// vals[c][i][j] = [in1[i], 1] * W[c] * [in2[j], 1]^T + b[c]
+// the scores are filled in by BiaffineExecute, losses are set by the caller
 class BiaffineNode : public Node {
   public:
     vector<PNode> in1, in2;
-    Tensor2D x1, x2;//concat nodes in in1 by y
 
     bool expandIn1, expandIn2;
     BiaffineParams* param;
     int nSize;
     int classDim;
-    int inDim1, inDim2;
 
+    // dim x dim each, only the first nSize rows and cols are used
     vector<Tensor2D> vals;
     vector<Tensor2D> losses;
-    vector<Tensor2D> y1;
 
   public:
     BiaffineNode() : Node() {
@@ -106,14 +107,17 @@ class BiaffineNode : public Node {
         expandIn2 = expandIns2;
     }
 
+    // scores are kept for the next graph, losses are zeroed
     inline void clearValue() {
         Node::clearValue();
         in1.clear();
         in2.clear();
-        vals.clear();
-        losses.clear();
+        for (size_t i = 0; i < losses.size(); i++) {
+            losses[i].zero();
+        }
     }
 
+    // dim is the max number of inputs
     inline void init(int dim) {
         this->dim = dim;
         vals.resize(classDim);
@@ -129,6 +133,10 @@ class BiaffineNode : public Node {
     void forward(Graph *cg, vector<PNode> x1, vector<PNode> x2) {
         assert(x1.size() == x2.size());
         nSize = x1.size();
+        if (nSize == 0 || nSize > dim) {
+            std::cout << "biaffine node of dim " << dim << " can not score " << nSize << " inputs" << std::endl;
+            abort();
+        }
         for (int i = 0; i < nSize; i++) {
             in1.push_back(x1[i]);
             in2.push_back(x2[i]);
@@ -154,93 +162,140 @@ class BiaffineNode : public Node {
         } else
             return false;
     }
+
+    size_t typeHashCode() const override {
+        return Node::typeHashCode() ^ ::typeHashCode(param);
+    }
+
   public:
+    // the scores of a node are computed by BiaffineExecute only, with the
+    // workspaces of the batch
     inline void compute() {
-        inDim1 = in1[0]->dim;
-        inDim2 = in2[0]->dim;
-        x1.init(inDim1 + (expandIn1 ? 1 : 0), nSize);
-        x2.init(inDim2 + (expandIn2 ? 1 : 0), nSize);
-        y1.resize(classDim);
-        for (int i = 0; i < classDim; i++) {
-            y1[i].init(nSize, inDim2 + (expandIn2 ? 1 : 0));
-        }
-        for (int i = 0; i < nSize; ++i) {
-            for (int j = 0; j < inDim1; j++)
-                x1[i][j] = in1[i]->val[j];
-            if (expandIn1)
-                x1[i][inDim1] = 1;
-
-            for (int j = 0; j < inDim2; j++)
-                x2[i][j] = in2[i]->val[j];
-            if (expandIn2)
-                x2[i][inDim2] = 1;
-        }
-        for (int i = 0; i < classDim; i++) {
-            y1[i].mat() = x1.mat().transpose() * param->W[i].val.mat();
-            vals[i].mat() = y1[i].mat() * x2.mat();
-            if (param->bUseB) {
-                for (int idx = 0; idx < nSize; idx++)
-                    for (int idy = 0; idy < nSize; idy++)
-                        vals[i].mat()(idx, idy) += param->b.val.mat()(i, 0);
-            }
-        }
+        std::cout << "BiaffineNode is computed by its execute only" << std::endl;
+        abort();
     }
 
     inline void backward() {
-        vector<Tensor2D> lx1, lx2, ly1;
-        lx1.resize(classDim);
-        lx2.resize(classDim);
-        ly1.resize(classDim);
-        for (int i = 0; i < classDim; i++) {
-            lx1[i].init(inDim1 + (expandIn1 ? 1 : 0), nSize);
-            lx2[i].init(inDim2 + (expandIn2 ? 1 : 0), nSize);
-            ly1[i].init(nSize, inDim2 + (expandIn2 ? 1 : 0));
-        }
-
-        for (int i = 0; i < classDim; i++) {
-            lx2[i].mat() = y1[i].mat().transpose() * losses[i].mat();
-            ly1[i].mat() = losses[i].mat() * x2.mat().transpose();
-            lx1[i].mat() = param->W[i].val.mat() * ly1[i].mat().transpose();
-            param->W[i].grad.mat() += x1.mat() * ly1[i].mat();
-        }
-
-        if (param->bUseB) {
-            for (int i = 0; i < classDim; i++) {
-                for (int idx = 0; idx < nSize; idx++) {
-                    for (int idy = 0; idy < nSize; idy++)
-                        param->b.grad.v[i] += losses[i][idx][idy];
-                }
-            }
-        }
-        for (int i = 0; i < classDim; i++) {
-            for (int idx = 0; idx < nSize; idx++) {
-                for (int idy = 0; idy < inDim1; idy++) {
-                    in1[idx]->loss[idy] += lx1[i][idx][idy];
-                }
-                for (int idy = 0; idy < inDim2; idy++) {
-                    in2[idx]->loss[idy] += lx2[i][idx][idy];
-                }
-            }
-        }
+        std::cout << "BiaffineNode is computed by its execute only" << std::endl;
+        abort();
     }
 };
 
+// inputs of all the nodes in the batch are packed, a row per input, the
+// inputs of the idx-th node at rows [offsets[idx], offsets[idx + 1])
+// (1) W of all classes are put side by side, so that x1 * W is a single GEMM
+//     over the batch
+// (2) the rows of x1 * W of a node, read as one row per input and class, are
+//     multiplied by its x2 at once, giving the scores of all classes
+// workspaces are allocated once per batch, for the longest node
 class BiaffineExecute :public Execute {
   public:
+    BiaffineParams* param;
+    int classDim;
+    int inDim1, inDim2; // expanded
+    bool expandIn1, expandIn2;
+    std::vector<int> offsets;
+    int max_size;
+    Tensor2D x1, x2, w, y1;
+
     inline void  forward() {
         int count = batch.size();
+        BiaffineNode* first = (BiaffineNode*)batch[0];
+        expandIn1 = first->expandIn1;
+        expandIn2 = first->expandIn2;
+        inDim1 = first->in1[0]->dim + (expandIn1 ? 1 : 0);
+        inDim2 = first->in2[0]->dim + (expandIn2 ? 1 : 0);
+
+        offsets.resize(count + 1);
+        offsets[0] = 0;
+        max_size = 0;
+        for (int idx = 0; idx < count; idx++) {
+            BiaffineNode* ptr = (BiaffineNode*)batch[idx];
+            offsets[idx + 1] = offsets[idx] + ptr->nSize;
+            max_size = std::max(max_size, ptr->nSize);
+        }
+        int total = offsets[count];
+        x1.init(total, inDim1);
+        x2.init(total, inDim2);
+        for (int idx = 0; idx < count; idx++) {
+            BiaffineNode* ptr = (BiaffineNode*)batch[idx];
+            for (int i = 0; i < ptr->nSize; i++) {
+                int row = offsets[idx] + i;
+                memcpy(x1[row], ptr->in1[i]->val.v, ptr->in1[i]->dim * sizeof(dtype));
+                if (expandIn1) x1[row][inDim1 - 1] = 1;
+                memcpy(x2[row], ptr->in2[i]->val.v, ptr->in2[i]->dim * sizeof(dtype));
+                if (expandIn2) x2[row][inDim2 - 1] = 1;
+            }
+        }
+
+        w.init(inDim1, classDim * inDim2);
+        for (int c = 0; c < classDim; c++) {
+            w.mat().middleCols(c * inDim2, inDim2) = param->W[c].val.mat();
+        }
+        y1.init(total, classDim * inDim2);
+        y1.mat() = x1.mat() * w.mat();
 
+        Tensor2D scores;
+        scores.init(max_size * classDim, max_size);
         for (int idx = 0; idx < count; idx++) {
             BiaffineNode* ptr = (BiaffineNode*)batch[idx];
-            ptr->compute();
+            int n = ptr->nSize, offset = offsets[idx];
+            Mat s(scores.v, n * classDim, n);
+            s.noalias() = Mat(y1[offset], n * classDim, inDim2) *
+                Mat(x2[offset], n, inDim2).transpose();
+            for (int c = 0; c < classDim; c++) {
+                dtype b = param->bUseB ? param->b.val.v[c] : 0;
+                for (int i = 0; i < n; i++) {
+                    Mat(ptr->vals[c][i], 1, n) = s.row(i * classDim + c).array() + b;
+                }
+            }
         }
     }
 
     inline void backward() {
         int count = batch.size();
+        int total = offsets[count];
+        Tensor2D ly1, lx2, ls;
+        ly1.init(total, classDim * inDim2);
+        lx2.init(total, inDim2);
+        ls.init(max_size * classDim, max_size);
         for (int idx = 0; idx < count; idx++) {
             BiaffineNode* ptr = (BiaffineNode*)batch[idx];
-            ptr->backward();
+            int n = ptr->nSize, offset = offsets[idx];
+            Mat l(ls.v, n * classDim, n);
+            for (int c = 0; c < classDim; c++) {
+                for (int i = 0; i < n; i++) {
+                    l.row(i * classDim + c) = Mat(ptr->losses[c][i], 1, n);
+                }
+                if (param->bUseB) {
+                    for (int i = 0; i < n; i++) {
+                        param->b.grad.v[c] += l.row(i * classDim + c).sum();
+                    }
+                }
+            }
+            Mat(ly1[offset], n * classDim, inDim2).noalias() = l * Mat(x2[offset], n, inDim2);
+            Mat(lx2[offset], n, inDim2).noalias() = l.transpose() *
+                Mat(y1[offset], n * classDim, inDim2);
+        }
+
+        Tensor2D lw, lx1;
+        lw.init(inDim1, classDim * inDim2);
+        lw.mat() = x1.mat().transpose() * ly1.mat();
+        for (int c = 0; c < classDim; c++) {
+            param->W[c].grad.mat() += lw.mat().middleCols(c * inDim2, inDim2);
+        }
+        lx1.init(total, inDim1);
+        lx1.mat() = ly1.mat() * w.mat().transpose();
+
+        for (int idx = 0; idx < count; idx++) {
+            BiaffineNode* ptr = (BiaffineNode*)batch[idx];
+            for (int i = 0; i < ptr->nSize; i++) {
+                int row = offsets[idx] + i;
+                PNode in = ptr->in1[i];
+                in->loss.tmat() += Mat(lx1[row], 1, in->dim);
+                in = ptr->in2[i];
+                in->loss.tmat() += Mat(lx2[row], 1, in->dim);
+            }
         }
     }
 };
@@ -250,6 +305,8 @@ inline PExecute BiaffineNode::generate(bool bTrain, dtype cur_drop_factor) {
     exec->batch.push_back(this);
     exec->bTrain = bTrain;
     exec->drop_factor = cur_drop_factor;
+    exec->param = param;
+    exec->classDim = classDim;
     return exec;
 };
 
@@ -39,6 +39,11 @@ class BucketNode : public Node {
         Node::init(ndim, -1);
     }
 
+    // val is assigned in forward, before the graph is computed
+    bool keepsValue() const override {
+        return true;
+    }
+
   public:
     void forward(Graph *cg, dtype value) {
 #if TEST_CUDA
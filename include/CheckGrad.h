@@ -2,6 +2,7 @@
 #define CHECKGREAD_H_
 
 #include "MyLib.h"
+#include "Param.h"
 #include <Eigen/Dense>
 
 using namespace Eigen;
@@ -66,5 +67,96 @@ class CheckGrad {
 };
 
 
+#if !USE_GPU
+// compares the outputs of a model with int8 weights against fp32, see
+// Param::quantize, predict(example) returns the output scores of an example
+// the params are given back in fp32, call quantize on them after the check
+class CheckQuantization {
+
+  public:
+    vector<Param*> _params;
+    vector<string> _names;
+
+    struct Result {
+        dtype max_abs_error = 0;
+        dtype mean_rel_error = 0; // of the score vectors, in l2 norm
+        dtype argmax_agreement = 0;
+    };
+
+  public:
+    CheckQuantization() {
+        clear();
+    }
+
+    inline void clear() {
+        _params.clear();
+        _names.clear();
+    }
+
+    inline void add(Param* param, const string& name) {
+        _params.push_back(param);
+        _names.push_back(name);
+    }
+
+  public:
+    template<typename Example, typename Predict>
+    inline Result check(Predict predict, const vector<Example>& examples, const string& description) {
+        Result result;
+        if (examples.empty()) {
+            return result;
+        }
+        vector<vector<dtype> > fp32;
+        for (const Example &example : examples) {
+            fp32.push_back(predict(example));
+        }
+
+        vector<bool> frozen;
+        size_t fp32_bytes = 0, int8_bytes = 0;
+        for (Param *param : _params) {
+            frozen.push_back(param->frozen);
+            param->quantize(true);
+            fp32_bytes += param->val.size * sizeof(dtype);
+            int8_bytes += param->qval.bytes();
+        }
+
+        int agree = 0;
+        for (int i = 0; i < examples.size(); i++) {
+            vector<dtype> scores = predict(examples[i]);
+            if (scores.size() != fp32[i].size()) {
+                std::cout << "CheckQuantization: predict returns " << scores.size() <<
+                    " scores, but " << fp32[i].size() << " before quantization" << std::endl;
+                abort();
+            }
+            dtype diff = 0, norm = 0;
+            int best = 0, best8 = 0;
+            for (int j = 0; j < scores.size(); j++) {
+                dtype error = std::abs(scores[j] - fp32[i][j]);
+                result.max_abs_error = std::max(result.max_abs_error, error);
+                diff += error * error;
+                norm += fp32[i][j] * fp32[i][j];
+                if (fp32[i][j] > fp32[i][best]) best = j;
+                if (scores[j] > scores[best8]) best8 = j;
+            }
+            result.mean_rel_error += norm > 0 ? sqrt(diff / norm) : sqrt(diff);
+            agree += best == best8;
+        }
+        result.mean_rel_error /= examples.size();
+        result.argmax_agreement = (dtype)agree / examples.size();
+
+        for (int i = 0; i < _params.size(); i++) {
+            _params[i]->qval.clear();
+            if (!frozen[i]) {
+                _params[i]->unfreeze();
+            }
+        }
+
+        printf("%s, int8 vs fp32 over %d examples: max abs error = %.6f, mean relative error = %.6f, "
+               "argmax agreement = %.4f, weights %zu -> %zu bytes\n", description.c_str(),
+               (int)examples.size(), result.max_abs_error, result.mean_rel_error,
+               result.argmax_agreement, fp32_bytes, int8_bytes);
+        return result;
+    }
+};
+#endif
 
 #endif /*CHECKGREAD_H_*/
@@ -0,0 +1,208 @@
+#ifndef N3LDG_CHECKPOINT_H
+#define N3LDG_CHECKPOINT_H
+
+/*
+*  Checkpoint.h:
+*  gradient checkpointing for training graphs
+*  (1) builders put their nodes into segments with Graph::beginSegment,
+*      nodes of different segments are never batched into one execute
+*  (2) a node is a boundary if it is in no segment, has no parents, or has a
+*      parent in another segment, boundary vals are kept as usual
+*  (3) the other nodes of a segment get pooled buffers during forward, freed
+*      once their parents have executed, and the executes of the segment are
+*      dropped with their intermediate tensors
+*  (4) in Graph::backward, the forward of a segment is re-run just before the
+*      backward of its last execute, and the buffers of a node are freed
+*      right after its own backward
+*  Dropout masks of the first forward are reused by the recompute.
+*/
+
+#include "Node.h"
+#include "MemoryPlanner.h"
+#include <vector>
+#include <unordered_map>
+
+#if !USE_GPU
+
+class Checkpointer;
+
+// stands for an execute of a segment in Graph::execs
+class RecomputeExecute : public Execute {
+  public:
+    Checkpointer *checkpointer;
+    int segment;
+    PExecute exec = NULL;
+
+    ~RecomputeExecute() {
+        delete exec;
+    }
+
+    void forward() override {
+        exec = batch.at(0)->generate(bTrain, drop_factor);
+        exec->batch = batch;
+        exec->forward();
+    }
+
+    void backward() override;
+};
+
+class Checkpointer {
+  public:
+    // called once all nodes are added, before the first level executes
+    void plan(const std::vector<PNode> &nodes) {
+        for (PNode node : nodes) {
+            if (node->segment == 0) {
+                node->ensureStorage();
+                continue;
+            }
+            Segment &seg = segments[node->segment];
+            seg.nodes.push_back(node);
+            if (isBoundary(node)) {
+                node->ensureStorage();
+                continue;
+            }
+            node->val.release();
+            node->loss.release();
+            seg.dropped.push_back(node);
+            std::vector<PNode> readers;
+            collectReaders(node, readers);
+            pending[node] = readers.size();
+            for (PNode reader : readers) {
+                inputs[reader].push_back(node);
+            }
+        }
+    }
+
+    void bind(PNode node) {
+        if (node->val.v == NULL && pending.find(node) != pending.end()) {
+            node->val.attach(pool.acquire(node->dim));
+        }
+    }
+
+    void finish(PNode node) {
+        auto it = inputs.find(node);
+        if (it == inputs.end()) {
+            return;
+        }
+        for (PNode in : it->second) {
+            int &count = pending[in];
+            --count;
+            if (count == 0) {
+                pool.release(in->val.v, in->dim);
+                in->val.detach();
+            }
+        }
+    }
+
+    // takes the place of an executed execute of a segment
+    PExecute stash(PExecute exec, bool train, dtype drop_factor) {
+        RecomputeExecute *e = new RecomputeExecute;
+        e->checkpointer = this;
+        e->segment = exec->batch.at(0)->segment;
+        // the arguments exec was generated with, not the fields it derived
+        e->bTrain = train;
+        e->drop_factor = drop_factor;
+        e->batch = std::move(exec->batch);
+        segments[e->segment].execs.push_back(e);
+        delete exec;
+        return e;
+    }
+
+    void backward(RecomputeExecute *e) {
+        Segment &seg = segments[e->segment];
+        if (!seg.recomputed) {
+            recompute(seg);
+        }
+        e->exec->backward();
+        delete e->exec;
+        e->exec = NULL;
+        // parents of these nodes are done with backward already
+        for (PNode node : e->batch) {
+            releaseStorage(node);
+        }
+    }
+
+    void clear() {
+        for (auto &it : segments) {
+            for (PNode node : it.second.dropped) {
+                releaseStorage(node);
+            }
+        }
+        segments.clear();
+        inputs.clear();
+        pending.clear();
+    }
+
+    const BufferPool &bufferPool() const {
+        return pool;
+    }
+
+  private:
+    struct Segment {
+        std::vector<PNode> nodes;
+        std::vector<PNode> dropped;
+        std::vector<RecomputeExecute*> execs;
+        bool recomputed = false;
+    };
+
+    static bool isBoundary(PNode node) {
+        if (node->keepsValue() || node->parents.empty()) {
+            return true;
+        }
+        std::vector<PNode> readers;
+        collectReaders(node, readers);
+        for (PNode reader : readers) {
+            if (reader->segment != node->segment) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void recompute(Segment &seg) {
+        for (PNode node : seg.dropped) {
+            if (node->val.v == NULL) {
+                node->val.attach(pool.acquire(node->dim));
+            }
+            node->loss.attach(pool.acquire(node->dim));
+        }
+        // the first forward started from zeroed vals as well
+        for (PNode node : seg.nodes) {
+            if (!node->keepsValue()) {
+                node->val.zero();
+            }
+            node->reuse_drop_mask = true;
+        }
+        for (RecomputeExecute *e : seg.execs) {
+            e->forward();
+        }
+        for (PNode node : seg.nodes) {
+            node->reuse_drop_mask = false;
+        }
+        seg.recomputed = true;
+    }
+
+    void releaseStorage(PNode node) {
+        if (node->val.isAttached()) {
+            pool.release(node->val.v, node->dim);
+            node->val.detach();
+        }
+        if (node->loss.isAttached()) {
+            pool.release(node->loss.v, node->dim);
+            node->loss.detach();
+        }
+    }
+
+    BufferPool pool;
+    std::unordered_map<int, Segment> segments;
+    std::unordered_map<PNode, std::vector<PNode>> inputs;
+    std::unordered_map<PNode, int> pending;
+};
+
+inline void RecomputeExecute::backward() {
+    checkpointer->backward(this);
+}
+
+#endif
+
+#endif
@@ -128,6 +128,13 @@ public:
         return hash_code;
     }
 
+#if !USE_GPU
+    // ConcatExecute copies the inputs with gatherVal
+    bool readsViews() const override {
+        return true;
+    }
+#endif
+
     void compute() {
         int nSize = ins.size();
         int offset = 0;
@@ -232,23 +239,32 @@ class ConcatExecute : public Execute {
     }
 };
 #else
+// inputs are copied as blocks, views (e.g. WindowNode) are read in place
 class ConcatExecute : public Execute {
   public:
     inline void  forward() {
         int count = batch.size();
-        //#pragma omp parallel for
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->compute();
-            batch[idx]->forward_drop(bTrain, drop_factor);
+            ConcatNode* ptr = (ConcatNode*)batch[idx];
+            dtype *dst = ptr->val.v;
+            for (PNode in : ptr->ins) {
+                gatherVal(in, dst);
+                dst += in->dim;
+            }
+            ptr->forward_drop(bTrain, drop_factor);
         }
     }
 
     inline void backward() {
         int count = batch.size();
-        //#pragma omp parallel for
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->backward_drop();
-            batch[idx]->backward();
+            ConcatNode* ptr = (ConcatNode*)batch[idx];
+            ptr->backward_drop();
+            const dtype *src = ptr->loss.v;
+            for (PNode in : ptr->ins) {
+                scatterLoss(in, src);
+                src += in->dim;
+            }
         }
     }
 };
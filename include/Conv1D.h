@@ -0,0 +1,336 @@
+#ifndef N3LDG_CONV1D_H
+#define N3LDG_CONV1D_H
+
+/*
+*  Conv1D.h:
+*  one dimensional convolution over a sequence of nodes, a node per output
+*  position, which can be pooled by MaxPoolNode, AvgPoolNode and the like
+*  (1) a node reads window inputs, padding is left out (NULL) and read as 0
+*  (2) one execute runs all positions of all sentences as a single
+*      im2col + GEMM, the im2col rows are filled with block copies, windows
+*      are never kept as nodes
+*  (3) backward computes the filter gradient with a single GEMM as well
+*  Only the CPU version is provided, GPU users can still go with
+*  WindowBuilder + UniNode.
+*/
+
+#include "MyLib.h"
+#include "Node.h"
+#include "Param.h"
+#include "Graph.h"
+#include "ModelUpdate.h"
+
+#if !USE_GPU
+
+class Conv1DParams {
+  public:
+    Param W; // a row per filter, the inputs of a window side by side
+    Param b;
+    bool bUseB;
+    int window;
+
+  public:
+    Conv1DParams() {
+        bUseB = true;
+        window = 1;
+    }
+
+    inline void exportAdaParams(ModelUpdate& ada) {
+        ada.addParam(&W);
+        if (bUseB) {
+            ada.addParam(&b);
+        }
+    }
+
+    // nOSize filters of nWindow inputs of nISize
+    inline void initial(int nOSize, int nISize, int nWindow, bool useB = true) {
+        if (nWindow <= 0) {
+            std::cout << "conv1d window should be positive, but is " << nWindow << std::endl;
+            abort();
+        }
+        W.initial(nOSize, nISize * nWindow);
+        window = nWindow;
+
+        bUseB = useB;
+        if (bUseB) {
+            b.initial(nOSize, 1);
+        }
+    }
+
+    inline int inDim() {
+        return W.inDim() / window;
+    }
+
+    inline void save(std::ofstream &os) const {
+        os << bUseB << " " << window << std::endl;
+        W.save(os);
+        if (bUseB) {
+            b.save(os);
+        }
+    }
+
+    inline void load(std::ifstream &is) {
+        is >> bUseB >> window;
+        W.load(is);
+        if (bUseB) {
+            b.load(is);
+        }
+    }
+};
+
+class Conv1DNode : public Node {
+  public:
+    vector<PNode> ins; // window inputs from left to right, NULL for padding
+    Conv1DParams* param;
+    dtype(*activate)(const dtype&);   // activation function
+    dtype(*derivate)(const dtype&, const dtype&);  // derivation function of activation function
+
+  public:
+    Conv1DNode() : Node() {
+        param = NULL;
+        activate = ftanh;
+        derivate = dtanh;
+        node_type = "conv1d";
+    }
+
+    inline void setParam(Conv1DParams* paramInit) {
+        param = paramInit;
+    }
+
+    inline void clearValue() {
+        Node::clearValue();
+        ins.clear();
+    }
+
+    // define the activate function and its derivation form
+    inline void setFunctions(dtype(*f)(const dtype&), dtype(*f_deri)(const dtype&, const dtype&)) {
+        activate = f;
+        derivate = f_deri;
+    }
+
+  public:
+    void forward(Graph *cg, const vector<PNode>& x) {
+        if (x.size() != (size_t)param->window) {
+            std::cout << "conv1d window is " << param->window << ", but " << x.size() << " inputs are given" << std::endl;
+            abort();
+        }
+        int inDim = param->inDim();
+        ins = x;
+        degree = 0;
+        for (PNode p : ins) {
+            if (p == NULL) {
+                continue;
+            }
+            if (p->dim != inDim) {
+                std::cout << "input dim does not match for conv1d" << std::endl;
+                abort();
+            }
+            p->addParent(this);
+        }
+        cg->addNode(this);
+    }
+
+  public:
+    // positions are computed by Conv1DExecute only, which keeps the im2col
+    // matrix needed by backward
+    inline void compute() {
+        std::cout << "Conv1DNode is computed by its execute only" << std::endl;
+        abort();
+    }
+
+    inline void backward() {
+        std::cout << "Conv1DNode is computed by its execute only" << std::endl;
+        abort();
+    }
+
+    inline PExecute generate(bool bTrain, dtype cur_drop_factor);
+
+    bool typeEqual(PNode other) override {
+        bool result = Node::typeEqual(other);
+        if (!result) return false;
+
+        Conv1DNode* conv_other = (Conv1DNode*)other;
+        if (param != conv_other->param) {
+            return false;
+        }
+        return activate == conv_other->activate && derivate == conv_other->derivate;
+    }
+
+    size_t typeHashCode() const override {
+        void *act = reinterpret_cast<void*>(activate);
+        void *de = reinterpret_cast<void*>(derivate);
+        return Node::typeHashCode() ^ ::typeHashCode(param) ^ ::typeHashCode(act) ^
+            (::typeHashCode(de) << 1);
+    }
+
+    // the im2col rows are filled with gatherVal
+    bool readsViews() const override {
+        return true;
+    }
+};
+
+// matrices hold a row per output position
+class Conv1DExecute : public Execute {
+  public:
+    Conv1DParams* param;
+    dtype(*activate)(const dtype&);
+    dtype(*derivate)(const dtype&, const dtype&);
+    Tensor2D x, ty, y; // x is the im2col matrix
+
+    inline void forward() {
+        int count = batch.size();
+        int inDim = param->inDim();
+        int outDim = param->W.outDim();
+        x.init(count, param->W.inDim());
+        ty.init(count, outDim);
+        y.init(count, outDim);
+
+        for (int idx = 0; idx < count; idx++) {
+            Conv1DNode* ptr = (Conv1DNode*)batch[idx];
+            for (int k = 0; k < param->window; k++) {
+                if (ptr->ins[k] != NULL) {
+                    gatherVal(ptr->ins[k], x[idx] + k * inDim);
+                }
+            }
+        }
+
+        ty.mat() = x.mat() * param->W.val.mat().transpose();
+        if (param->bUseB) {
+            Matrix<dtype, 1, Dynamic> bias = param->b.val.mat().transpose();
+            ty.mat().rowwise() += bias;
+        }
+        y.vec() = ty.vec().unaryExpr(ptr_fun(activate));
+
+        for (int idx = 0; idx < count; idx++) {
+            memcpy(batch[idx]->val.v, y[idx], outDim * sizeof(dtype));
+            batch[idx]->forward_drop(bTrain, drop_factor);
+        }
+    }
+
+    inline void backward() {
+        int count = batch.size();
+        int inDim = param->inDim();
+        int outDim = param->W.outDim();
+        Tensor2D lty, lx;
+        lty.init(count, outDim);
+        lx.init(count, param->W.inDim());
+
+        for (int idx = 0; idx < count; idx++) {
+            batch[idx]->backward_drop();
+            memcpy(lty[idx], batch[idx]->loss.v, outDim * sizeof(dtype));
+        }
+        lty.vec() = lty.vec() * ty.vec().binaryExpr(y.vec(), ptr_fun(derivate));
+
+        param->W.grad.mat() += lty.mat().transpose() * x.mat();
+        if (param->bUseB) {
+            param->b.grad.mat() += lty.mat().colwise().sum().transpose();
+        }
+        lx.mat() = lty.mat() * param->W.val.mat();
+
+        for (int idx = 0; idx < count; idx++) {
+            Conv1DNode* ptr = (Conv1DNode*)batch[idx];
+            for (int k = 0; k < param->window; k++) {
+                if (ptr->ins[k] != NULL) {
+                    scatterLoss(ptr->ins[k], lx[idx] + k * inDim);
+                }
+            }
+        }
+    }
+};
+
+inline PExecute Conv1DNode::generate(bool bTrain, dtype cur_drop_factor) {
+    Conv1DExecute* exec = new Conv1DExecute();
+    exec->batch.push_back(this);
+    exec->bTrain = bTrain;
+    exec->drop_factor = cur_drop_factor;
+    exec->param = param;
+    exec->activate = activate;
+    exec->derivate = derivate;
+    return exec;
+}
+
+// output j reads x[j * stride - padding], ..., x[j * stride - padding + window - 1]
+class Conv1DBuilder {
+  public:
+    int _nSize;
+    int _outDim;
+    int _stride;
+    int _padding;
+    dtype _dropout;
+    dtype(*_activate)(const dtype&);
+    dtype(*_derivate)(const dtype&, const dtype&);
+
+    vector<Conv1DNode*> _outputs;
+
+    Conv1DParams* _param;
+
+  public:
+    Conv1DBuilder() {
+        _activate = ftanh;
+        _derivate = dtanh;
+        clear();
+    }
+
+    ~Conv1DBuilder() {
+        clear();
+    }
+
+  public:
+    inline void clear() {
+        _outputs.clear();
+        _nSize = 0;
+    }
+
+  public:
+    // padding (window - 1) / 2 with stride 1 keeps the length of odd windows
+    inline void init(Conv1DParams* paramInit, int stride = 1, int padding = 0, dtype dropout = -1) {
+        if (stride <= 0 || padding < 0) {
+            std::cout << "conv1d stride should be positive and padding should not be negative" << std::endl;
+            abort();
+        }
+        _param = paramInit;
+        _outDim = _param->W.outDim();
+        _stride = stride;
+        _padding = padding;
+        _dropout = dropout;
+    }
+
+    inline void setFunctions(dtype(*f)(const dtype&), dtype(*f_deri)(const dtype&, const dtype&)) {
+        _activate = f;
+        _derivate = f_deri;
+    }
+
+  public:
+    inline void forward(Graph *cg, const vector<PNode>& x) {
+        _outputs.clear();
+        if (x.size() == 0) {
+            std::cout << "empty inputs for conv1d operation" << std::endl;
+            return;
+        }
+        _nSize = x.size();
+        int window = _param->window;
+        if (_nSize + 2 * _padding < window) {
+            std::cout << "inputs are shorter than the conv1d window" << std::endl;
+            return;
+        }
+        int positions = (_nSize + 2 * _padding - window) / _stride + 1;
+
+        vector<PNode> in_nodes(window);
+        _outputs.resize(positions);
+        for (int idx = 0; idx < positions; idx++) {
+            int begin = idx * _stride - _padding;
+            for (int k = 0; k < window; k++) {
+                int pos = begin + k;
+                in_nodes[k] = pos >= 0 && pos < _nSize ? x[pos] : NULL;
+            }
+            _outputs[idx] = cg->newNode<Conv1DNode>(_outDim, _dropout);
+            _outputs[idx]->setParam(_param);
+            _outputs[idx]->setFunctions(_activate, _derivate);
+            _outputs[idx]->forward(cg, in_nodes);
+        }
+    }
+};
+
+#endif
+
+#endif
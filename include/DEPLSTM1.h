@@ -71,37 +71,39 @@ class TreeLSTM1Builder {
 
     bool _bottom2top;
 
-    vector<LinearNode> _inputgates_l;
-    vector<LinearNode> _forgetgates_l;
-    vector<LinearNode> _halfcells_l;
-    vector<LinearNode> _outputgates_l;
+    vector<LinearNode*> _inputgates_l;
+    vector<LinearNode*> _forgetgates_l;
+    vector<LinearNode*> _halfcells_l;
+    vector<LinearNode*> _outputgates_l;
 
-    vector<UniNode> _inputgates_r;
-    vector<UniNode> _forgetgates_r;
-    vector<UniNode> _halfcells_r;
-    vector<UniNode> _outputgates_r;
+    vector<UniNode*> _inputgates_r;
+    vector<UniNode*> _forgetgates_r;
+    vector<UniNode*> _halfcells_r;
+    vector<UniNode*> _outputgates_r;
 
-    vector<PAddNode> _inputgates_add;
-    vector<PAddNode> _forgetgates_add;
-    vector<PAddNode> _halfcells_add;
-    vector<PAddNode> _outputgates_add;
+    vector<PAddNode*> _inputgates_add;
+    vector<PAddNode*> _forgetgates_add;
+    vector<PAddNode*> _halfcells_add;
+    vector<PAddNode*> _outputgates_add;
 
-    vector<SigmoidNode> _inputgates;
-    vector<SigmoidNode> _forgetgates;
-    vector<TanhNode> _halfcells;
-    vector<SigmoidNode> _outputgates;
+    vector<SigmoidNode*> _inputgates;
+    vector<SigmoidNode*> _forgetgates;
+    vector<TanhNode*> _halfcells;
+    vector<SigmoidNode*> _outputgates;
 
-    vector<PMultiNode> _inputfilters;
-    vector<PMultiNode> _forgetfilters;
+    vector<PMultiNode*> _inputfilters;
+    vector<PMultiNode*> _forgetfilters;
 
-    vector<PAddNode> _cells;
+    vector<PAddNode*> _cells;
 
-    vector<TanhNode> _halfhiddens;
+    vector<TanhNode*> _halfhiddens;
 
-    vector<PMultiNode> _hiddens;
+    vector<PMultiNode*> _hiddens;
 
     TreeLSTM1Params* _param;
 
+    dtype _dropout;
+
 
   public:
     TreeLSTM1Builder() {
@@ -117,80 +119,14 @@ class TreeLSTM1Builder {
         _param = paramInit;
         _inDim = _param->input_l.W.inDim();
         _outDim = _param->input_l.W.outDim();
-        int maxsize = _inputgates.size();
-        for (int idx = 0; idx < maxsize; idx++) {
-            _inputgates_l[idx].setParam(&(_param->input_l));
-            _forgetgates_l[idx].setParam(&(_param->forget_l));
-            _outputgates_l[idx].setParam(&(_param->output_l));
-            _halfcells_l[idx].setParam(&(_param->cell_l));
-
-            _inputgates_r[idx].setParam(&(_param->input_r));
-            _forgetgates_r[idx].setParam(&(_param->forget_r));
-            _outputgates_r[idx].setParam(&(_param->output_r));
-            _halfcells_r[idx].setParam(&(_param->cell_r));
-
-        }
-
-        for (int idx = 0; idx < maxsize; idx++) {
-            _inputgates_l[idx].init(_outDim, -1);
-            _forgetgates_l[idx].init(_outDim, -1);
-            _outputgates_l[idx].init(_outDim, -1);
-            _halfcells_l[idx].init(_outDim, -1);
-
-            _inputgates_r[idx].init(_outDim, -1);
-            _forgetgates_r[idx].init(_outDim, -1);
-            _outputgates_r[idx].init(_outDim, -1);
-            _halfcells_r[idx].init(_outDim, -1);
-
-            _inputgates_add[idx].init(_outDim, -1);
-            _forgetgates_add[idx].init(_outDim, -1);
-            _outputgates_add[idx].init(_outDim, -1);
-            _halfcells_add[idx].init(_outDim, -1);
-
-            _inputgates[idx].init(_outDim, -1);
-            _forgetgates[idx].init(_outDim, -1);
-            _outputgates[idx].init(_outDim, -1);
-            _halfcells[idx].init(_outDim, -1);
-
-            _inputfilters[idx].init(_outDim, -1);
-            _forgetfilters[idx].init(_outDim, -1);
-            _cells[idx].init(_outDim, -1);
-            _halfhiddens[idx].init(_outDim, -1);
-            _hiddens[idx].init(_outDim, dropout);
-        }
-
+        _dropout = dropout;
         _bottom2top = bottom2top;
     }
 
-    inline void resize(int maxsize) {
-        _inputgates_l.resize(maxsize);
-        _forgetgates_l.resize(maxsize);
-        _halfcells_l.resize(maxsize);
-        _outputgates_l.resize(maxsize);
-
-        _inputgates_r.resize(maxsize);
-        _forgetgates_r.resize(maxsize);
-        _halfcells_r.resize(maxsize);
-        _outputgates_r.resize(maxsize);
-
-        _inputgates_add.resize(maxsize);
-        _forgetgates_add.resize(maxsize);
-        _halfcells_add.resize(maxsize);
-        _outputgates_add.resize(maxsize);
-
-        _inputgates.resize(maxsize);
-        _forgetgates.resize(maxsize);
-        _halfcells.resize(maxsize);
-        _outputgates.resize(maxsize);
-
-        _inputfilters.resize(maxsize);
-        _forgetfilters.resize(maxsize);
-        _cells.resize(maxsize);
-        _halfhiddens.resize(maxsize);
-        _hiddens.resize(maxsize);
+    // no-op, forward takes the nodes from Graph::newNode
+    N3LDG_DEPRECATED inline void resize(int) {
     }
 
-
     inline void clear() {
         _inputgates_l.clear();
         _forgetgates_l.clear();
@@ -219,6 +155,7 @@ class TreeLSTM1Builder {
         _hiddens.clear();
 
         _param = NULL;
+        _dropout = -1;
         _nSize = 0;
         _inDim = 0;
         _outDim = 0;
@@ -234,6 +171,8 @@ class TreeLSTM1Builder {
 
         _nSize = x.size();
 
+        allocate(cg);
+
         if (_bottom2top) {
             btforward(cg, x, heads);
         } else {
@@ -242,6 +181,68 @@ class TreeLSTM1Builder {
     }
 
   protected:
+    // nodes of the current tree, see NodePool.h
+    inline void allocate(Graph *cg) {
+        _inputgates_l.resize(_nSize);
+        _forgetgates_l.resize(_nSize);
+        _halfcells_l.resize(_nSize);
+        _outputgates_l.resize(_nSize);
+        _inputgates_r.resize(_nSize);
+        _forgetgates_r.resize(_nSize);
+        _halfcells_r.resize(_nSize);
+        _outputgates_r.resize(_nSize);
+        _inputgates_add.resize(_nSize);
+        _forgetgates_add.resize(_nSize);
+        _halfcells_add.resize(_nSize);
+        _outputgates_add.resize(_nSize);
+        _inputgates.resize(_nSize);
+        _forgetgates.resize(_nSize);
+        _halfcells.resize(_nSize);
+        _outputgates.resize(_nSize);
+        _inputfilters.resize(_nSize);
+        _forgetfilters.resize(_nSize);
+        _cells.resize(_nSize);
+        _halfhiddens.resize(_nSize);
+        _hiddens.resize(_nSize);
+        for (int idx = 0; idx < _nSize; idx++) {
+            _inputgates_l[idx] = cg->newNode<LinearNode>(_outDim);
+            _forgetgates_l[idx] = cg->newNode<LinearNode>(_outDim);
+            _halfcells_l[idx] = cg->newNode<LinearNode>(_outDim);
+            _outputgates_l[idx] = cg->newNode<LinearNode>(_outDim);
+            _inputgates_r[idx] = cg->newNode<UniNode>(_outDim);
+            _forgetgates_r[idx] = cg->newNode<UniNode>(_outDim);
+            _halfcells_r[idx] = cg->newNode<UniNode>(_outDim);
+            _outputgates_r[idx] = cg->newNode<UniNode>(_outDim);
+            _inputgates_add[idx] = cg->newNode<PAddNode>(_outDim);
+            _forgetgates_add[idx] = cg->newNode<PAddNode>(_outDim);
+            _halfcells_add[idx] = cg->newNode<PAddNode>(_outDim);
+            _outputgates_add[idx] = cg->newNode<PAddNode>(_outDim);
+            _inputgates[idx] = cg->newNode<SigmoidNode>(_outDim);
+            _forgetgates[idx] = cg->newNode<SigmoidNode>(_outDim);
+            _halfcells[idx] = cg->newNode<TanhNode>(_outDim);
+            _outputgates[idx] = cg->newNode<SigmoidNode>(_outDim);
+            _inputfilters[idx] = cg->newNode<PMultiNode>(_outDim);
+            _forgetfilters[idx] = cg->newNode<PMultiNode>(_outDim);
+            _cells[idx] = cg->newNode<PAddNode>(_outDim);
+            _halfhiddens[idx] = cg->newNode<TanhNode>(_outDim);
+            _hiddens[idx] = cg->newNode<PMultiNode>(_outDim, _dropout);
+
+            _inputgates_l[idx]->setParam(&(_param->input_l));
+            _forgetgates_l[idx]->setParam(&(_param->forget_l));
+            _outputgates_l[idx]->setParam(&(_param->output_l));
+            _halfcells_l[idx]->setParam(&(_param->cell_l));
+
+            _inputgates_r[idx]->setParam(&(_param->input_r));
+            _forgetgates_r[idx]->setParam(&(_param->forget_r));
+            _outputgates_r[idx]->setParam(&(_param->output_r));
+            _halfcells_r[idx]->setParam(&(_param->cell_r));
+            _inputgates_r[idx]->setFunctions(&ftanh, &dtanh);
+            _forgetgates_r[idx]->setFunctions(&ftanh, &dtanh);
+            _outputgates_r[idx]->setFunctions(&ftanh, &dtanh);
+            _halfcells_r[idx]->setFunctions(&ftanh, &dtanh);
+        }
+    }
+
     inline void btforward(Graph *cg, const vector<PNode>& x, const vector<int>& heads) {
         vector<vector<int> > children;
         vector<bool> computed;
@@ -283,50 +284,50 @@ class TreeLSTM1Builder {
                 updatedCellNodes.clear();
                 for (int idy = 0; idy < child_num; idy++) {
                     int curChild = children[idx][idy];
-                    _inputgates_r[curChild].forward(cg, &_hiddens[curChild]);
-                    sumInputNodes.push_back(&(_inputgates_r[curChild]));
+                    _inputgates_r[curChild]->forward(cg, _hiddens[curChild]);
+                    sumInputNodes.push_back(_inputgates_r[curChild]);
 
-                    _outputgates_r[curChild].forward(cg, &_hiddens[curChild]);
-                    sumOutputNodes.push_back(&(_outputgates_r[curChild]));
+                    _outputgates_r[curChild]->forward(cg, _hiddens[curChild]);
+                    sumOutputNodes.push_back(_outputgates_r[curChild]);
 
-                    _halfcells_r[curChild].forward(cg, &_hiddens[curChild]);
-                    sumHaffCellNodes.push_back(&(_halfcells_r[curChild]));
+                    _halfcells_r[curChild]->forward(cg, _hiddens[curChild]);
+                    sumHaffCellNodes.push_back(_halfcells_r[curChild]);
                 }
 
-                _inputgates_l[idx].forward(cg, x[idx]);
-                sumInputNodes.push_back(&(_inputgates_l[idx]));
-                _inputgates_add[idx].forward(cg, sumInputNodes);
-                _inputgates[idx].forward(cg, &(_inputgates_add[idx]));
+                _inputgates_l[idx]->forward(cg, x[idx]);
+                sumInputNodes.push_back(_inputgates_l[idx]);
+                _inputgates_add[idx]->forward(cg, sumInputNodes);
+                _inputgates[idx]->forward(cg, _inputgates_add[idx]);
 
-                _outputgates_l[idx].forward(cg, x[idx]);
-                sumOutputNodes.push_back(&(_outputgates_l[idx]));
-                _outputgates_add[idx].forward(cg, sumOutputNodes);
-                _outputgates[idx].forward(cg, &(_outputgates_add[idx]));
+                _outputgates_l[idx]->forward(cg, x[idx]);
+                sumOutputNodes.push_back(_outputgates_l[idx]);
+                _outputgates_add[idx]->forward(cg, sumOutputNodes);
+                _outputgates[idx]->forward(cg, _outputgates_add[idx]);
 
-                _halfcells_l[idx].forward(cg, x[idx]);
-                sumHaffCellNodes.push_back(&(_halfcells_l[idx]));
-                _halfcells_add[idx].forward(cg, sumHaffCellNodes);
-                _halfcells[idx].forward(cg, &(_halfcells_add[idx]));
+                _halfcells_l[idx]->forward(cg, x[idx]);
+                sumHaffCellNodes.push_back(_halfcells_l[idx]);
+                _halfcells_add[idx]->forward(cg, sumHaffCellNodes);
+                _halfcells[idx]->forward(cg, _halfcells_add[idx]);
 
-                _forgetgates_l[idx].forward(cg, x[idx]);
+                _forgetgates_l[idx]->forward(cg, x[idx]);
                 vector<PNode> updatedCellNodes;
                 for (int idy = 0; idy < child_num; idy++) {
                     int curChild = children[idx][idy];
-                    _forgetgates_r[curChild].forward(cg, &_hiddens[curChild]);
-                    _forgetgates_add[curChild].forward(cg, &(_forgetgates_l[idx]), &(_forgetgates_r[curChild]));
-                    _forgetgates[curChild].forward(cg, &(_forgetgates_add[curChild]));
-                    _forgetfilters[curChild].forward(cg, &(_forgetgates[curChild]), &(_cells[curChild]));
-                    updatedCellNodes.push_back(&(_forgetfilters[curChild]));
+                    _forgetgates_r[curChild]->forward(cg, _hiddens[curChild]);
+                    _forgetgates_add[curChild]->forward(cg, _forgetgates_l[idx], _forgetgates_r[curChild]);
+                    _forgetgates[curChild]->forward(cg, _forgetgates_add[curChild]);
+                    _forgetfilters[curChild]->forward(cg, _forgetgates[curChild], _cells[curChild]);
+                    updatedCellNodes.push_back(_forgetfilters[curChild]);
                 }
 
-                _inputfilters[idx].forward(cg, &_halfcells[idx], &_inputgates[idx]);
-                updatedCellNodes.push_back(&(_inputfilters[idx]));
+                _inputfilters[idx]->forward(cg, _halfcells[idx], _inputgates[idx]);
+                updatedCellNodes.push_back(_inputfilters[idx]);
 
-                _cells[idx].forward(cg, updatedCellNodes);
+                _cells[idx]->forward(cg, updatedCellNodes);
 
-                _halfhiddens[idx].forward(cg, &_cells[idx]);
+                _halfhiddens[idx]->forward(cg, _cells[idx]);
 
-                _hiddens[idx].forward(cg, &_halfhiddens[idx], &_outputgates[idx]);
+                _hiddens[idx]->forward(cg, _halfhiddens[idx], _outputgates[idx]);
 
                 computed_count++;
                 computed[idx] = true;
@@ -376,54 +377,54 @@ class TreeLSTM1Builder {
             sumForgetNodes.clear();
             sumHaffCellNodes.clear();
 
-            _inputgates_l[curId].forward(cg, x[curId]);
-            sumInputNodes.push_back(&(_inputgates_l[curId]));
+            _inputgates_l[curId]->forward(cg, x[curId]);
+            sumInputNodes.push_back(_inputgates_l[curId]);
 
-            _outputgates_l[curId].forward(cg, x[curId]);
-            sumOutputNodes.push_back(&(_outputgates_l[curId]));
-            _halfcells_l[curId].forward(cg, x[curId]);
-            sumHaffCellNodes.push_back(&(_halfcells_l[curId]));
+            _outputgates_l[curId]->forward(cg, x[curId]);
+            sumOutputNodes.push_back(_outputgates_l[curId]);
+            _halfcells_l[curId]->forward(cg, x[curId]);
+            sumHaffCellNodes.push_back(_halfcells_l[curId]);
 
             if (curHead >= 0) {
-                _inputgates_r[curId].forward(cg, &(_hiddens[curHead]));
-                sumInputNodes.push_back(&(_inputgates_r[curId]));
+                _inputgates_r[curId]->forward(cg, _hiddens[curHead]);
+                sumInputNodes.push_back(_inputgates_r[curId]);
 
-                _outputgates_r[curId].forward(cg, &(_hiddens[curHead]));
-                sumOutputNodes.push_back(&(_outputgates_r[curId]));
-                _halfcells_r[curId].forward(cg, &(_hiddens[curHead]));
-                sumHaffCellNodes.push_back(&(_halfcells_r[curId]));
+                _outputgates_r[curId]->forward(cg, _hiddens[curHead]);
+                sumOutputNodes.push_back(_outputgates_r[curId]);
+                _halfcells_r[curId]->forward(cg, _hiddens[curHead]);
+                sumHaffCellNodes.push_back(_halfcells_r[curId]);
 
-                _forgetgates_l[curId].forward(cg, x[curId]);
-                sumForgetNodes.push_back(&(_forgetgates_l[curId]));
-                _forgetgates_r[curId].forward(cg, &(_hiddens[curHead]));
-                sumForgetNodes.push_back(&(_forgetgates_r[curId]));
+                _forgetgates_l[curId]->forward(cg, x[curId]);
+                sumForgetNodes.push_back(_forgetgates_l[curId]);
+                _forgetgates_r[curId]->forward(cg, _hiddens[curHead]);
+                sumForgetNodes.push_back(_forgetgates_r[curId]);
 
-                _forgetgates_add[curId].forward(cg, sumForgetNodes);
-                _forgetgates[curId].forward(cg, &(_forgetgates_add[curId]));
+                _forgetgates_add[curId]->forward(cg, sumForgetNodes);
+                _forgetgates[curId]->forward(cg, _forgetgates_add[curId]);
 
-                _forgetfilters[curId].forward(cg, &(_forgetgates[curId]), &(_cells[curHead]));
+                _forgetfilters[curId]->forward(cg, _forgetgates[curId], _cells[curHead]);
 
-                updatedCellNodes.push_back(&(_forgetfilters[curId]));
+                updatedCellNodes.push_back(_forgetfilters[curId]);
             }
 
-            _inputgates_add[curId].forward(cg, sumInputNodes);
-            _inputgates[curId].forward(cg, &(_inputgates_add[curId]));
+            _inputgates_add[curId]->forward(cg, sumInputNodes);
+            _inputgates[curId]->forward(cg, _inputgates_add[curId]);
 
-            _halfcells_add[curId].forward(cg, sumHaffCellNodes);
-            _halfcells[curId].forward(cg, &(_halfcells_add[curId]));
+            _halfcells_add[curId]->forward(cg, sumHaffCellNodes);
+            _halfcells[curId]->forward(cg, _halfcells_add[curId]);
 
-            _inputfilters[curId].forward(cg, &(_inputgates[curId]), &(_halfcells[curId]));
+            _inputfilters[curId]->forward(cg, _inputgates[curId], _halfcells[curId]);
 
-            updatedCellNodes.push_back(&(_inputfilters[curId]));
+            updatedCellNodes.push_back(_inputfilters[curId]);
 
-            _cells[curId].forward(cg, updatedCellNodes);
+            _cells[curId]->forward(cg, updatedCellNodes);
 
-            _outputgates_add[curId].forward(cg, sumOutputNodes);
-            _outputgates[curId].forward(cg, &(_outputgates_add[curId]));
+            _outputgates_add[curId]->forward(cg, sumOutputNodes);
+            _outputgates[curId]->forward(cg, _outputgates_add[curId]);
 
-            _halfhiddens[curId].forward(cg, &_cells[curId]);
+            _halfhiddens[curId]->forward(cg, _cells[curId]);
 
-            _hiddens[curId].forward(cg, &_halfhiddens[curId], &_outputgates[curId]);
+            _hiddens[curId]->forward(cg, _halfhiddens[curId], _outputgates[curId]);
 
             for (int idx = 0; idx < children[curId].size(); idx++) {
                 queue.push_back(children[curId][idx]);
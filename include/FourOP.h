@@ -51,6 +51,29 @@ class FourParams {
         }
     }
 
+#if !USE_GPU
+    // int8 weights for inference, the bias stays as it is, see Param::quantize
+    inline void quantize(bool keepVal = false) {
+        W1.quantize(keepVal);
+        W2.quantize(keepVal);
+        W3.quantize(keepVal);
+        W4.quantize(keepVal);
+    }
+
+    // 16 bit weights for inference, see Param::toHalf
+    inline void toHalf(HalfMat::Format format = HalfMat::BF16, bool keepVal = false) {
+        W1.toHalf(format, keepVal);
+        W2.toHalf(format, keepVal);
+        W3.toHalf(format, keepVal);
+        W4.toHalf(format, keepVal);
+    }
+
+    // the executes multiply by Param::multiply rather than by val
+    inline bool isCompressed() const {
+        return W1.isCompressed() || W2.isCompressed() || W3.isCompressed() || W4.isCompressed();
+    }
+#endif
+
     inline void save(std::ofstream &os) const {
         os << bUseB << std::endl;
         W1.save(os);
@@ -281,6 +304,10 @@ public:
     dtype(*derivate)(const dtype&, const dtype&);  // derivation function of activation function
 public:
 
+    double flops() const override {
+        return weightFlops(inDim1 + inDim2 + inDim3 + inDim4, outDim);
+    }
+
     void  forward() {
         int count = batch.size();
         x1.init(inDim1, count);
@@ -312,7 +339,18 @@ public:
                 }
             }
         }
+#if !USE_GPU
+        if (param->isCompressed()) {
+            param->W1.multiply(x1.v, count, ty.v, false);
+            param->W2.multiply(x2.v, count, ty.v, true);
+            param->W3.multiply(x3.v, count, ty.v, true);
+            param->W4.multiply(x4.v, count, ty.v, true);
+        } else {
+            ty.mat() = param->W1.val.mat() * x1.mat() + param->W2.val.mat() * x2.mat() + param->W3.val.mat() * x3.mat() + param->W4.val.mat() * x4.mat();
+        }
+#else
         ty.mat() = param->W1.val.mat() * x1.mat() + param->W2.val.mat() * x2.mat() + param->W3.val.mat() * x3.mat() + param->W4.val.mat() * x4.mat();
+#endif
         if (param->bUseB) {
             ty.vec() = ty.vec() + b.vec();
         }
@@ -399,6 +437,10 @@ public:
     FourParams* param;
 
 public:
+    double flops() const override {
+        return weightFlops(inDim1 + inDim2 + inDim3 + inDim4, outDim);
+    }
+
     inline void  forward() {
         count = batch.size();
         x1.init(inDim1, count);
@@ -430,7 +472,18 @@ public:
             }
         }
 
+#if !USE_GPU
+        if (param->isCompressed()) {
+            param->W1.multiply(x1.v, count, y.v, false);
+            param->W2.multiply(x2.v, count, y.v, true);
+            param->W3.multiply(x3.v, count, y.v, true);
+            param->W4.multiply(x4.v, count, y.v, true);
+        } else {
+            y.mat() = param->W1.val.mat() * x1.mat() + param->W2.val.mat() * x2.mat() + param->W3.val.mat() * x3.mat() + param->W4.val.mat() * x4.mat();
+        }
+#else
         y.mat() = param->W1.val.mat() * x1.mat() + param->W2.val.mat() * x2.mat() + param->W3.val.mat() * x3.mat() + param->W4.val.mat() * x4.mat();
+#endif
 
         if (param->bUseB) {
             y.vec() += b.vec();
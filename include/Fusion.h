@@ -0,0 +1,320 @@
+#ifndef N3LDG_FUSION_H
+#define N3LDG_FUSION_H
+
+/*
+*  Fusion.h:
+*  fuse chains of elementwise nodes (PAdd, PSub, PMulti, PDot, Activate,
+*  Tanh, Sigmoid and Relu) when a graph is computed, see Graph::setFusion
+*  (1) an elementwise node without dropout whose only parent is elementwise
+*      as well is computed by that parent, such nodes make a tree (a group),
+*      its root is the only node of the group whose val and loss are written
+*  (2) a group runs as one program, forward reads the inputs of the group
+*      once and writes the val of the root, backward reads the loss of the
+*      root once and adds to the losses of the inputs, values inside the
+*      group live in a scratch buffer and are recomputed by backward rather
+*      than kept
+*  (3) the root waits for the inputs of the group directly, so the group
+*      takes one level of the schedule, and roots of the same program (e.g.
+*      the cells of an LSTM at a step) are batched by one FusedExecute
+*  Vals of the nodes inside a group are never filled, so do not read them.
+*  Nodes computed incrementally need fusion off, as with MemoryPlanner.
+*/
+
+#include "Node.h"
+#include <unordered_set>
+#include <vector>
+
+#if !USE_GPU
+
+struct FusedStep {
+    ElementwiseOp op;
+    std::vector<int> args; // >= 0 for a step, < 0 for the input -1 - arg
+    int dim;
+    int in_dim;
+    int offset; // of the step in the scratch buffers
+};
+
+class FusedGroup {
+  public:
+    PNode root;
+    std::vector<PNode> nodes; // of the steps, the root is the last one
+    std::vector<PNode> inputs;
+    std::vector<FusedStep> steps; // children before parents
+    int scratch = 0;
+    size_t hash = 0;
+
+    inline PExecute generate(bool bTrain, dtype cur_drop_factor);
+
+    // runs the steps, the root is written to root_val unless it is NULL
+    void evaluate(dtype *vals, dtype *root_val) const {
+        int last = steps.size() - 1;
+        for (int s = 0; s <= last; s++) {
+            const FusedStep &step = steps[s];
+            dtype *y = s == last && root_val != NULL ? root_val : vals + step.offset;
+            const dtype *x0 = value(vals, step.args[0]);
+            switch (step.op.kind) {
+            case ElementwiseOp::ADD:
+                memcpy(y, x0, step.dim * sizeof(dtype));
+                for (size_t a = 1; a < step.args.size(); a++) {
+                    const dtype *x = value(vals, step.args[a]);
+                    for (int i = 0; i < step.dim; i++) {
+                        y[i] += x[i];
+                    }
+                }
+                break;
+            case ElementwiseOp::SUB: {
+                const dtype *x1 = value(vals, step.args[1]);
+                for (int i = 0; i < step.dim; i++) {
+                    y[i] = x0[i] - x1[i];
+                }
+                break;
+            }
+            case ElementwiseOp::MULTI: {
+                const dtype *x1 = value(vals, step.args[1]);
+                for (int i = 0; i < step.dim; i++) {
+                    y[i] = x0[i] * x1[i];
+                }
+                break;
+            }
+            case ElementwiseOp::DOT: {
+                const dtype *x1 = value(vals, step.args[1]);
+                y[0] = 0.0;
+                for (int i = 0; i < step.in_dim; i++) {
+                    y[0] += x0[i] * x1[i];
+                }
+                break;
+            }
+            case ElementwiseOp::ACTIVATE:
+                for (int i = 0; i < step.dim; i++) {
+                    y[i] = step.op.activate(x0[i]);
+                }
+                break;
+            }
+        }
+    }
+
+    // vals are filled by evaluate, losses hold the loss of the root
+    void backward(const dtype *vals, dtype *losses) const {
+        for (int s = steps.size() - 1; s >= 0; s--) {
+            const FusedStep &step = steps[s];
+            const dtype *y = vals + step.offset;
+            const dtype *ly = losses + step.offset;
+            const dtype *x0 = value(vals, step.args[0]);
+            dtype *lx0 = loss(losses, step.args[0]);
+            switch (step.op.kind) {
+            case ElementwiseOp::ADD:
+                for (size_t a = 0; a < step.args.size(); a++) {
+                    dtype *lx = loss(losses, step.args[a]);
+                    for (int i = 0; i < step.dim; i++) {
+                        lx[i] += ly[i];
+                    }
+                }
+                break;
+            case ElementwiseOp::SUB: {
+                dtype *lx1 = loss(losses, step.args[1]);
+                for (int i = 0; i < step.dim; i++) {
+                    lx0[i] += ly[i];
+                }
+                for (int i = 0; i < step.dim; i++) {
+                    lx1[i] -= ly[i];
+                }
+                break;
+            }
+            case ElementwiseOp::MULTI: {
+                const dtype *x1 = value(vals, step.args[1]);
+                dtype *lx1 = loss(losses, step.args[1]);
+                for (int i = 0; i < step.dim; i++) {
+                    lx0[i] += ly[i] * x1[i];
+                }
+                for (int i = 0; i < step.dim; i++) {
+                    lx1[i] += ly[i] * x0[i];
+                }
+                break;
+            }
+            case ElementwiseOp::DOT: {
+                const dtype *x1 = value(vals, step.args[1]);
+                dtype *lx1 = loss(losses, step.args[1]);
+                for (int i = 0; i < step.in_dim; i++) {
+                    lx0[i] += ly[0] * x1[i];
+                }
+                for (int i = 0; i < step.in_dim; i++) {
+                    lx1[i] += ly[0] * x0[i];
+                }
+                break;
+            }
+            case ElementwiseOp::ACTIVATE:
+                for (int i = 0; i < step.dim; i++) {
+                    lx0[i] += ly[i] * step.op.derivate(x0[i], y[i]);
+                }
+                break;
+            }
+        }
+    }
+
+  private:
+    inline const dtype *value(const dtype *vals, int arg) const {
+        return arg >= 0 ? vals + steps[arg].offset : inputs[-1 - arg]->val.v;
+    }
+
+    inline dtype *loss(dtype *losses, int arg) const {
+        return arg >= 0 ? losses + steps[arg].offset : inputs[-1 - arg]->loss.v;
+    }
+};
+
+class FusedExecute : public Execute {
+  public:
+    std::vector<dtype> vals, losses;
+
+    inline void forward() {
+        for (PNode node : batch) {
+            const FusedGroup *group = node->fused_group;
+            vals.resize(group->scratch);
+            group->evaluate(vals.data(), node->val.v);
+            node->forward_drop(bTrain, drop_factor);
+        }
+    }
+
+    inline void backward() {
+        for (PNode node : batch) {
+            const FusedGroup *group = node->fused_group;
+            node->backward_drop();
+            vals.resize(group->scratch);
+            losses.assign(group->scratch, 0);
+            group->evaluate(vals.data(), NULL);
+            memcpy(losses.data() + group->steps.back().offset, node->loss.v,
+                    node->dim * sizeof(dtype));
+            group->backward(vals.data(), losses.data());
+        }
+    }
+};
+
+inline PExecute FusedGroup::generate(bool bTrain, dtype cur_drop_factor) {
+    FusedExecute* exec = new FusedExecute();
+    exec->batch.push_back(root);
+    exec->bTrain = bTrain;
+    exec->drop_factor = cur_drop_factor;
+    return exec;
+}
+
+class Fuser {
+  public:
+    // called once all nodes are added, before the first level executes,
+    // only nodes still waiting for some input are fused
+    void fuse(const std::vector<PNode> &nodes) {
+        if (fused) {
+            std::cout << "Fuser: the graph is computed twice, "
+                "incremental compute is not supported with fusion" << std::endl;
+            abort();
+        }
+        fused = true;
+        std::unordered_set<PNode> inner;
+        ElementwiseOp op;
+        for (PNode node : nodes) {
+            if (node->degree > 0 && node->drop_value <= 0 &&
+                    node->parents.size() == 1 && node->toElementwise(op) &&
+                    node->parents[0]->degree > 0 &&
+                    node->parents[0]->toElementwise(op)) {
+                inner.insert(node);
+            }
+        }
+        for (PNode node : nodes) {
+            if (node->degree <= 0 || inner.count(node) > 0 || !node->toElementwise(op)) {
+                continue;
+            }
+            bool fusable = false;
+            for (PNode in : op.ins) {
+                fusable = fusable || inner.count(in) > 0;
+            }
+            if (!fusable) {
+                continue;
+            }
+            groups.push_back(std::unique_ptr<FusedGroup>(new FusedGroup));
+            FusedGroup &group = *groups.back();
+            group.root = node;
+            build(group, node, inner);
+            wire(group);
+            node->fused_group = &group;
+        }
+    }
+
+    // called by Graph::clearValue
+    void clear() {
+        for (auto &group : groups) {
+            group->root->fused_group = NULL;
+        }
+        groups.clear();
+        fused = false;
+    }
+
+  private:
+    std::vector<std::unique_ptr<FusedGroup>> groups;
+    bool fused = false;
+
+    static inline void mix(size_t &hash, size_t value) {
+        hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+    }
+
+    int build(FusedGroup &group, PNode node, const std::unordered_set<PNode> &inner) {
+        FusedStep step;
+        node->toElementwise(step.op);
+        for (PNode in : step.op.ins) {
+            if (inner.count(in) > 0) {
+                step.args.push_back(build(group, in, inner));
+            } else {
+                group.inputs.push_back(in);
+                step.args.push_back(-(int)group.inputs.size());
+            }
+        }
+        step.dim = node->dim;
+        step.in_dim = step.op.ins[0]->dim;
+        step.offset = group.scratch;
+        group.scratch += step.dim;
+
+        mix(group.hash, step.op.kind);
+        mix(group.hash, step.dim);
+        mix(group.hash, step.in_dim);
+        for (int arg : step.args) {
+            mix(group.hash, arg);
+        }
+        mix(group.hash, std::hash<void*>{}(reinterpret_cast<void*>(step.op.activate)));
+        mix(group.hash, std::hash<void*>{}(reinterpret_cast<void*>(step.op.derivate)));
+
+        group.steps.push_back(step);
+        group.nodes.push_back(node);
+        return group.steps.size() - 1;
+    }
+
+    // the root reads the inputs of the group in place of the inner nodes
+    void wire(FusedGroup &group) {
+        PNode root = group.root;
+        int degree = 0;
+        for (size_t s = 0; s < group.steps.size(); s++) {
+            PNode node = group.nodes[s];
+            const FusedStep &step = group.steps[s];
+            for (int arg : step.args) {
+                if (arg >= 0) {
+                    continue;
+                }
+                PNode in = group.inputs[-1 - arg];
+                // inputs computed by an earlier compute() are not waited for
+                if (in->degree < 0) {
+                    continue;
+                }
+                degree++;
+                for (PNode &parent : in->parents) {
+                    if (parent == node) {
+                        parent = root;
+                        break;
+                    }
+                }
+            }
+        }
+        root->degree = degree;
+        mix(group.hash, std::hash<std::string>{}(root->node_type));
+        mix(group.hash, std::hash<int>{}((int)(10000 * root->drop_value)));
+    }
+};
+
+#endif
+
+#endif
@@ -13,10 +13,16 @@
 #include "Eigen/Dense"
 #include "Node.h"
 #include "MyLib.h"
+#include "MemoryPlanner.h"
+#include "Checkpoint.h"
+#include "Fusion.h"
+#include "NodePool.h"
 #include <set>
 #include <map>
 #include <unordered_map>
 #include "profiler.h"
+#include "Tracer.h"
+#include "GraphStats.h"
 #include <vector>
 
 using namespace Eigen;
@@ -50,6 +56,16 @@ typedef std::unordered_map<size_t, vector<PNode>, SelfHash> NodeMap;
 
 void Insert(const PNode node, NodeMap& node_map) {
     size_t x_hash = node->typeHashCode();
+#if !USE_GPU
+    if (node->fused_group != NULL) {
+        // roots are batched by the program of their groups
+        x_hash = node->fused_group->hash;
+    }
+#endif
+    if (node->segment != 0) {
+        // nodes of different checkpoint segments are never batched together
+        x_hash ^= std::hash<int>{}(node->segment) * 0x9e3779b9;
+    }
     auto it = node_map.find(x_hash);
     if (it == node_map.end()) {
         std::vector<PNode> v = {node};
@@ -80,6 +96,22 @@ class Graph {
   public:
     bool train;
     dtype drop_factor;
+#if !USE_GPU
+    // see MemoryPlanner.h, only used when the graph is not trained
+    bool plan_memory = false;
+    MemoryPlanner memory_planner;
+    // see Checkpoint.h, only used when the graph is trained
+    bool checkpointing = false;
+    int segment = 0;
+    Checkpointer checkpointer;
+    // see Fusion.h
+    bool fusion = false;
+    Fuser fuser;
+#endif
+    // nodes of builders, see NodePool.h
+    NodePool node_pool;
+    // see GraphStats.h, not owned, NULL to record nothing
+    GraphStats *stats = NULL;
 #if USE_GPU
     void *host_memory = NULL;
     void *device_memory = NULL;
@@ -88,6 +120,7 @@ class Graph {
   public:
     Graph() {
         drop_factor = 1.0;
+        train = false;
     }
 
     virtual ~Graph() {
@@ -101,14 +134,77 @@ class Graph {
     }
 
 
+    inline void setStats(GraphStats *graph_stats) {
+        stats = graph_stats;
+    }
+
     inline void setDropFactor(dtype cur_drop_factor) {
         drop_factor = cur_drop_factor;
         if (drop_factor <= 0) drop_factor = 0;
         if (drop_factor >= 1.0) drop_factor = 1.0;
     }
 
+    inline void setMemoryPlanning(bool enabled) {
+#if USE_GPU
+        if (enabled) {
+            std::cout << "memory planning is not supported on GPU" << std::endl;
+            abort();
+        }
+#else
+        plan_memory = enabled;
+#endif
+    }
+
+    inline void setCheckpointing(bool enabled) {
+#if USE_GPU
+        if (enabled) {
+            std::cout << "checkpointing is not supported on GPU" << std::endl;
+            abort();
+        }
+#else
+        checkpointing = enabled;
+#endif
+    }
+
+    inline void setFusion(bool enabled) {
+#if USE_GPU
+        if (enabled) {
+            std::cout << "fusion is not supported on GPU" << std::endl;
+            abort();
+        }
+#else
+        fusion = enabled;
+#endif
+    }
+
+    // nodes added until endSegment() are recomputed in backward as a whole,
+    // segment ids are chosen by builders and must be positive
+    inline void beginSegment(int id) {
+#if !USE_GPU
+        segment = id;
+#endif
+    }
+
+    inline void endSegment() {
+#if !USE_GPU
+        segment = 0;
+#endif
+    }
+
+    // a node valid until the next clearValue
+    template<typename T>
+    inline T *newNode(int dim, dtype dropout = -1) {
+        return node_pool.acquire<T>(dim, dropout);
+    }
+
   public:
     void clearValue(const bool& bTrain = false) {
+#if !USE_GPU
+        memory_planner.clear();
+        checkpointer.clear();
+        fuser.clear();
+        segment = 0;
+#endif
         NodeMap node_map;
         for (Node *node : nodes) {
             Insert(node, node_map);
@@ -127,6 +223,7 @@ class Graph {
             delete execs.at(idx);
         }
         execs.clear();
+        node_pool.recycle();
 
         //std::set<PNode> uncleared_nodes;
         //for (PNode p : nodes) {
@@ -160,13 +257,54 @@ class Graph {
     }
 
     inline void backward() {
+        if (!train) {
+            // params may be shared with other threads in inference
+            std::cout << "backward called on a graph cleared for inference"
+                << std::endl;
+            abort();
+        }
+        Tracer &tracer = Tracer::ins();
+        static const int backward_event = tracer.intern("Graph::backward");
+        TraceScope scope(backward_event);
+        GraphStats::Call call;
+        call.backward = true;
         int count = execs.size();
         for (int idx = count - 1; idx >= 0; idx--) {
-            execs.at(idx)->backward();
+            PExecute e = execs.at(idx);
+            bool traced = tracer.enabled();
+            if (traced) {
+                PNode n = e->batch.at(0);
+                tracer.begin(tracer.internCached(n->node_type), Tracer::BACKWARD,
+                        e->batch.size(), n->dim);
+            }
+            std::chrono::steady_clock::time_point begin;
+            if (stats != NULL) {
+                begin = std::chrono::steady_clock::now();
+            }
+            e->backward();
+            if (stats != NULL) {
+                GraphStats::TypeStats &type = call.types[e->batch.at(0)->node_type];
+                type.backward_executes++;
+                type.backward_seconds += std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - begin).count();
+            }
+            if (traced) {
+                tracer.end();
+            }
+        }
+        if (stats != NULL) {
+            stats->add(call);
         }
     }
 
     inline void addNode(PNode x) {
+#if !USE_GPU
+        x->segment = checkpointing && train ? segment : 0;
+        x->fused_group = NULL;
+        if (!(plan_memory && !train) && !(checkpointing && train)) {
+            x->ensureStorage();
+        }
+#endif
         nodes.push_back(x);
         if (x->degree == 0) {
             Insert(x, free_nodes);
@@ -176,21 +314,83 @@ class Graph {
 
     //real executation
     void compute() {
-        n3ldg_cuda::Profiler &profiler = n3ldg_cuda::Profiler::Ins();
+        Tracer &tracer = Tracer::ins();
+        static const int compute_event = tracer.intern("Graph::compute");
+        TraceScope scope(compute_event);
+        GraphStats::Call call;
+#if !USE_GPU
+        bool planned = plan_memory && !train;
+        bool checkpointed = checkpointing && train;
+        // segments are recomputed by the executes of their nodes, so fusion
+        // is left out when checkpointing
+        if (fusion && !checkpointed) {
+            fuser.fuse(all_nodes);
+        }
+        if (planned) {
+            memory_planner.plan(all_nodes);
+        }
+        if (checkpointed) {
+            checkpointer.plan(all_nodes);
+        }
+#endif
 
         while (Size(free_nodes) > 0) {
+#if !USE_GPU
+            if (planned || checkpointed) {
+                for (auto it : free_nodes) {
+                    for (PNode p : it.second) {
+                        if (planned) {
+                            memory_planner.bind(p);
+                        } else {
+                            checkpointer.bind(p);
+                        }
+                    }
+                }
+            }
+#endif
+            std::chrono::steady_clock::time_point level_begin;
+            if (stats != NULL) {
+                level_begin = std::chrono::steady_clock::now();
+            }
             vector<PExecute> cur_execs;
             for (auto it : free_nodes) {
-                PExecute new_exec = it.second.at(0)->generate(train,
-                        drop_factor);
+                PExecute new_exec = generate(it.second.at(0));
                 new_exec->batch = it.second;
                 cur_execs.push_back(new_exec);
             }
 
             for (PExecute e : cur_execs) {
-                //profiler.BeginEvent("forward");
+                bool traced = tracer.enabled();
+                if (traced) {
+                    PNode n = e->batch.at(0);
+                    tracer.begin(tracer.internCached(n->node_type), Tracer::FORWARD,
+                            e->batch.size(), n->dim);
+                }
+                std::chrono::steady_clock::time_point begin;
+                if (stats != NULL) {
+                    begin = std::chrono::steady_clock::now();
+                }
                 e->forward();
-                //profiler.EndEvent();
+                if (stats != NULL) {
+                    double seconds = std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - begin).count();
+                    GraphStats::TypeStats &type = call.types[e->batch.at(0)->node_type];
+                    int size = e->batch.size();
+                    type.executes++;
+                    type.nodes += size;
+                    type.singletons += size == 1;
+                    type.batches[GraphStats::bucket(size)]++;
+                    type.flops += e->flops();
+                    type.forward_seconds += seconds;
+                }
+                if (traced) {
+                    tracer.end();
+                }
+#if !USE_GPU
+                if (checkpointed && e->batch.at(0)->segment != 0) {
+                    e = checkpointer.stash(e, train, drop_factor);
+                }
+#endif
                 execs.push_back(e);
             }
 
@@ -199,6 +399,20 @@ class Graph {
             for (auto vec_it : free_nodes) {
                 for (auto free_node_it : vec_it.second) {
                     finish_nodes.push_back(free_node_it);
+#if !USE_GPU
+                    if (free_node_it->fused_group != NULL) {
+                        for (PNode p : free_node_it->fused_group->nodes) {
+                            if (p != free_node_it) {
+                                finish_nodes.push_back(p);
+                            }
+                        }
+                    }
+                    if (planned) {
+                        memory_planner.finish(free_node_it);
+                    } else if (checkpointed) {
+                        checkpointer.finish(free_node_it);
+                    }
+#endif
                     for (auto parent_it : free_node_it->parents) {
                         if (parent_it->degree <= 0) {
                             abort();
@@ -213,6 +427,13 @@ class Graph {
 
             // update free nodes
             free_nodes = std::move(new_free_nodes);
+            if (stats != NULL) {
+                call.level_seconds.push_back(std::chrono::duration<double>(
+                            std::chrono::steady_clock::now() - level_begin).count());
+            }
+        }
+        if (stats != NULL) {
+            stats->add(call);
         }
 
         if (finish_nodes.size() != all_nodes.size()) {
@@ -231,6 +452,17 @@ class Graph {
         }
     }
 
+  private:
+    PExecute generate(PNode node) {
+#if !USE_GPU
+        if (node->fused_group != NULL) {
+            return node->fused_group->generate(train, drop_factor);
+        }
+#endif
+        return node->generate(train, drop_factor);
+    }
+
+  public:
 #if USE_GPU
     void computeNodeInfo(std::vector<std::vector<NodeInfo>> &graph_node_info) const {
         if (!graph_node_info.empty()) {
@@ -317,6 +549,18 @@ inline vector<PNode> getPNodes(vector<DerivedNode>& inputs, int size) {
     return pnodes;
 }
 
+template<typename DerivedNode>
+inline vector<PNode> getPNodes(vector<DerivedNode*>& inputs, int size) {
+    int usedSize = inputs.size();
+    if (size >= 0 && size < usedSize) usedSize = size;
+    vector<PNode> pnodes;
+    for (int idx = 0; idx < usedSize; idx++) {
+        pnodes.push_back(inputs.at(idx));
+    }
+
+    return pnodes;
+}
+
 template<typename DerivedNode>
 inline vector<PNode> getPNodes(DerivedNode inputs[], int size) {
     //int usedSize = inputs.;
@@ -346,6 +590,21 @@ inline vector<PNode> getPNodes(vector<DerivedNode>& inputs, int start, int lengt
     return pnodes;
 }
 
+template<typename DerivedNode>
+inline vector<PNode> getPNodes(vector<DerivedNode*>& inputs, int start, int length) {
+    int end, tmp_end = start + length;
+    if (tmp_end > inputs.size())
+        end = inputs.size();
+    else
+        end = tmp_end;
+    vector<PNode> pnodes;
+    for (int idx = start; idx < end; idx++) {
+        pnodes.push_back(inputs.at(idx));
+    }
+
+    return pnodes;
+}
+
 template<typename DerivedNode>
 inline vector<PNode> getPNodes(DerivedNode inputs[], int size, int start, int length) {
     int end, tmp_end = start + length;
@@ -0,0 +1,188 @@
+#ifndef N3LDG_GRAPHSTATS_H
+#define N3LDG_GRAPHSTATS_H
+
+/*
+*  GraphStats.h:
+*  how well Graph::compute batches, see Graph::setStats
+*  (1) per compute: the levels (rounds of free nodes), the executes and
+*      their nodes, the singletons (executes of one node) and the time of
+*      every level
+*  (2) per node type: a histogram of the batch sizes, the executes, the
+*      singletons, the estimated flops (Execute::flops) and the forward
+*      and backward time
+*  (3) counters are cumulative, a GraphStats may be shared by the graphs
+*      of several threads, each graph merges its call once it is done,
+*      writeCounters writes them in the Prometheus text format
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class GraphStats {
+  public:
+    // batch sizes 1, 2, 3-4, 5-8, ..., 1025 and more
+    static const int BUCKETS = 12;
+
+    struct TypeStats {
+        uint64_t executes = 0;
+        uint64_t nodes = 0;
+        uint64_t singletons = 0;
+        uint64_t batches[BUCKETS] = {};
+        double flops = 0;
+        double forward_seconds = 0;
+        uint64_t backward_executes = 0;
+        double backward_seconds = 0;
+
+        void add(const TypeStats &other) {
+            executes += other.executes;
+            nodes += other.nodes;
+            singletons += other.singletons;
+            for (int b = 0; b < BUCKETS; b++) {
+                batches[b] += other.batches[b];
+            }
+            flops += other.flops;
+            forward_seconds += other.forward_seconds;
+            backward_executes += other.backward_executes;
+            backward_seconds += other.backward_seconds;
+        }
+    };
+
+    struct Totals {
+        uint64_t computes = 0;
+        uint64_t backwards = 0;
+        uint64_t levels = 0;
+        uint64_t executes = 0;
+        uint64_t nodes = 0;
+        uint64_t singletons = 0;
+        std::vector<double> level_seconds; // by level
+        std::map<std::string, TypeStats> types;
+
+        // nodes per execute, 1 when nothing is batched
+        double meanBatch() const {
+            return executes > 0 ? (double)nodes / executes : 0;
+        }
+    };
+
+    // what one compute or backward call recorded, merged by add
+    struct Call {
+        bool backward = false;
+        std::vector<double> level_seconds;
+        std::unordered_map<std::string, TypeStats> types;
+    };
+
+    static int bucket(int size) {
+        int b = 0;
+        while (b + 1 < BUCKETS && (1 << b) < size) {
+            b++;
+        }
+        return b;
+    }
+
+    // le of the bucket in writeCounters, -1 for the last one
+    static int bucketBound(int b) {
+        return b + 1 < BUCKETS ? 1 << b : -1;
+    }
+
+    void add(const Call &call) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (call.backward) {
+            totals.backwards++;
+        } else {
+            totals.computes++;
+            totals.levels += call.level_seconds.size();
+            if (totals.level_seconds.size() < call.level_seconds.size()) {
+                totals.level_seconds.resize(call.level_seconds.size());
+            }
+            for (size_t l = 0; l < call.level_seconds.size(); l++) {
+                totals.level_seconds[l] += call.level_seconds[l];
+            }
+        }
+        for (auto &it : call.types) {
+            totals.executes += it.second.executes;
+            totals.nodes += it.second.nodes;
+            totals.singletons += it.second.singletons;
+            totals.types[it.first].add(it.second);
+        }
+        if (!call.backward) {
+            last = call;
+        }
+    }
+
+    Totals snapshot() {
+        std::lock_guard<std::mutex> guard(lock);
+        return totals;
+    }
+
+    // the last compute call merged
+    Call lastCompute() {
+        std::lock_guard<std::mutex> guard(lock);
+        return last;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock);
+        totals = Totals();
+        last = Call();
+    }
+
+    void writeCounters(std::ostream &os) {
+        Totals t = snapshot();
+        os << "# TYPE n3ldg_graph_computes_total counter\n" <<
+            "n3ldg_graph_computes_total " << t.computes << "\n" <<
+            "# TYPE n3ldg_graph_backwards_total counter\n" <<
+            "n3ldg_graph_backwards_total " << t.backwards << "\n" <<
+            "# TYPE n3ldg_graph_levels_total counter\n" <<
+            "n3ldg_graph_levels_total " << t.levels << "\n" <<
+            "# TYPE n3ldg_graph_executes_total counter\n" <<
+            "n3ldg_graph_executes_total " << t.executes << "\n" <<
+            "# TYPE n3ldg_graph_nodes_total counter\n" <<
+            "n3ldg_graph_nodes_total " << t.nodes << "\n" <<
+            "# TYPE n3ldg_graph_singleton_executes_total counter\n" <<
+            "n3ldg_graph_singleton_executes_total " << t.singletons << "\n";
+        os << "# TYPE n3ldg_graph_level_seconds_total counter\n";
+        for (size_t l = 0; l < t.level_seconds.size(); l++) {
+            os << "n3ldg_graph_level_seconds_total{level=\"" << l << "\"} " <<
+                t.level_seconds[l] << "\n";
+        }
+        os << "# TYPE n3ldg_graph_batch_size histogram\n";
+        for (auto &it : t.types) {
+            uint64_t cumulative = 0;
+            for (int b = 0; b < BUCKETS; b++) {
+                cumulative += it.second.batches[b];
+                int bound = bucketBound(b);
+                os << "n3ldg_graph_batch_size_bucket{node_type=\"" << it.first << "\",le=\"" <<
+                    (bound < 0 ? std::string("+Inf") : std::to_string(bound)) << "\"} " <<
+                    cumulative << "\n";
+            }
+            os << "n3ldg_graph_batch_size_sum{node_type=\"" << it.first << "\"} " <<
+                it.second.nodes << "\n" << "n3ldg_graph_batch_size_count{node_type=\"" <<
+                it.first << "\"} " << it.second.executes << "\n";
+        }
+        const char *names[] = {"singleton_executes", "flops", "forward_seconds",
+            "backward_executes", "backward_seconds"};
+        for (int k = 0; k < 5; k++) {
+            os << "# TYPE n3ldg_graph_type_" << names[k] << "_total counter\n";
+            for (auto &it : t.types) {
+                const TypeStats &s = it.second;
+                double v[] = {(double)s.singletons, s.flops, s.forward_seconds,
+                    (double)s.backward_executes, s.backward_seconds};
+                os << "n3ldg_graph_type_" << names[k] << "_total{node_type=\"" << it.first <<
+                    "\"} " << v[k] << "\n";
+            }
+        }
+        os.flush();
+    }
+
+  private:
+    std::mutex lock;
+    Totals totals;
+    Call last;
+};
+
+#endif
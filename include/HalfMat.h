@@ -0,0 +1,206 @@
+#ifndef N3LDG_HALFMAT_H
+#define N3LDG_HALFMAT_H
+
+/*
+*  HalfMat.h:
+*  16 bit copy of a row major matrix for inference, see SparseParam::toHalf
+*  and Param::toHalf
+*  (1) values are stored as bf16 (the top half of a float, same range) or
+*      fp16 (IEEE half, more precision, values beyond 65504 become inf),
+*      rounded to nearest even
+*  (2) rows are widened back to dtype when read, with AVX2 (bf16) or F16C
+*      (fp16) when the compiler targets them and dtype is float
+*  (3) multiply widens blocks of rows that stay in cache and multiplies
+*      them by Eigen, so the weights are read from memory at 16 bits
+*/
+
+#include "MyTensor.h"
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#if !USE_GPU
+
+class HalfMat {
+  public:
+    enum Format {
+        BF16,
+        FP16
+    };
+
+    static const int BLOCK_BYTES = 64 * 1024; // of the rows widened by multiply
+
+    int row = 0;
+    int col = 0;
+    Format format = BF16;
+
+    // stores the row major matrix m of row x col
+    void store(const dtype *m, int nRow, int nCol, Format f) {
+        row = nRow;
+        col = nCol;
+        format = f;
+        size_t size = (size_t)row * col;
+        h.resize(size);
+        for (size_t i = 0; i < size; i++) {
+            h[i] = format == BF16 ? toBF16(m[i]) : toFP16(m[i]);
+        }
+    }
+
+    inline bool empty() const {
+        return h.empty();
+    }
+
+    inline void clear() {
+        std::vector<uint16_t>().swap(h);
+        row = col = 0;
+    }
+
+    inline size_t bytes() const {
+        return h.size() * sizeof(uint16_t);
+    }
+
+    inline const uint16_t *data(int i) const {
+        return h.data() + (size_t)i * col;
+    }
+
+    // out = the first n values of row i
+    inline void decode(int i, dtype *out, int n) const {
+        widen(data(i), out, n, false);
+    }
+
+    // out += the first n values of row i
+    inline void add(int i, dtype *out, int n) const {
+        widen(data(i), out, n, true);
+    }
+
+    // y = M x, or y += M x when accumulate, x is col x count and y is
+    // row x count, both row major as Tensor2D
+    void multiply(const dtype *x, int count, dtype *y, bool accumulate) const {
+        static thread_local std::vector<dtype> block_buffer;
+        int rows = std::max(1, std::min<int>(row, BLOCK_BYTES / sizeof(dtype) / std::max(col, 1)));
+        block_buffer.resize(rows * col);
+        dtype *block = block_buffer.data();
+        Mat xm(const_cast<dtype*>(x), col, count);
+        for (int i0 = 0; i0 < row; i0 += rows) {
+            int n = std::min(rows, row - i0);
+            widen(data(i0), block, n * col, false);
+            Mat wm(block, n, col);
+            Mat ym(y + (size_t)i0 * count, n, count);
+            if (accumulate) {
+                ym.noalias() += wm * xm;
+            } else {
+                ym.noalias() = wm * xm;
+            }
+        }
+    }
+
+  private:
+    std::vector<uint16_t> h;
+
+    static inline uint32_t bits(float f) {
+        uint32_t u;
+        memcpy(&u, &f, sizeof(u));
+        return u;
+    }
+
+    static inline float fromBits(uint32_t u) {
+        float f;
+        memcpy(&f, &u, sizeof(f));
+        return f;
+    }
+
+    static inline uint16_t toBF16(float f) {
+        uint32_t u = bits(f);
+        if ((u & 0x7fffffff) > 0x7f800000) {
+            return (u >> 16) | 0x40; // keeps nan a nan
+        }
+        u += 0x7fff + ((u >> 16) & 1);
+        return u >> 16;
+    }
+
+    static inline float fromBF16(uint16_t v) {
+        return fromBits((uint32_t)v << 16);
+    }
+
+    static inline uint16_t toFP16(float f) {
+        uint32_t u = bits(f);
+        uint16_t sign = (u >> 16) & 0x8000;
+        u &= 0x7fffffff;
+        if (u >= 0x7f800000) {
+            return sign | 0x7c00 | (u > 0x7f800000 ? 0x200 : 0);
+        }
+        if (u >= 0x477ff000) { // rounds to 65536 or above
+            return sign | 0x7c00;
+        }
+        if (u < 0x38800000) { // subnormal, in units of 2^-24
+            return sign | (uint16_t)std::nearbyint(fromBits(u) * 16777216.0f);
+        }
+        u += 0xc8000fff + ((u >> 13) & 1); // exponent rebiased by -112, rounded
+        return sign | (u >> 13);
+    }
+
+    static inline float fromFP16(uint16_t v) {
+        uint32_t sign = (uint32_t)(v & 0x8000) << 16;
+        uint32_t e = (v >> 10) & 0x1f, m = v & 0x3ff;
+        if (e == 0) {
+            float f = m / 16777216.0f;
+            return sign ? -f : f;
+        }
+        if (e == 31) {
+            return fromBits(sign | 0x7f800000 | (m << 13));
+        }
+        return fromBits(sign | ((e + 112) << 23) | (m << 13));
+    }
+
+    inline void widen(const uint16_t *src, dtype *dst, int n, bool accumulate) const {
+        int k = 0;
+#if USE_FLOAT
+        if (format == BF16) {
+#if defined(__AVX2__)
+            for (; k + 8 <= n; k += 8) {
+                __m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(src + k)));
+                __m256 f = _mm256_castsi256_ps(_mm256_slli_epi32(v, 16));
+                if (accumulate) {
+                    f = _mm256_add_ps(f, _mm256_loadu_ps(dst + k));
+                }
+                _mm256_storeu_ps(dst + k, f);
+            }
+#endif
+        } else {
+#if defined(__F16C__) && defined(__AVX__)
+            for (; k + 8 <= n; k += 8) {
+                __m256 f = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(src + k)));
+                if (accumulate) {
+                    f = _mm256_add_ps(f, _mm256_loadu_ps(dst + k));
+                }
+                _mm256_storeu_ps(dst + k, f);
+            }
+#endif
+        }
+#endif
+        // loops of one format and one mode each, so that they vectorize
+        if (format == BF16 && accumulate) {
+            for (; k < n; k++) {
+                dst[k] += fromBF16(src[k]);
+            }
+        } else if (format == BF16) {
+            for (; k < n; k++) {
+                dst[k] = fromBF16(src[k]);
+            }
+        } else {
+            for (; k < n; k++) {
+                dtype v = fromFP16(src[k]);
+                dst[k] = accumulate ? dst[k] + v : v;
+            }
+        }
+    }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,275 @@
+#ifndef N3LDG_INT8MAT_H
+#define N3LDG_INT8MAT_H
+
+/*
+*  Int8Mat.h:
+*  int8 copy of a dense weight matrix for inference, see Param::quantize
+*  (1) weights are symmetric int8 per row (output channel) with a float
+*      scale per row, rows are padded to a multiple of 32 with zeros
+*  (2) inputs are quantized on the fly, a scale per column (node)
+*  (3) products are int8 x int8 -> int32, with AVX512-VNNI (dpbusd on
+*      inputs shifted to uint8, the shift is taken back with the row sums
+*      of the weights) or AVX2 (madd on inputs widened to int16) when the
+*      compiler targets them, a portable loop otherwise
+*/
+
+#include "MyTensor.h"
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+#define N3LDG_INT8_VNNI 1
+#endif
+
+#if !USE_GPU
+
+class Int8Mat {
+  public:
+    static const int COLUMN_BLOCK = 16;
+
+    int row = 0;
+    int col = 0;
+    int stride = 0; // col padded to a multiple of 32
+
+    // quantizes the row major matrix m of row x col
+    void quantize(const dtype *m, int nRow, int nCol) {
+        row = nRow;
+        col = nCol;
+        stride = (col + 31) / 32 * 32;
+        q.assign(row * stride, 0);
+        scale.resize(row);
+#if N3LDG_INT8_VNNI
+        shift.assign(row, 0);
+#endif
+        for (int i = 0; i < row; i++) {
+            const dtype *r = m + i * col;
+            dtype max_abs = 0;
+            for (int j = 0; j < col; j++) {
+                max_abs = std::max<dtype>(max_abs, std::abs(r[j]));
+            }
+            scale[i] = max_abs / 127;
+            dtype inv = max_abs > 0 ? 127 / max_abs : 0;
+            for (int j = 0; j < col; j++) {
+                q[i * stride + j] = toInt(r[j] * inv);
+#if N3LDG_INT8_VNNI
+                shift[i] += 128 * q[i * stride + j];
+#endif
+            }
+        }
+    }
+
+    inline bool empty() const {
+        return q.empty();
+    }
+
+    inline void clear() {
+        std::vector<int8_t>().swap(q);
+        std::vector<float>().swap(scale);
+        std::vector<int32_t>().swap(shift);
+        row = col = stride = 0;
+    }
+
+    inline size_t bytes() const {
+        return q.size() * sizeof(int8_t) + scale.size() * sizeof(float) +
+            shift.size() * sizeof(int32_t);
+    }
+
+    // y = W x, or y += W x when accumulate, x is col x count and y is
+    // row x count, both row major as Tensor2D, one column per node, the
+    // scratch is per thread since a quantized param is frozen and may be
+    // shared by the graphs of several threads
+    void multiply(const dtype *x, int count, dtype *y, bool accumulate) const {
+        static thread_local std::vector<XInt> xq_buffer;
+        static thread_local std::vector<dtype> scale_buffer;
+        xq_buffer.assign(count * stride, 0);
+        scale_buffer.assign(2 * count, 0);
+        // thread locals are read through plain pointers in the loops
+        XInt *xq = xq_buffer.data();
+        dtype *x_scale = scale_buffer.data(), *inv = x_scale + count;
+        for (int k = 0; k < col; k++) {
+            const dtype *r = x + k * count;
+            for (int n = 0; n < count; n++) {
+                x_scale[n] = std::max<dtype>(x_scale[n], std::abs(r[n]));
+            }
+        }
+        for (int n = 0; n < count; n++) {
+            inv[n] = x_scale[n] > 0 ? 127 / x_scale[n] : 0;
+            x_scale[n] /= 127;
+        }
+        // transposed by strips of 16 rows, so that writes are contiguous
+        for (int k0 = 0; k0 < col; k0 += 16) {
+            int k1 = std::min(col, k0 + 16);
+            for (int n = 0; n < count; n++) {
+                XInt *out = xq + n * stride;
+                for (int k = k0; k < k1; k++) {
+                    out[k] = toInt(x[k * count + n] * inv[n]) + X_SHIFT;
+                }
+            }
+        }
+
+        // blocks of columns stay in cache while the rows stream by, a
+        // block of 2 rows by 4 columns is kept in registers
+        const XInt *xs = xq;
+        int32_t acc[8];
+        for (int n0 = 0; n0 < count; n0 += COLUMN_BLOCK) {
+            int n1 = std::min(count, n0 + COLUMN_BLOCK);
+            int i = 0;
+            for (; i + 2 <= row; i += 2) {
+                int n = n0;
+                for (; n + 4 <= n1; n += 4) {
+                    dot2x4(q.data() + i * stride, xs + n * stride, acc);
+                    for (int r = 0; r < 2; r++) {
+                        store(y + (i + r) * count + n, acc + 4 * r, 4, i + r,
+                                x_scale + n, accumulate);
+                    }
+                }
+                for (; n < n1; n++) {
+                    for (int r = 0; r < 2; r++) {
+                        acc[0] = dot(q.data() + (i + r) * stride, xs + n * stride);
+                        store(y + (i + r) * count + n, acc, 1, i + r,
+                                x_scale + n, accumulate);
+                    }
+                }
+            }
+            for (; i < row; i++) {
+                for (int n = n0; n < n1; n++) {
+                    acc[0] = dot(q.data() + i * stride, xs + n * stride);
+                    store(y + i * count + n, acc, 1, i, x_scale + n, accumulate);
+                }
+            }
+        }
+    }
+
+  private:
+#if N3LDG_INT8_VNNI
+    // inputs are shifted to uint8 for dpbusd
+    typedef uint8_t XInt;
+    static const int X_SHIFT = 128;
+#else
+    // inputs are kept as int16, so that the kernels widen the weights only
+    typedef int16_t XInt;
+    static const int X_SHIFT = 0;
+#endif
+
+    std::vector<int8_t> q;
+    std::vector<float> scale;
+    std::vector<int32_t> shift; // X_SHIFT times the row sums, VNNI only
+
+    static inline int8_t toInt(dtype v) {
+        int i = (int)(v + std::copysign((dtype)0.5, v));
+        return (int8_t)std::max(-127, std::min(127, i));
+    }
+
+#if defined(__AVX2__)
+    // 16 products of int16 or 32 of uint8 x int8 added to acc, by groups of 4
+    static inline __m256i madd(__m256i acc, __m256i w, __m256i x) {
+#if N3LDG_INT8_VNNI
+        return _mm256_dpbusd_epi32(acc, x, w);
+#else
+        return _mm256_add_epi32(acc, _mm256_madd_epi16(w, x));
+#endif
+    }
+
+    // the weights of k ... k + STEP - 1 as the kernels want them
+    static inline __m256i loadWeight(const int8_t *w) {
+#if N3LDG_INT8_VNNI
+        return _mm256_loadu_si256((const __m256i*)w);
+#else
+        return _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)w));
+#endif
+    }
+
+    static inline __m256i loadInput(const XInt *x) {
+        return _mm256_loadu_si256((const __m256i*)x);
+    }
+
+    static const int STEP = 32 / sizeof(XInt);
+
+    static inline int32_t sum(__m256i v) {
+        __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+        s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(s);
+    }
+#endif
+
+    inline int32_t dot(const int8_t *w, const XInt *x) const {
+#if defined(__AVX2__)
+        __m256i acc = _mm256_setzero_si256();
+        for (int k = 0; k < stride; k += STEP) {
+            acc = madd(acc, loadWeight(w + k), loadInput(x + k));
+        }
+        return sum(acc);
+#else
+        int32_t s = 0;
+        for (int k = 0; k < stride; k++) {
+            s += w[k] * x[k];
+        }
+        return s;
+#endif
+    }
+
+    inline void store(dtype *y, const int32_t *acc, int n, int i, const dtype *x_scale,
+            bool accumulate) const {
+        int32_t offset = shift.empty() ? 0 : shift[i];
+        for (int t = 0; t < n; t++) {
+            dtype v = (acc[t] - offset) * scale[i] * x_scale[t];
+            y[t] = accumulate ? y[t] + v : v;
+        }
+    }
+
+    // 2 weight rows against 4 input columns, out is row major 2 x 4
+    inline void dot2x4(const int8_t *w, const XInt *x, int32_t *out) const {
+        const int8_t *w0 = w, *w1 = w + stride;
+        const XInt *x0 = x, *x1 = x + stride, *x2 = x + 2 * stride, *x3 = x + 3 * stride;
+#if defined(__AVX2__)
+        __m256i a[8];
+        for (int t = 0; t < 8; t++) {
+            a[t] = _mm256_setzero_si256();
+        }
+        for (int k = 0; k < stride; k += STEP) {
+            __m256i v0 = loadWeight(w0 + k);
+            __m256i v1 = loadWeight(w1 + k);
+            __m256i u = loadInput(x0 + k);
+            a[0] = madd(a[0], v0, u);
+            a[4] = madd(a[4], v1, u);
+            u = loadInput(x1 + k);
+            a[1] = madd(a[1], v0, u);
+            a[5] = madd(a[5], v1, u);
+            u = loadInput(x2 + k);
+            a[2] = madd(a[2], v0, u);
+            a[6] = madd(a[6], v1, u);
+            u = loadInput(x3 + k);
+            a[3] = madd(a[3], v0, u);
+            a[7] = madd(a[7], v1, u);
+        }
+        for (int t = 0; t < 8; t++) {
+            out[t] = sum(a[t]);
+        }
+#else
+        int32_t s[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (int k = 0; k < stride; k++) {
+            int32_t a0 = w0[k], a1 = w1[k];
+            s[0] += a0 * x0[k];
+            s[1] += a0 * x1[k];
+            s[2] += a0 * x2[k];
+            s[3] += a0 * x3[k];
+            s[4] += a1 * x0[k];
+            s[5] += a1 * x1[k];
+            s[6] += a1 * x2[k];
+            s[7] += a1 * x3[k];
+        }
+        for (int t = 0; t < 8; t++) {
+            out[t] = s[t];
+        }
+#endif
+    }
+};
+
+#endif
+
+#endif
@@ -74,24 +74,29 @@ class LSTM1Builder {
     int _inDim;
     int _outDim;
 
-    vector<BiNode> _inputgates;
-    vector<BiNode> _forgetgates;
-    vector<BiNode> _halfcells;
+    vector<BiNode*> _inputgates;
+    vector<BiNode*> _forgetgates;
+    vector<BiNode*> _halfcells;
 
-    vector<PMultiNode> _inputfilters;
-    vector<PMultiNode> _forgetfilters;
+    vector<PMultiNode*> _inputfilters;
+    vector<PMultiNode*> _forgetfilters;
 
-    vector<PAddNode> _cells;
-    vector<BiNode> _outputgates;
-    vector<TanhNode> _halfhiddens;
-    vector<PMultiNode> _hiddens;  // intermediate result without dropout
+    vector<PAddNode*> _cells;
+    vector<BiNode*> _outputgates;
+    vector<TanhNode*> _halfhiddens;
+    vector<PMultiNode*> _hiddens;  // intermediate result without dropout
 
     BucketNode _bucket;
 
     LSTM1Params* _param;
 
+    dtype _dropout;
+
     bool _left2right;
 
+    // steps per recompute segment when the graph is checkpointed, 0 for none
+    int _checkpoint_interval;
+
   public:
     LSTM1Builder() {
         clear();
@@ -106,45 +111,15 @@ class LSTM1Builder {
         _param = paramInit;
         _inDim = _param->input.W2.inDim();
         _outDim = _param->input.W2.outDim();
-        int maxsize = _inputgates.size();
-        for (int idx = 0; idx < maxsize; idx++) {
-            _inputgates[idx].setParam(&_param->input);
-            _forgetgates[idx].setParam(&_param->forget);
-            _outputgates[idx].setParam(&_param->output);
-            _halfcells[idx].setParam(&_param->cell);
-            _inputgates[idx].setFunctions(&fsigmoid, &dsigmoid);
-            _forgetgates[idx].setFunctions(&fsigmoid, &dsigmoid);
-            _outputgates[idx].setFunctions(&fsigmoid, &dsigmoid);
-            _halfcells[idx].setFunctions(&ftanh, &dtanh);
-        }
+        _dropout = dropout;
         _left2right = left2right;
 
-        for (int idx = 0; idx < maxsize; idx++) {
-            _inputgates[idx].init(_outDim, -1);
-            _forgetgates[idx].init(_outDim, -1);
-            _halfcells[idx].init(_outDim, -1);
-            _inputfilters[idx].init(_outDim, -1);
-            _forgetfilters[idx].init(_outDim, -1);
-            _cells[idx].init(_outDim, -1);
-            _outputgates[idx].init(_outDim, -1);
-            _halfhiddens[idx].init(_outDim, -1);
-            _hiddens[idx].init(_outDim, dropout);
-        }
-
         _bucket.init(_outDim, -1);
 
     }
 
-    inline void resize(int maxsize) {
-        _inputgates.resize(maxsize);
-        _forgetgates.resize(maxsize);
-        _halfcells.resize(maxsize);
-        _inputfilters.resize(maxsize);
-        _forgetfilters.resize(maxsize);
-        _cells.resize(maxsize);
-        _outputgates.resize(maxsize);
-        _halfhiddens.resize(maxsize);
-        _hiddens.resize(maxsize);
+    // no-op, forward takes the nodes from Graph::newNode
+    N3LDG_DEPRECATED inline void resize(int) {
     }
 
     //whether vectors have been allocated
@@ -164,12 +139,19 @@ class LSTM1Builder {
         _hiddens.clear();
 
         _left2right = true;
+        _checkpoint_interval = 0;
         _param = NULL;
+        _dropout = -1;
         _nSize = 0;
         _inDim = 0;
         _outDim = 0;
     }
 
+    // trade compute for memory, see Graph::setCheckpointing
+    inline void setCheckpointInterval(int steps) {
+        _checkpoint_interval = steps;
+    }
+
   public:
     inline void forward(Graph *cg, const vector<PNode>& x) {
         if (x.size() == 0) {
@@ -182,91 +164,145 @@ class LSTM1Builder {
             return;
         }
 
+        allocate(cg);
+
         if (_left2right) {
             left2right_forward(cg, x);
         } else {
             right2left_forward(cg, x);
         }
+        if (_checkpoint_interval > 0) {
+            cg->endSegment();
+        }
     }
 
   protected:
+    // nodes of the current sentence, see NodePool.h
+    inline void allocate(Graph *cg) {
+        _inputgates.resize(_nSize);
+        _forgetgates.resize(_nSize);
+        _halfcells.resize(_nSize);
+        _inputfilters.resize(_nSize);
+        _forgetfilters.resize(_nSize);
+        _cells.resize(_nSize);
+        _outputgates.resize(_nSize);
+        _halfhiddens.resize(_nSize);
+        _hiddens.resize(_nSize);
+        // the first step has no cell to forget
+        int first = _left2right ? 0 : _nSize - 1;
+        for (int idx = 0; idx < _nSize; idx++) {
+            if (idx != first) {
+                _forgetgates[idx] = cg->newNode<BiNode>(_outDim);
+                _forgetfilters[idx] = cg->newNode<PMultiNode>(_outDim);
+                _forgetgates[idx]->setParam(&_param->forget);
+                _forgetgates[idx]->setFunctions(&fsigmoid, &dsigmoid);
+            } else {
+                _forgetgates[idx] = NULL;
+                _forgetfilters[idx] = NULL;
+            }
+            _inputgates[idx] = cg->newNode<BiNode>(_outDim);
+            _halfcells[idx] = cg->newNode<BiNode>(_outDim);
+            _inputfilters[idx] = cg->newNode<PMultiNode>(_outDim);
+            _cells[idx] = cg->newNode<PAddNode>(_outDim);
+            _outputgates[idx] = cg->newNode<BiNode>(_outDim);
+            _halfhiddens[idx] = cg->newNode<TanhNode>(_outDim);
+            _hiddens[idx] = cg->newNode<PMultiNode>(_outDim, _dropout);
+
+            _inputgates[idx]->setParam(&_param->input);
+            _outputgates[idx]->setParam(&_param->output);
+            _halfcells[idx]->setParam(&_param->cell);
+            _inputgates[idx]->setFunctions(&fsigmoid, &dsigmoid);
+            _outputgates[idx]->setFunctions(&fsigmoid, &dsigmoid);
+            _halfcells[idx]->setFunctions(&ftanh, &dtanh);
+        }
+    }
+
     inline void left2right_forward(Graph *cg, const vector<PNode>& x) {
         for (int idx = 0; idx < _nSize; idx++) {
+            // odd segment ids for left2right and even ones for right2left,
+            // so that a segment spans a short stretch of the backward pass
+            if (_checkpoint_interval > 0) {
+                cg->beginSegment(2 * (idx / _checkpoint_interval) + 1);
+            }
             if (idx == 0) {
                 _bucket.forward(cg, 0);
 
-                _inputgates[idx].forward(cg, &_bucket, x[idx]);
+                _inputgates[idx]->forward(cg, &_bucket, x[idx]);
 
-                _halfcells[idx].forward(cg, &_bucket, x[idx]);
+                _halfcells[idx]->forward(cg, &_bucket, x[idx]);
 
-                _inputfilters[idx].forward(cg, &_halfcells[idx], &_inputgates[idx]);
+                _inputfilters[idx]->forward(cg, _halfcells[idx], _inputgates[idx]);
 
-                _cells[idx].forward(cg, &_inputfilters[idx], &_bucket);
+                _cells[idx]->forward(cg, _inputfilters[idx], &_bucket);
 
-                _halfhiddens[idx].forward(cg, &_cells[idx]);
+                _halfhiddens[idx]->forward(cg, _cells[idx]);
 
-                _outputgates[idx].forward(cg, &_bucket, x[idx]);
+                _outputgates[idx]->forward(cg, &_bucket, x[idx]);
 
-                _hiddens[idx].forward(cg, &_halfhiddens[idx], &_outputgates[idx]);
+                _hiddens[idx]->forward(cg, _halfhiddens[idx], _outputgates[idx]);
 
             } else {
-                _inputgates[idx].forward(cg, &_hiddens[idx - 1], x[idx]);
+                _inputgates[idx]->forward(cg, _hiddens[idx - 1], x[idx]);
 
-                _forgetgates[idx].forward(cg, &_hiddens[idx - 1], x[idx]);
+                _forgetgates[idx]->forward(cg, _hiddens[idx - 1], x[idx]);
 
-                _halfcells[idx].forward(cg, &_hiddens[idx - 1], x[idx]);
+                _halfcells[idx]->forward(cg, _hiddens[idx - 1], x[idx]);
 
-                _inputfilters[idx].forward(cg, &_halfcells[idx], &_inputgates[idx]);
+                _inputfilters[idx]->forward(cg, _halfcells[idx], _inputgates[idx]);
 
-                _forgetfilters[idx].forward(cg, &_cells[idx - 1], &_forgetgates[idx]);
+                _forgetfilters[idx]->forward(cg, _cells[idx - 1], _forgetgates[idx]);
 
-                _cells[idx].forward(cg, &_inputfilters[idx], &_forgetfilters[idx]);
+                _cells[idx]->forward(cg, _inputfilters[idx], _forgetfilters[idx]);
 
-                _halfhiddens[idx].forward(cg, &_cells[idx]);
+                _halfhiddens[idx]->forward(cg, _cells[idx]);
 
-                _outputgates[idx].forward(cg, &_hiddens[idx - 1], x[idx]);
+                _outputgates[idx]->forward(cg, _hiddens[idx - 1], x[idx]);
 
-                _hiddens[idx].forward(cg, &_halfhiddens[idx], &_outputgates[idx]);
+                _hiddens[idx]->forward(cg, _halfhiddens[idx], _outputgates[idx]);
             }
         }
     }
 
     inline void right2left_forward(Graph *cg, const vector<PNode>& x) {
         for (int idx = _nSize - 1; idx >= 0; idx--) {
+            if (_checkpoint_interval > 0) {
+                int step = _nSize - 1 - idx;
+                cg->beginSegment(2 * (step / _checkpoint_interval) + 2);
+            }
             if (idx == _nSize - 1) {
                 _bucket.forward(cg, 0);
 
-                _inputgates[idx].forward(cg, &_bucket, x[idx]);
+                _inputgates[idx]->forward(cg, &_bucket, x[idx]);
 
-                _halfcells[idx].forward(cg, &_bucket, x[idx]);
+                _halfcells[idx]->forward(cg, &_bucket, x[idx]);
 
-                _inputfilters[idx].forward(cg, &_halfcells[idx], &_inputgates[idx]);
+                _inputfilters[idx]->forward(cg, _halfcells[idx], _inputgates[idx]);
 
-                _cells[idx].forward(cg, &_inputfilters[idx], &_bucket);
+                _cells[idx]->forward(cg, _inputfilters[idx], &_bucket);
 
-                _halfhiddens[idx].forward(cg, &_cells[idx]);
+                _halfhiddens[idx]->forward(cg, _cells[idx]);
 
-                _outputgates[idx].forward(cg, &_bucket, x[idx]);
+                _outputgates[idx]->forward(cg, &_bucket, x[idx]);
 
-                _hiddens[idx].forward(cg, &_halfhiddens[idx], &_outputgates[idx]);
+                _hiddens[idx]->forward(cg, _halfhiddens[idx], _outputgates[idx]);
             } else {
-                _inputgates[idx].forward(cg, &_hiddens[idx + 1], x[idx]);
+                _inputgates[idx]->forward(cg, _hiddens[idx + 1], x[idx]);
 
-                _forgetgates[idx].forward(cg, &_hiddens[idx + 1], x[idx]);
+                _forgetgates[idx]->forward(cg, _hiddens[idx + 1], x[idx]);
 
-                _halfcells[idx].forward(cg, &_hiddens[idx + 1], x[idx]);
+                _halfcells[idx]->forward(cg, _hiddens[idx + 1], x[idx]);
 
-                _inputfilters[idx].forward(cg, &_halfcells[idx], &_inputgates[idx]);
+                _inputfilters[idx]->forward(cg, _halfcells[idx], _inputgates[idx]);
 
-                _forgetfilters[idx].forward(cg, &_cells[idx + 1], &_forgetgates[idx]);
+                _forgetfilters[idx]->forward(cg, _cells[idx + 1], _forgetgates[idx]);
 
-                _cells[idx].forward(cg, &_inputfilters[idx], &_forgetfilters[idx]);
+                _cells[idx]->forward(cg, _inputfilters[idx], _forgetfilters[idx]);
 
-                _halfhiddens[idx].forward(cg, &_cells[idx]);
+                _halfhiddens[idx]->forward(cg, _cells[idx]);
 
-                _outputgates[idx].forward(cg, &_hiddens[idx + 1], x[idx]);
+                _outputgates[idx]->forward(cg, _hiddens[idx + 1], x[idx]);
 
-                _hiddens[idx].forward(cg, &_halfhiddens[idx], &_outputgates[idx]);
+                _hiddens[idx]->forward(cg, _halfhiddens[idx], _outputgates[idx]);
             }
 
         }
@@ -101,40 +101,45 @@ public:
     int _inDim;
     int _outDim;
 
-    vector<LinearNode> _inputgates_hidden;
-    vector<LinearNode> _inputgates_input;
-    vector<PAddNode> _inputgates_add;
-    vector<SigmoidNode> _inputgates;
+    vector<LinearNode*> _inputgates_hidden;
+    vector<LinearNode*> _inputgates_input;
+    vector<PAddNode*> _inputgates_add;
+    vector<SigmoidNode*> _inputgates;
 
-    vector<LinearNode> _forgetgates_hidden;
-    vector<LinearNode> _forgetgates_input;
-    vector<PAddNode> _forgetgates_add;
-    vector<SigmoidNode> _forgetgates;
+    vector<LinearNode*> _forgetgates_hidden;
+    vector<LinearNode*> _forgetgates_input;
+    vector<PAddNode*> _forgetgates_add;
+    vector<SigmoidNode*> _forgetgates;
 
-    vector<LinearNode> _halfcells_hidden;
-    vector<LinearNode> _halfcells_input;
-    vector<PAddNode> _halfcells_add;
-    vector<TanhNode> _halfcells;
+    vector<LinearNode*> _halfcells_hidden;
+    vector<LinearNode*> _halfcells_input;
+    vector<PAddNode*> _halfcells_add;
+    vector<TanhNode*> _halfcells;
 
-    vector<LinearNode> _outputgates_hidden;
-    vector<LinearNode> _outputgates_input;
-    vector<PAddNode> _outputgates_add;
-    vector<SigmoidNode> _outputgates;
+    vector<LinearNode*> _outputgates_hidden;
+    vector<LinearNode*> _outputgates_input;
+    vector<PAddNode*> _outputgates_add;
+    vector<SigmoidNode*> _outputgates;
 
-    vector<PMultiNode> _inputfilters;
-    vector<PMultiNode> _forgetfilters;
+    vector<PMultiNode*> _inputfilters;
+    vector<PMultiNode*> _forgetfilters;
 
-    vector<PAddNode> _cells;
+    vector<PAddNode*> _cells;
 
-    vector<TanhNode> _halfhiddens;
-    vector<PMultiNode> _hiddens;  // intermediate result without dropout
+    vector<TanhNode*> _halfhiddens;
+    vector<PMultiNode*> _hiddens;  // intermediate result without dropout
 
     BucketNode _bucket;
 
     LSTM2Params* _param;
 
+    dtype _dropout;
+
     bool _left2right;
 
+    // steps per recompute segment when the graph is checkpointed, 0 for none
+    int _checkpoint_interval;
+
 public:
     LSTM2Builder() {
         clear();
@@ -149,75 +154,15 @@ public:
         _param = paramInit;
         _inDim = _param->input_input.W.inDim();
         _outDim = _param->input_input.W.outDim();
-        int maxsize = _inputgates_hidden.size();
-
-        for (int idx = 0; idx < maxsize; idx++) {
-            _inputgates_input.at(idx).setParam(&_param->input_input);
-            _outputgates_input.at(idx).setParam(&_param->output_input);
-            _forgetgates_input.at(idx).setParam(&_param->forget_input);
-            _halfcells_input.at(idx).setParam(&_param->cell_input);
-
-            _inputgates_hidden.at(idx).setParam(&_param->input_hidden);
-            _outputgates_hidden.at(idx).setParam(&_param->output_hidden);
-            _forgetgates_hidden.at(idx).setParam(&_param->forget_hidden);
-            _halfcells_hidden.at(idx).setParam(&_param->cell_hidden);
-        }
+        _dropout = dropout;
         _left2right = left2right;
 
-        for (int idx = 0; idx < maxsize; idx++) {
-            _inputgates_hidden.at(idx).init(_outDim, -1);
-            _inputgates_input.at(idx).init(_outDim, -1);
-            _forgetgates_hidden.at(idx).init(_outDim, -1);
-            _forgetgates_input.at(idx).init(_outDim, -1);
-            _halfcells_hidden.at(idx).init(_outDim, -1);
-            _halfcells_input.at(idx).init(_outDim, -1);
-            _outputgates_hidden.at(idx).init(_outDim, -1);
-            _outputgates_input.at(idx).init(_outDim, -1);
-
-            _inputfilters.at(idx).init(_outDim, -1);
-            _forgetfilters.at(idx).init(_outDim, -1);
-            _cells.at(idx).init(_outDim, -1);
-
-            _halfhiddens.at(idx).init(_outDim, -1);
-            _hiddens.at(idx).init(_outDim, dropout);
-        }
-        for (int idx = 0; idx < maxsize; idx++) {
-            _inputgates_add.at(idx).init(_outDim, -1);
-            _inputgates.at(idx).init(_outDim, -1);
-            _forgetgates_add.at(idx).init(_outDim, -1);
-            _forgetgates.at(idx).init(_outDim, -1);
-            _halfcells_add.at(idx).init(_outDim, -1);
-            _halfcells.at(idx).init(_outDim, -1);
-            _outputgates_add.at(idx).init(_outDim, -1);
-            _outputgates.at(idx).init(_outDim, -1);
-        }
         _bucket.init(_outDim, -1);
 
     }
 
-    inline void resize(int maxsize) {
-        _inputgates_hidden.resize(maxsize);
-        _inputgates_input.resize(maxsize);
-        _inputgates_add.resize(maxsize);
-        _inputgates.resize(maxsize);
-        _forgetgates_hidden.resize(maxsize);
-        _forgetgates_input.resize(maxsize);
-        _forgetgates_add.resize(maxsize);
-        _forgetgates.resize(maxsize);
-        _halfcells_hidden.resize(maxsize);
-        _halfcells_input.resize(maxsize);
-        _halfcells_add.resize(maxsize);
-        _halfcells.resize(maxsize);
-        _outputgates_hidden.resize(maxsize);
-        _outputgates_input.resize(maxsize);
-        _outputgates_add.resize(maxsize);
-        _outputgates.resize(maxsize);
-
-        _inputfilters.resize(maxsize);
-        _forgetfilters.resize(maxsize);
-        _cells.resize(maxsize);
-        _halfhiddens.resize(maxsize);
-        _hiddens.resize(maxsize);
+    // no-op, forward takes the nodes from Graph::newNode
+    N3LDG_DEPRECATED inline void resize(int) {
     }
 
     //whether vectors have been allocated
@@ -250,12 +195,19 @@ public:
         _hiddens.clear();
 
         _left2right = true;
+        _checkpoint_interval = 0;
         _param = NULL;
+        _dropout = -1;
         _nSize = 0;
         _inDim = 0;
         _outDim = 0;
     }
 
+    // trade compute for memory, see Graph::setCheckpointing
+    inline void setCheckpointInterval(int steps) {
+        _checkpoint_interval = steps;
+    }
+
 public:
     inline void forward(Graph *cg, const vector<PNode>& x) {
         if (x.size() == 0) {
@@ -268,193 +220,265 @@ public:
             return;
         }
 
+        allocate(cg);
+
         if (_left2right) {
             left2right_forward(cg, x);
         }
         else {
             right2left_forward(cg, x);
         }
+        if (_checkpoint_interval > 0) {
+            cg->endSegment();
+        }
     }
 
 protected:
+    // nodes of the current sentence, see NodePool.h
+    inline void allocate(Graph *cg) {
+        _inputgates_hidden.resize(_nSize);
+        _inputgates_input.resize(_nSize);
+        _inputgates_add.resize(_nSize);
+        _inputgates.resize(_nSize);
+        _forgetgates_hidden.resize(_nSize);
+        _forgetgates_input.resize(_nSize);
+        _forgetgates_add.resize(_nSize);
+        _forgetgates.resize(_nSize);
+        _halfcells_hidden.resize(_nSize);
+        _halfcells_input.resize(_nSize);
+        _halfcells_add.resize(_nSize);
+        _halfcells.resize(_nSize);
+        _outputgates_hidden.resize(_nSize);
+        _outputgates_input.resize(_nSize);
+        _outputgates_add.resize(_nSize);
+        _outputgates.resize(_nSize);
+        _inputfilters.resize(_nSize);
+        _forgetfilters.resize(_nSize);
+        _cells.resize(_nSize);
+        _halfhiddens.resize(_nSize);
+        _hiddens.resize(_nSize);
+        for (int idx = 0; idx < _nSize; idx++) {
+            _inputgates_hidden[idx] = cg->newNode<LinearNode>(_outDim);
+            _inputgates_input[idx] = cg->newNode<LinearNode>(_outDim);
+            _inputgates_add[idx] = cg->newNode<PAddNode>(_outDim);
+            _inputgates[idx] = cg->newNode<SigmoidNode>(_outDim);
+            _forgetgates_hidden[idx] = cg->newNode<LinearNode>(_outDim);
+            _forgetgates_input[idx] = cg->newNode<LinearNode>(_outDim);
+            _forgetgates_add[idx] = cg->newNode<PAddNode>(_outDim);
+            _forgetgates[idx] = cg->newNode<SigmoidNode>(_outDim);
+            _halfcells_hidden[idx] = cg->newNode<LinearNode>(_outDim);
+            _halfcells_input[idx] = cg->newNode<LinearNode>(_outDim);
+            _halfcells_add[idx] = cg->newNode<PAddNode>(_outDim);
+            _halfcells[idx] = cg->newNode<TanhNode>(_outDim);
+            _outputgates_hidden[idx] = cg->newNode<LinearNode>(_outDim);
+            _outputgates_input[idx] = cg->newNode<LinearNode>(_outDim);
+            _outputgates_add[idx] = cg->newNode<PAddNode>(_outDim);
+            _outputgates[idx] = cg->newNode<SigmoidNode>(_outDim);
+            _inputfilters[idx] = cg->newNode<PMultiNode>(_outDim);
+            _forgetfilters[idx] = cg->newNode<PMultiNode>(_outDim);
+            _cells[idx] = cg->newNode<PAddNode>(_outDim);
+            _halfhiddens[idx] = cg->newNode<TanhNode>(_outDim);
+            _hiddens[idx] = cg->newNode<PMultiNode>(_outDim, _dropout);
+
+            _inputgates_input[idx]->setParam(&_param->input_input);
+            _outputgates_input[idx]->setParam(&_param->output_input);
+            _forgetgates_input[idx]->setParam(&_param->forget_input);
+            _halfcells_input[idx]->setParam(&_param->cell_input);
+
+            _inputgates_hidden[idx]->setParam(&_param->input_hidden);
+            _outputgates_hidden[idx]->setParam(&_param->output_hidden);
+            _forgetgates_hidden[idx]->setParam(&_param->forget_hidden);
+            _halfcells_hidden[idx]->setParam(&_param->cell_hidden);
+        }
+    }
+
     inline void left2right_forward(Graph *cg, const vector<PNode>& x) {
         for (int idx = 0; idx < _nSize; idx++) {
+            // odd segment ids for left2right and even ones for right2left,
+            // so that a segment spans a short stretch of the backward pass
+            if (_checkpoint_interval > 0) {
+                cg->beginSegment(2 * (idx / _checkpoint_interval) + 1);
+            }
             if (idx == 0) {
                 _bucket.forward(cg, 0);
 
-                _inputgates_hidden[idx].forward(cg, &_bucket);
+                _inputgates_hidden[idx]->forward(cg, &_bucket);
 
-                _inputgates_input[idx].forward(cg, x[idx]);
+                _inputgates_input[idx]->forward(cg, x[idx]);
 
-                _inputgates_add[idx].forward(cg, &_inputgates_hidden[idx], &_inputgates_input[idx]);
+                _inputgates_add[idx]->forward(cg, _inputgates_hidden[idx], _inputgates_input[idx]);
 
-                _inputgates[idx].forward(cg, &_inputgates_add[idx]);
+                _inputgates[idx]->forward(cg, _inputgates_add[idx]);
 
 
-                _outputgates_hidden[idx].forward(cg, &_bucket);
+                _outputgates_hidden[idx]->forward(cg, &_bucket);
 
-                _outputgates_input[idx].forward(cg, x[idx]);
+                _outputgates_input[idx]->forward(cg, x[idx]);
 
-                _outputgates_add[idx].forward(cg, &_outputgates_hidden[idx], &_outputgates_input[idx]);
+                _outputgates_add[idx]->forward(cg, _outputgates_hidden[idx], _outputgates_input[idx]);
 
-                _outputgates[idx].forward(cg, &_outputgates_add[idx]);
+                _outputgates[idx]->forward(cg, _outputgates_add[idx]);
 
 
-                _halfcells_hidden[idx].forward(cg, &_bucket);
+                _halfcells_hidden[idx]->forward(cg, &_bucket);
 
-                _halfcells_input[idx].forward(cg, x[idx]);
+                _halfcells_input[idx]->forward(cg, x[idx]);
 
-                _halfcells_add[idx].forward(cg, &_halfcells_hidden[idx], &_halfcells_input[idx]);
+                _halfcells_add[idx]->forward(cg, _halfcells_hidden[idx], _halfcells_input[idx]);
 
-                _halfcells[idx].forward(cg, &_halfcells_add[idx]);
+                _halfcells[idx]->forward(cg, _halfcells_add[idx]);
 
 
-                _inputfilters[idx].forward(cg, &_halfcells[idx], &_inputgates[idx]);
+                _inputfilters[idx]->forward(cg, _halfcells[idx], _inputgates[idx]);
 
-                _cells[idx].forward(cg, &_inputfilters[idx], &_bucket);
+                _cells[idx]->forward(cg, _inputfilters[idx], &_bucket);
 
-                _halfhiddens[idx].forward(cg, &_cells[idx]);
+                _halfhiddens[idx]->forward(cg, _cells[idx]);
 
-                _hiddens[idx].forward(cg, &_halfhiddens[idx], &_outputgates[idx]);
+                _hiddens[idx]->forward(cg, _halfhiddens[idx], _outputgates[idx]);
 
             }
             else {
-                _inputgates_hidden[idx].forward(cg, &_hiddens[idx - 1]);
+                _inputgates_hidden[idx]->forward(cg, _hiddens[idx - 1]);
 
-                _inputgates_input[idx].forward(cg, x[idx]);
+                _inputgates_input[idx]->forward(cg, x[idx]);
 
-                _inputgates_add[idx].forward(cg, &_inputgates_hidden[idx], &_inputgates_input[idx]);
+                _inputgates_add[idx]->forward(cg, _inputgates_hidden[idx], _inputgates_input[idx]);
 
-                _inputgates[idx].forward(cg, &_inputgates_add[idx]);
+                _inputgates[idx]->forward(cg, _inputgates_add[idx]);
 
 
-                _outputgates_hidden[idx].forward(cg, &_hiddens[idx - 1]);
+                _outputgates_hidden[idx]->forward(cg, _hiddens[idx - 1]);
 
-                _outputgates_input[idx].forward(cg, x[idx]);
+                _outputgates_input[idx]->forward(cg, x[idx]);
 
-                _outputgates_add[idx].forward(cg, &_outputgates_hidden[idx], &_outputgates_input[idx]);
+                _outputgates_add[idx]->forward(cg, _outputgates_hidden[idx], _outputgates_input[idx]);
 
-                _outputgates[idx].forward(cg, &_outputgates_add[idx]);
+                _outputgates[idx]->forward(cg, _outputgates_add[idx]);
 
 
-                _halfcells_hidden[idx].forward(cg, &_hiddens[idx - 1]);
+                _halfcells_hidden[idx]->forward(cg, _hiddens[idx - 1]);
 
-                _halfcells_input[idx].forward(cg, x[idx]);
+                _halfcells_input[idx]->forward(cg, x[idx]);
 
-                _halfcells_add[idx].forward(cg, &_halfcells_hidden[idx], &_halfcells_input[idx]);
+                _halfcells_add[idx]->forward(cg, _halfcells_hidden[idx], _halfcells_input[idx]);
 
-                _halfcells[idx].forward(cg, &_halfcells_add[idx]);
+                _halfcells[idx]->forward(cg, _halfcells_add[idx]);
 
 
-                _forgetgates_hidden[idx].forward(cg, &_hiddens[idx - 1]);
+                _forgetgates_hidden[idx]->forward(cg, _hiddens[idx - 1]);
 
-                _forgetgates_input[idx].forward(cg, x[idx]);
+                _forgetgates_input[idx]->forward(cg, x[idx]);
 
-                _forgetgates_add[idx].forward(cg, &_forgetgates_hidden[idx], &_forgetgates_input[idx]);
+                _forgetgates_add[idx]->forward(cg, _forgetgates_hidden[idx], _forgetgates_input[idx]);
 
-                _forgetgates[idx].forward(cg, &_forgetgates_add[idx]);
+                _forgetgates[idx]->forward(cg, _forgetgates_add[idx]);
 
 
-                _inputfilters[idx].forward(cg, &_halfcells[idx], &_inputgates[idx]);
+                _inputfilters[idx]->forward(cg, _halfcells[idx], _inputgates[idx]);
 
-                _forgetfilters[idx].forward(cg, &_cells[idx - 1], &_forgetgates[idx]);
+                _forgetfilters[idx]->forward(cg, _cells[idx - 1], _forgetgates[idx]);
 
-                _cells[idx].forward(cg, &_inputfilters[idx], &_forgetfilters[idx]);
+                _cells[idx]->forward(cg, _inputfilters[idx], _forgetfilters[idx]);
 
-                _halfhiddens[idx].forward(cg, &_cells[idx]);
+                _halfhiddens[idx]->forward(cg, _cells[idx]);
 
-                _hiddens[idx].forward(cg, &_halfhiddens[idx], &_outputgates[idx]);
+                _hiddens[idx]->forward(cg, _halfhiddens[idx], _outputgates[idx]);
             }
         }
     }
 
     inline void right2left_forward(Graph *cg, const vector<PNode>& x) {
         for (int idx = _nSize - 1; idx >= 0; idx--) {
+            if (_checkpoint_interval > 0) {
+                int step = _nSize - 1 - idx;
+                cg->beginSegment(2 * (step / _checkpoint_interval) + 2);
+            }
             if (idx == _nSize - 1) {
                 _bucket.forward(cg, 0);
 
-                _inputgates_hidden[idx].forward(cg, &_bucket);
+                _inputgates_hidden[idx]->forward(cg, &_bucket);
 
-                _inputgates_input[idx].forward(cg, x[idx]);
+                _inputgates_input[idx]->forward(cg, x[idx]);
 
-                _inputgates_add[idx].forward(cg, &_inputgates_hidden[idx], &_inputgates_input[idx]);
+                _inputgates_add[idx]->forward(cg, _inputgates_hidden[idx], _inputgates_input[idx]);
 
-                _inputgates[idx].forward(cg, &_inputgates_add[idx]);
+                _inputgates[idx]->forward(cg, _inputgates_add[idx]);
 
 
-                _outputgates_hidden[idx].forward(cg, &_bucket);
+                _outputgates_hidden[idx]->forward(cg, &_bucket);
 
-                _outputgates_input[idx].forward(cg, x[idx]);
+                _outputgates_input[idx]->forward(cg, x[idx]);
 
-                _outputgates_add[idx].forward(cg, &_outputgates_hidden[idx], &_outputgates_input[idx]);
+                _outputgates_add[idx]->forward(cg, _outputgates_hidden[idx], _outputgates_input[idx]);
 
-                _outputgates[idx].forward(cg, &_outputgates_add[idx]);
+                _outputgates[idx]->forward(cg, _outputgates_add[idx]);
 
 
-                _halfcells_hidden[idx].forward(cg, &_bucket);
+                _halfcells_hidden[idx]->forward(cg, &_bucket);
 
-                _halfcells_input[idx].forward(cg, x[idx]);
+                _halfcells_input[idx]->forward(cg, x[idx]);
 
-                _halfcells_add[idx].forward(cg, &_halfcells_hidden[idx], &_halfcells_input[idx]);
+                _halfcells_add[idx]->forward(cg, _halfcells_hidden[idx], _halfcells_input[idx]);
 
-                _halfcells[idx].forward(cg, &_halfcells_add[idx]);
+                _halfcells[idx]->forward(cg, _halfcells_add[idx]);
 
 
-                _inputfilters[idx].forward(cg, &_halfcells[idx], &_inputgates[idx]);
+                _inputfilters[idx]->forward(cg, _halfcells[idx], _inputgates[idx]);
 
-                _cells[idx].forward(cg, &_inputfilters[idx], &_bucket);
+                _cells[idx]->forward(cg, _inputfilters[idx], &_bucket);
 
-                _halfhiddens[idx].forward(cg, &_cells[idx]);
+                _halfhiddens[idx]->forward(cg, _cells[idx]);
 
-                _hiddens[idx].forward(cg, &_halfhiddens[idx], &_outputgates[idx]);
+                _hiddens[idx]->forward(cg, _halfhiddens[idx], _outputgates[idx]);
 
             }
             else {
-                _inputgates_hidden[idx].forward(cg, &_hiddens[idx + 1]);
+                _inputgates_hidden[idx]->forward(cg, _hiddens[idx + 1]);
 
-                _inputgates_input[idx].forward(cg, x[idx]);
+                _inputgates_input[idx]->forward(cg, x[idx]);
 
-                _inputgates_add[idx].forward(cg, &_inputgates_hidden[idx], &_inputgates_input[idx]);
+                _inputgates_add[idx]->forward(cg, _inputgates_hidden[idx], _inputgates_input[idx]);
 
-                _inputgates[idx].forward(cg, &_inputgates_add[idx]);
+                _inputgates[idx]->forward(cg, _inputgates_add[idx]);
 
 
-                _outputgates_hidden[idx].forward(cg, &_hiddens[idx + 1]);
+                _outputgates_hidden[idx]->forward(cg, _hiddens[idx + 1]);
 
-                _outputgates_input[idx].forward(cg, x[idx]);
+                _outputgates_input[idx]->forward(cg, x[idx]);
 
-                _outputgates_add[idx].forward(cg, &_outputgates_hidden[idx], &_outputgates_input[idx]);
+                _outputgates_add[idx]->forward(cg, _outputgates_hidden[idx], _outputgates_input[idx]);
 
-                _outputgates[idx].forward(cg, &_outputgates_add[idx]);
+                _outputgates[idx]->forward(cg, _outputgates_add[idx]);
 
 
-                _halfcells_hidden[idx].forward(cg, &_hiddens[idx + 1]);
+                _halfcells_hidden[idx]->forward(cg, _hiddens[idx + 1]);
 
-                _halfcells_input[idx].forward(cg, x[idx]);
+                _halfcells_input[idx]->forward(cg, x[idx]);
 
-                _halfcells_add[idx].forward(cg, &_halfcells_hidden[idx], &_halfcells_input[idx]);
+                _halfcells_add[idx]->forward(cg, _halfcells_hidden[idx], _halfcells_input[idx]);
 
-                _halfcells[idx].forward(cg, &_halfcells_add[idx]);
+                _halfcells[idx]->forward(cg, _halfcells_add[idx]);
 
 
-                _forgetgates_hidden[idx].forward(cg, &_hiddens[idx + 1]);
+                _forgetgates_hidden[idx]->forward(cg, _hiddens[idx + 1]);
 
-                _forgetgates_input[idx].forward(cg, x[idx]);
+                _forgetgates_input[idx]->forward(cg, x[idx]);
 
-                _forgetgates_add[idx].forward(cg, &_forgetgates_hidden[idx], &_forgetgates_input[idx]);
+                _forgetgates_add[idx]->forward(cg, _forgetgates_hidden[idx], _forgetgates_input[idx]);
 
-                _forgetgates[idx].forward(cg, &_forgetgates_add[idx]);
+                _forgetgates[idx]->forward(cg, _forgetgates_add[idx]);
 
 
-                _inputfilters[idx].forward(cg, &_halfcells[idx], &_inputgates[idx]);
+                _inputfilters[idx]->forward(cg, _halfcells[idx], _inputgates[idx]);
 
-                _forgetfilters[idx].forward(cg, &_cells[idx + 1], &_forgetgates[idx]);
+                _forgetfilters[idx]->forward(cg, _cells[idx + 1], _forgetgates[idx]);
 
-                _cells[idx].forward(cg, &_inputfilters[idx], &_forgetfilters[idx]);
+                _cells[idx]->forward(cg, _inputfilters[idx], _forgetfilters[idx]);
 
-                _halfhiddens[idx].forward(cg, &_cells[idx]);
+                _halfhiddens[idx]->forward(cg, _cells[idx]);
 
-                _hiddens[idx].forward(cg, &_halfhiddens[idx], &_outputgates[idx]);
+                _hiddens[idx]->forward(cg, _halfhiddens[idx], _outputgates[idx]);
             }
         }
     }
@@ -18,9 +18,9 @@ class LogSoftMax {
   public:
     int _nSize;
 
-    vector<PSubNode> _middles;
-    vector<ActivateNode> _expmiddles;
-    vector<PSubNode> _outputs;
+    vector<PSubNode*> _middles;
+    vector<ActivateNode*> _expmiddles;
+    vector<PSubNode*> _outputs;
     PAddNode _sum;
     ActivateNode _logsum;
 
@@ -43,21 +43,17 @@ class LogSoftMax {
     }
 
 
-    inline void init(int maxsize) {
-        _middles.resize(maxsize);
-        _expmiddles.resize(maxsize);
-        _outputs.resize(maxsize);
-        for (int idx = 0; idx < maxsize; idx++) {
-            _middles[idx].init(1, -1);
-            _outputs[idx].init(1, -1);
-            _expmiddles[idx].init(1, -1);
-            _expmiddles[idx].setFunctions(&fexp, &dexp);
-        }
+    inline void init() {
         _sum.init(1, -1);
         _logsum.init(1, -1);
         _logsum.setFunctions(&flog, &dlog);
     }
 
+    // maxsize is unused, forward takes the nodes from Graph::newNode
+    N3LDG_DEPRECATED inline void init(int) {
+        init();
+    }
+
 
 
   public:
@@ -82,16 +78,26 @@ class LogSoftMax {
             }
         }
 
+        _middles.resize(_nSize);
+        _expmiddles.resize(_nSize);
+        _outputs.resize(_nSize);
+        for (int idx = 0; idx < _nSize; idx++) {
+            _middles[idx] = cg->newNode<PSubNode>(1);
+            _expmiddles[idx] = cg->newNode<ActivateNode>(1);
+            _outputs[idx] = cg->newNode<PSubNode>(1);
+            _expmiddles[idx]->setFunctions(&fexp, &dexp);
+        }
+
         for (int idx = 0; idx < _nSize; idx++) {
-            _middles[idx].forward(cg, x[idx], pmax_node);
-            _expmiddles[idx].forward(cg, &_middles[idx]);
+            _middles[idx]->forward(cg, x[idx], pmax_node);
+            _expmiddles[idx]->forward(cg, _middles[idx]);
         }
 
         _sum.forward(cg, getPNodes(_expmiddles, _nSize));
         _logsum.forward(cg, &_sum);
 
         for (int idx = 0; idx < _nSize; idx++) {
-            _outputs[idx].forward(cg, &_middles[idx], &_logsum);
+            _outputs[idx]->forward(cg, _middles[idx], &_logsum);
         }
     }
 
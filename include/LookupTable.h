@@ -10,12 +10,14 @@
  */
 
 #include "SparseParam.h"
+#include "PQTable.h"
 #include "MyLib.h"
 #include "Alphabet.h"
 #include "Node.h"
 #include "Graph.h"
 #include "ModelUpdate.h"
 #include "profiler.h"
+#include <algorithm>
 
 class LookupTable {
 public:
@@ -25,6 +27,9 @@ public:
     int nDim;
     int nVSize;
     int nUNKId;
+#if !USE_GPU
+    PQTable pq; // see compress
+#endif
 
     LookupTable() {
         nVSize = 0;
@@ -189,6 +194,9 @@ public:
 
 
     inline int getElemId(const string& strFeat) {
+        if (E.frozen) {
+            return elems->find(strFeat);
+        }
         return elems->from_string(strFeat);
     }
 
@@ -210,6 +218,64 @@ public:
         elems = alpha;
     }
 
+#if !USE_GPU
+    // as initial with random weights, but E lives in the file at path, see
+    // SparseParam::initialMapped, an existing file is reopened as it is
+    inline bool initialMapped(PAlphabet alpha, int dim, const string &path,
+            size_t cacheRows = 1 << 16, bool fineTune = true) {
+        elems = alpha;
+        nVSize = elems->size();
+        nUNKId = elems->from_string(unknownkey);
+        if (nVSize == 0 || (nVSize == 1 && nUNKId >= 0)) {
+            std::cout << "please check the alphabet" << std::endl;
+            return false;
+        }
+        nDim = dim;
+        bFineTune = fineTune;
+        return E.initialMapped(nDim, nVSize, path, cacheRows, sqrt(1.0 / nDim));
+    }
+
+    // replaces E by a product quantized copy for inference, see PQTable.h,
+    // lookups decode their rows from pq, E is frozen and freed, so the
+    // table is read only from then on
+    inline void compress(int subspaces, int iterations = 16, int sample = 65536) {
+        if (E.valData() == NULL) {
+            std::cout << "LookupTable::compress: E is already freed" << std::endl;
+            abort();
+        }
+        pq.train(E.valData(), E.val.row, E.val.col, subspaces, iterations, sample);
+        E.freeze();
+        E.val.release();
+        E.grad.release();
+        E.aux_square.release();
+        E.aux_mean.release();
+        bFineTune = false;
+    }
+
+    inline bool isCompressed() const {
+        return !pq.empty();
+    }
+
+    // what tools/pq_embedding writes, the alphabet is saved by the model
+    inline void saveCompressed(std::ofstream &os) const {
+        pq.save(os);
+        os << nDim << std::endl;
+        os << nVSize << std::endl;
+        os << nUNKId << std::endl;
+    }
+
+    // in place of load, E is left empty
+    inline void loadCompressed(std::ifstream &is, PAlphabet alpha) {
+        pq.load(is);
+        is >> nDim;
+        is >> nVSize;
+        is >> nUNKId;
+        elems = alpha;
+        bFineTune = false;
+        E.freeze();
+    }
+#endif
+
 };
 
 
@@ -237,7 +303,13 @@ public:
     //this should be leaf nodes
     void forward(Graph *cg, const string& strNorm) {
         assert(param != NULL);
-        xid = param->getElemId(strNorm);
+        forward(cg, param->getElemId(strNorm));
+    }
+
+    // id is that of getElemId (e.g. converted once by str2id), -1 if unknown
+    void forward(Graph *cg, int id) {
+        assert(param != NULL);
+        xid = id;
         if (xid < 0 && param->nUNKId >= 0) {
             xid = param->nUNKId;
         }
@@ -269,6 +341,12 @@ public:
 
     // for which do no require merge
     void compute() {
+#if !USE_GPU
+        if (xid >= 0 && param->isCompressed()) {
+            param->pq.decode(xid, val.v, std::min(dim, param->pq.col));
+            return;
+        }
+#endif
         if (xid >= 0) {
             param->E.value(xid, val);
         } else {
@@ -358,23 +436,106 @@ public:
     }
 };
 #else
+// forward gathers the rows of all ids of the batch, widened from 16 bits
+// when the table is stored so (see SparseParam::toHalf) or decoded from the
+// codes of a compressed table (see LookupTable::compress), backward sorts
+// the ids so that a row hit by several nodes (e.g. punctuation) is
+// accumulated by one task, tasks are split over threads when built with
+// OpenMP
 class LookupExecute :public Execute {
     public:
+        static const int PREFETCH = 4; // rows ahead
+        int dim;
+        LookupTable *table;
+        std::vector<std::pair<int, int>> hits; // (xid, index in batch)
+        std::vector<dtype*> grads; // of the rows hit
+
         inline void  forward() {
             int count = batch.size();
-            //#pragma omp parallel for
+            SparseParam &E = table->E;
+            const PQTable &pq = table->pq;
+            bool compressed = table->isCompressed();
+            int rowDim = compressed ? pq.col : E.outDim();
+            if (rowDim != dim) {
+                std::cout << "warning: output dim not equal lookup param dim." << std::endl;
+                rowDim = std::min(rowDim, dim);
+            }
+            bool half = E.isHalf();
             for (int idx = 0; idx < count; idx++) {
-                batch[idx]->compute();
-                batch[idx]->forward_drop(bTrain, drop_factor);
+                LookupNode *ptr = static_cast<LookupNode*>(batch[idx]);
+#if defined(__GNUC__)
+                if (idx + PREFETCH < count) {
+                    int next = static_cast<LookupNode*>(batch[idx + PREFETCH])->xid;
+                    if (next >= 0 && compressed) {
+                        __builtin_prefetch(pq.code(next));
+                    } else if (next >= 0 && half) {
+                        for (int j = 0; j < rowDim; j += 64 / sizeof(uint16_t)) {
+                            __builtin_prefetch(E.hval.data(next) + j);
+                        }
+                    } else if (next >= 0) {
+                        for (int j = 0; j < rowDim; j += 64 / sizeof(dtype)) {
+                            __builtin_prefetch(E.valRow(next) + j);
+                        }
+                    }
+                }
+#endif
+                if (ptr->xid >= 0 && compressed) {
+                    pq.decode(ptr->xid, ptr->val.v, rowDim);
+                } else if (ptr->xid >= 0 && half) {
+                    E.hval.decode(ptr->xid, ptr->val.v, rowDim);
+                } else if (ptr->xid >= 0) {
+                    E.use(ptr->xid);
+                    memcpy(ptr->val.v, E.valRow(ptr->xid), rowDim * sizeof(dtype));
+                } else {
+                    ptr->val.zero();
+                }
+                ptr->forward_drop(bTrain, drop_factor);
             }
         }
 
         inline void backward() {
             int count = batch.size();
-            //#pragma omp parallel for
+            SparseParam &E = table->E;
+            hits.clear();
             for (int idx = 0; idx < count; idx++) {
-                batch[idx]->backward_drop();
-                batch[idx]->backward();
+                LookupNode *ptr = static_cast<LookupNode*>(batch[idx]);
+                ptr->backward_drop();
+                int xid = ptr->xid;
+                if (xid >= 0 && (xid == table->nUNKId || table->bFineTune)) {
+                    hits.push_back(std::make_pair(xid, idx));
+                }
+            }
+            if (hits.empty()) {
+                return;
+            }
+            E.checkMutable("loss");
+            // nodes of the same id stay in batch order
+            std::sort(hits.begin(), hits.end());
+
+            // grad rows are taken here, as those of a mapped param are
+            // allocated on their first use
+            std::vector<int> starts;
+            grads.clear();
+            for (size_t i = 0; i < hits.size(); i++) {
+                if (i == 0 || hits[i].first != hits[i - 1].first) {
+                    starts.push_back(i);
+                    E.indexers[hits[i].first] = true;
+                    grads.push_back(E.gradRow(hits[i].first));
+                }
+            }
+            starts.push_back(hits.size());
+
+            int rowDim = std::min(E.outDim(), dim);
+            int rows = starts.size() - 1;
+#pragma omp parallel for schedule(static)
+            for (int r = 0; r < rows; r++) {
+                dtype *grad = grads[r];
+                for (int i = starts[r]; i < starts[r + 1]; i++) {
+                    const dtype *loss = batch[hits[i].second]->loss.v;
+                    for (int j = 0; j < rowDim; j++) {
+                        grad[j] += loss[j];
+                    }
+                }
             }
         }
 };
@@ -386,10 +547,8 @@ PExecute LookupNode::generate(bool bTrain, dtype cur_drop_factor) {
     exec->batch.push_back(this);
     exec->bTrain = bTrain;
     exec->drop_factor = cur_drop_factor;
-#if USE_GPU
     exec->table = param;
     exec->dim = dim;
-#endif
     return exec;
 }
 
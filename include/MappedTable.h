@@ -0,0 +1,183 @@
+#ifndef N3LDG_MAPPEDTABLE_H
+#define N3LDG_MAPPEDTABLE_H
+
+/*
+*  MappedTable.h:
+*  a file of per row arrays mapped in memory, the storage of an out of core
+*  SparseParam, see SparseParam::initialMapped
+*  (1) the file holds regions one after another, a region has a fixed
+*      number of bytes per row (e.g. the values, the optimizer state), it is
+*      created sparse, so pages of rows never written take no disk
+*  (2) the windows of 64KB used by the process are kept in an LRU of at
+*      most cache_windows, older ones are dropped from the process
+*      (madvise), dirty data stays in the page cache and goes to the file,
+*      only their rereads may cost, a window and not a page since the
+*      kernel maps the cached pages around a fault too
+*  (3) rows written are marked dirty and flush schedules their write back
+*  POSIX only.
+*/
+
+#include "MyTensor.h"
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if !USE_GPU
+
+class MappedTable {
+  public:
+    static const size_t WINDOW = 64 * 1024;
+
+    int row = 0;
+    size_t cache_windows = 0;
+
+    ~MappedTable() {
+        close();
+    }
+
+    // maps path with a region per entry of row_bytes, a new or empty file is
+    // sized (all zero), another one must have the expected size, returns
+    // whether it existed
+    bool open(const std::string &path, int nRow, const std::vector<size_t> &row_bytes,
+            size_t cacheRows) {
+        close();
+        page = sysconf(_SC_PAGESIZE);
+        window = std::max<size_t>(page, WINDOW);
+        row = nRow;
+        widths = row_bytes;
+        offsets.clear();
+        size_t total = 0;
+        for (size_t width : widths) {
+            offsets.push_back(total);
+            total += (width * row + page - 1) / page * page;
+        }
+        size_t width_sum = 0;
+        for (size_t width : widths) {
+            width_sum += width;
+        }
+        cache_windows = std::max<size_t>(widths.size(),
+                (cacheRows * width_sum + window - 1) / window);
+
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::cout << "MappedTable: cannot open " << path << std::endl;
+            abort();
+        }
+        struct stat st;
+        fstat(fd, &st);
+        bool existed = st.st_size != 0;
+        // a file of another size was written for other dims, never zero it
+        if (existed && (size_t)st.st_size != total) {
+            std::cout << "MappedTable: " << path << " has " << st.st_size <<
+                " bytes, expected " << total << std::endl;
+            abort();
+        }
+        if (!existed && ftruncate(fd, total) != 0) {
+            std::cout << "MappedTable: cannot size " << path << std::endl;
+            abort();
+        }
+        base = (char*)mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (base == MAP_FAILED) {
+            std::cout << "MappedTable: cannot map " << path << std::endl;
+            abort();
+        }
+        bytes = total;
+        // no read ahead, the rows are read at random
+        madvise(base, bytes, MADV_RANDOM);
+        return existed;
+    }
+
+    inline bool isOpen() const {
+        return base != NULL;
+    }
+
+    inline char *at(int region, int i) const {
+        return base + offsets[region] + widths[region] * i;
+    }
+
+    // records that row i is used, the least recently used windows beyond
+    // cache_windows are dropped from the process
+    inline void use(int i) {
+        for (size_t r = 0; r < widths.size(); r++) {
+            size_t first, last;
+            windows(r, i, first, last);
+            for (size_t w = first; w <= last; w++) {
+                auto it = where.find(w);
+                if (it != where.end()) {
+                    lru.splice(lru.begin(), lru, it->second);
+                    continue;
+                }
+                lru.push_front(w);
+                where[w] = lru.begin();
+                if (lru.size() > cache_windows) {
+                    size_t begin = lru.back() * window;
+                    madvise(base + begin, std::min(window, bytes - begin), MADV_DONTNEED);
+                    where.erase(lru.back());
+                    lru.pop_back();
+                }
+            }
+        }
+    }
+
+    // row i of region was written
+    inline void dirty(int region, int i) {
+        size_t begin = offsets[region] + widths[region] * i;
+        for (size_t p = begin / page; p <= (begin + widths[region] - 1) / page; p++) {
+            dirty_pages.insert(p);
+        }
+    }
+
+    // schedules the write back of the dirty rows, or waits for it if sync
+    void flush(bool sync = false) {
+        for (size_t p : dirty_pages) {
+            msync(base + p * page, page, sync ? MS_SYNC : MS_ASYNC);
+        }
+        dirty_pages.clear();
+    }
+
+    void close() {
+        if (base != NULL) {
+            flush(true);
+            munmap(base, bytes);
+            base = NULL;
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+        lru.clear();
+        where.clear();
+        dirty_pages.clear();
+    }
+
+  private:
+    int fd = -1;
+    char *base = NULL;
+    size_t bytes = 0;
+    size_t page = 4096;
+    size_t window = WINDOW;
+    std::vector<size_t> widths;
+    std::vector<size_t> offsets; // of the regions, page aligned
+    // window and page indexes in the file, regions start at page boundaries
+    std::list<size_t> lru;
+    std::unordered_map<size_t, std::list<size_t>::iterator> where;
+    std::unordered_set<size_t> dirty_pages;
+
+    inline void windows(size_t region, int i, size_t &first, size_t &last) const {
+        size_t begin = offsets[region] + widths[region] * i;
+        first = begin / window;
+        last = (begin + widths[region] - 1) / window;
+    }
+};
+
+#endif
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef N3LDG_MEMORY_PLANNER_H
+#define N3LDG_MEMORY_PLANNER_H
+
+/*
+*  MemoryPlanner.h:
+*  reuse node buffers by liveness when a graph is computed for inference
+*  (1) loss is never needed, so its storage is released and never allocated
+*  (2) val is bound to a pooled buffer right before its level is executed,
+*      and goes back to the pool once all of its parents have executed
+*  (3) nodes without parents are the outputs, they keep their buffers until
+*      Graph::clearValue
+*  (4) an elementwise node (see Node::toElementwise) whose input has no
+*      reader left but the node itself takes over the buffer of that input
+*      and writes its val in place, e.g. the PAdd of an LSTM cell
+*  Peak memory becomes proportional to the widest frontier of the schedule
+*  instead of the number of nodes.
+*  Only one compute() per graph is supported, nodes computed incrementally
+*  (e.g. LogSoftMaxBuilder reading val while building) need planning off.
+*/
+
+#include "Node.h"
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#if !USE_GPU
+
+// buffers of the same dim are recycled, memory is freed on destruction only
+class BufferPool {
+  public:
+    ~BufferPool() {
+        for (dtype *p : buffers) {
+            delete[] p;
+        }
+    }
+
+    // the returned buffer is zeroed
+    dtype *acquire(int dim) {
+        dtype *p;
+        std::vector<dtype*> &free_list = free_buffers[dim];
+        if (free_list.empty()) {
+            p = new dtype[dim];
+            buffers.push_back(p);
+            allocated_bytes += dim * sizeof(dtype);
+        } else {
+            p = free_list.back();
+            free_list.pop_back();
+        }
+        memset((void*)p, 0, dim * sizeof(dtype));
+        used_bytes += dim * sizeof(dtype);
+        if (used_bytes > peak_bytes) {
+            peak_bytes = used_bytes;
+        }
+        return p;
+    }
+
+    void release(dtype *p, int dim) {
+        free_buffers[dim].push_back(p);
+        used_bytes -= dim * sizeof(dtype);
+    }
+
+    // bytes held by the pool, i.e. the peak over every graph computed so far
+    size_t allocatedBytes() const {
+        return allocated_bytes;
+    }
+
+    size_t peakBytes() const {
+        return peak_bytes;
+    }
+
+  private:
+    std::unordered_map<int, std::vector<dtype*>> free_buffers;
+    std::vector<dtype*> buffers;
+    size_t allocated_bytes = 0;
+    size_t used_bytes = 0;
+    size_t peak_bytes = 0;
+};
+
+class MemoryPlanner {
+  public:
+    // called once all nodes are added, before the first level executes
+    void plan(const std::vector<PNode> &nodes) {
+        if (planned) {
+            std::cout << "MemoryPlanner: the graph is computed twice, "
+                "incremental compute is not supported with memory planning"
+                << std::endl;
+            abort();
+        }
+        planned = true;
+        for (PNode node : nodes) {
+            if (node->keepsValue()) {
+                continue;
+            }
+            node->loss.release();
+            if (!node->val.isAttached()) {
+                node->val.release();
+            }
+            // parents of a view read the val of node as well
+            std::vector<PNode> readers;
+            collectReaders(node, readers);
+            pending[node] = readers.size();
+            for (PNode reader : readers) {
+                inputs[reader].push_back(node);
+            }
+        }
+    }
+
+    // called for every node of a level before the level executes
+    void bind(PNode node) {
+        if (node->keepsValue() || node->val.v != NULL) {
+            return;
+        }
+        PNode in = handoverInput(node);
+        if (in != NULL) {
+            node->val.attach(in->val.v);
+            handed.insert(in);
+        } else {
+            node->val.attach(pool.acquire(node->dim));
+        }
+        bound.push_back(node);
+    }
+
+    // called for every node of a level after the whole level has executed
+    void finish(PNode node) {
+        auto it = inputs.find(node);
+        if (it == inputs.end()) {
+            return;
+        }
+        for (PNode in : it->second) {
+            int &count = pending[in];
+            --count;
+            if (count == 0 && in->val.isAttached()) {
+                // a buffer handed over belongs to the reader now
+                if (handed.count(in) == 0) {
+                    pool.release(in->val.v, in->dim);
+                }
+                in->val.detach();
+            }
+        }
+    }
+
+    // give back the buffers of the outputs, called by Graph::clearValue
+    void clear() {
+        for (PNode node : bound) {
+            if (node->val.isAttached()) {
+                pool.release(node->val.v, node->dim);
+                node->val.detach();
+            }
+        }
+        bound.clear();
+        handed.clear();
+        inputs.clear();
+        pending.clear();
+        planned = false;
+    }
+
+    const BufferPool &bufferPool() const {
+        return pool;
+    }
+
+  private:
+    // an input of the same dim read by node only, dot products are left out
+    // since their dim differs, and fused roots since they read other inputs
+    PNode handoverInput(PNode node) const {
+        ElementwiseOp op;
+        if (node->fused_group != NULL || !node->toElementwise(op) ||
+                op.kind == ElementwiseOp::DOT) {
+            return NULL;
+        }
+        for (PNode in : op.ins) {
+            auto it = pending.find(in);
+            if (it != pending.end() && it->second == 1 && in->dim == node->dim &&
+                    in->val.isAttached() && handed.count(in) == 0) {
+                return in;
+            }
+        }
+        return NULL;
+    }
+
+    BufferPool pool;
+    std::unordered_map<PNode, std::vector<PNode>> inputs;
+    std::unordered_map<PNode, int> pending;
+    std::vector<PNode> bound;
+    std::unordered_set<PNode> handed;
+    bool planned = false;
+};
+
+#endif
+
+#endif
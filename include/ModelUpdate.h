@@ -126,6 +126,20 @@ class ModelUpdate {
         }
     }
 
+    // read-only inference: every param is immutable until unfreeze(), so one
+    // model can be shared by the graphs of many threads without locks
+    inline void freeze() {
+        for (size_t idx = 0; idx < _params.size(); idx++) {
+            _params[idx]->freeze();
+        }
+    }
+
+    inline void unfreeze() {
+        for (size_t idx = 0; idx < _params.size(); idx++) {
+            _params[idx]->unfreeze();
+        }
+    }
+
     inline void gradClip(dtype maxScale) {
         dtype sumNorm = 0.0;
         for (int idx = 0; idx < _params.size(); idx++) {
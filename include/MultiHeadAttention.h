@@ -0,0 +1,453 @@
+#ifndef N3LDG_MULTI_HEAD_ATTENTION_H
+#define N3LDG_MULTI_HEAD_ATTENTION_H
+
+/*
+*  MultiHeadAttention.h:
+*  multi-head scaled dot-product attention, a node per query
+*  (1) a node attends from its query over its own keys and values, so
+*      sentences of different lengths are batched without padding, and a
+*      query never sees the keys of another node
+*  (2) one execute projects all queries, and every distinct key and value
+*      node once, with stacked GEMMs, queries sharing the same keys and
+*      values are scored together, a block of queries against all keys at a
+*      time so that the scores stay in cache
+*  (3) backward is fused in the same execute and reuses the attention
+*      probabilities kept by forward
+*  Only the CPU version is provided.
+*/
+
+#include "MyLib.h"
+#include "Node.h"
+#include "Param.h"
+#include "Graph.h"
+#include "ModelUpdate.h"
+#include <memory>
+#include <unordered_map>
+#include <utility>
+
+#if !USE_GPU
+
+class MultiHeadAttentionParams {
+  public:
+    Param W_q, W_k, W_v, W_o;
+    int heads;
+    int model_dim;
+
+  public:
+    MultiHeadAttentionParams() {
+        heads = 1;
+        model_dim = 0;
+    }
+
+    inline void exportAdaParams(ModelUpdate& ada) {
+        ada.addParam(&W_q);
+        ada.addParam(&W_k);
+        ada.addParam(&W_v);
+        ada.addParam(&W_o);
+    }
+
+    // nModel is split into nHeads heads, nOSize is the dim of the nodes
+    inline void initial(int nOSize, int nQSize, int nKSize, int nVSize, int nModel, int nHeads) {
+        if (nHeads <= 0 || nModel % nHeads != 0) {
+            std::cout << "model dim " << nModel << " can not be split into " << nHeads << " heads" << std::endl;
+            abort();
+        }
+        W_q.initial(nModel, nQSize);
+        W_k.initial(nModel, nKSize);
+        W_v.initial(nModel, nVSize);
+        W_o.initial(nOSize, nModel);
+        heads = nHeads;
+        model_dim = nModel;
+    }
+
+    inline int headDim() const {
+        return model_dim / heads;
+    }
+
+    inline void save(std::ofstream &os) const {
+        os << heads << " " << model_dim << std::endl;
+        W_q.save(os);
+        W_k.save(os);
+        W_v.save(os);
+        W_o.save(os);
+    }
+
+    inline void load(std::ifstream &is) {
+        is >> heads >> model_dim;
+        W_q.load(is);
+        W_k.load(is);
+        W_v.load(is);
+        W_o.load(is);
+    }
+};
+
+class MultiHeadAttentionNode : public Node {
+  public:
+    PNode query;
+    vector<PNode> keys, values;
+    // of the keys and values, so that the execute groups the nodes that
+    // share them without comparing every list
+    size_t kv_hash;
+    MultiHeadAttentionParams* param;
+
+  public:
+    MultiHeadAttentionNode() : Node() {
+        query = NULL;
+        param = NULL;
+        kv_hash = 0;
+        node_type = "multi_head_attention";
+    }
+
+    inline void setParam(MultiHeadAttentionParams* paramInit) {
+        param = paramInit;
+    }
+
+    inline void clearValue() {
+        Node::clearValue();
+        query = NULL;
+        keys.clear();
+        values.clear();
+    }
+
+  public:
+    void forward(Graph *cg, PNode q, const vector<PNode>& k, const vector<PNode>& v) {
+        if (k.size() == 0 || k.size() != v.size()) {
+            std::cout << "multi head attention needs as many values as keys, and at least one" << std::endl;
+            abort();
+        }
+        if (q->dim != param->W_q.inDim() || k[0]->dim != param->W_k.inDim() ||
+                v[0]->dim != param->W_v.inDim() || dim != param->W_o.outDim()) {
+            std::cout << "input dim does not match for multi head attention" << std::endl;
+            abort();
+        }
+        query = q;
+        keys = k;
+        values = v;
+
+        degree = 0;
+        query->addParent(this);
+        std::hash<PNode> hash;
+        kv_hash = keys.size();
+        for (PNode p : keys) {
+            p->addParent(this);
+            kv_hash = kv_hash * 0x9e3779b97f4a7c15ULL + hash(p);
+        }
+        for (PNode p : values) {
+            p->addParent(this);
+            kv_hash = kv_hash * 0x9e3779b97f4a7c15ULL + hash(p);
+        }
+        cg->addNode(this);
+    }
+
+    // keys are used as values as well
+    void forward(Graph *cg, PNode q, const vector<PNode>& kv) {
+        forward(cg, q, kv, kv);
+    }
+
+  public:
+    // the attention of a node is computed by MultiHeadAttentionExecute only,
+    // which keeps the probabilities needed by backward
+    inline void compute() {
+        std::cout << "MultiHeadAttentionNode is computed by its execute only" << std::endl;
+        abort();
+    }
+
+    inline void backward() {
+        std::cout << "MultiHeadAttentionNode is computed by its execute only" << std::endl;
+        abort();
+    }
+
+    inline PExecute generate(bool bTrain, dtype cur_drop_factor);
+
+    bool typeEqual(PNode other) override {
+        bool result = Node::typeEqual(other);
+        if (!result) return false;
+
+        MultiHeadAttentionNode* conv_other = (MultiHeadAttentionNode*)other;
+        return param == conv_other->param;
+    }
+
+    size_t typeHashCode() const override {
+        return Node::typeHashCode() ^ ::typeHashCode(param);
+    }
+};
+
+// matrices hold a row per query, key or value, heads are blocks of columns
+class MultiHeadAttentionExecute : public Execute {
+  public:
+    MultiHeadAttentionParams* param;
+    Tensor2D q_in, k_in, v_in;
+    Tensor2D q, k, v, o;
+
+    // queries with the same keys and values
+    struct Group {
+        MultiHeadAttentionNode *first; // whose keys and values it has
+        std::vector<int> queries;
+        std::vector<int> keys, values; // rows of k and v
+        Tensor2D q, k, v;
+        Tensor2D probs; // a row per head and query, a col per key
+    };
+    std::vector<std::unique_ptr<Group>> groups;
+    std::vector<PNode> key_nodes, value_nodes;
+
+    // queries scored at a time
+    int block = 64;
+
+    inline void forward() {
+        int count = batch.size();
+        int model = param->model_dim;
+
+        // by kv_hash, the lists are compared only when the hashes match
+        std::unordered_map<size_t, std::vector<Group*>> group_map;
+        std::unordered_map<PNode, int> key_rows, value_rows;
+        for (int idx = 0; idx < count; idx++) {
+            MultiHeadAttentionNode* ptr = (MultiHeadAttentionNode*)batch[idx];
+            std::vector<Group*> &candidates = group_map[ptr->kv_hash];
+            Group *group = NULL;
+            for (Group *g : candidates) {
+                if (g->first->keys == ptr->keys && g->first->values == ptr->values) {
+                    group = g;
+                    break;
+                }
+            }
+            if (group == NULL) {
+                groups.push_back(std::unique_ptr<Group>(new Group));
+                group = groups.back().get();
+                group->first = ptr;
+                candidates.push_back(group);
+                for (PNode p : ptr->keys) {
+                    group->keys.push_back(rowOf(p, key_rows, key_nodes));
+                }
+                for (PNode p : ptr->values) {
+                    group->values.push_back(rowOf(p, value_rows, value_nodes));
+                }
+            }
+            group->queries.push_back(idx);
+        }
+
+        vector<PNode> queries(count);
+        for (int idx = 0; idx < count; idx++) {
+            queries[idx] = ((MultiHeadAttentionNode*)batch[idx])->query;
+        }
+        project(queries, param->W_q, q_in, q);
+        project(key_nodes, param->W_k, k_in, k);
+        project(value_nodes, param->W_v, v_in, v);
+
+        o.init(count, model);
+        for (auto &group : groups) {
+            attend(*group);
+        }
+
+        Tensor2D y;
+        y.init(count, param->W_o.outDim());
+        y.mat() = o.mat() * param->W_o.val.mat().transpose();
+        for (int idx = 0; idx < count; idx++) {
+            memcpy(batch[idx]->val.v, y[idx], y.col * sizeof(dtype));
+            batch[idx]->forward_drop(bTrain, drop_factor);
+        }
+    }
+
+    inline void backward() {
+        int count = batch.size();
+        int model = param->model_dim;
+
+        Tensor2D ly, lo;
+        ly.init(count, param->W_o.outDim());
+        for (int idx = 0; idx < count; idx++) {
+            batch[idx]->backward_drop();
+            memcpy(ly[idx], batch[idx]->loss.v, ly.col * sizeof(dtype));
+        }
+        param->W_o.grad.mat() += ly.mat().transpose() * o.mat();
+        lo.init(count, model);
+        lo.mat() = ly.mat() * param->W_o.val.mat();
+
+        Tensor2D lq, lk, lv;
+        lq.init(count, model);
+        lk.init(key_nodes.size(), model);
+        lv.init(value_nodes.size(), model);
+        for (auto &group : groups) {
+            attendBackward(*group, lo, lq, lk, lv);
+        }
+
+        vector<PNode> queries(count);
+        for (int idx = 0; idx < count; idx++) {
+            queries[idx] = ((MultiHeadAttentionNode*)batch[idx])->query;
+        }
+        projectBackward(queries, param->W_q, q_in, lq);
+        projectBackward(key_nodes, param->W_k, k_in, lk);
+        projectBackward(value_nodes, param->W_v, v_in, lv);
+    }
+
+  private:
+    static int rowOf(PNode p, std::unordered_map<PNode, int> &rows, std::vector<PNode> &nodes) {
+        auto it = rows.find(p);
+        if (it != rows.end()) {
+            return it->second;
+        }
+        rows.insert(std::make_pair(p, (int)nodes.size()));
+        nodes.push_back(p);
+        return nodes.size() - 1;
+    }
+
+    static void gather(const Tensor2D &from, const std::vector<int> &rows, Tensor2D &to) {
+        to.init(rows.size(), from.col);
+        for (size_t i = 0; i < rows.size(); i++) {
+            memcpy(to[i], from[rows[i]], from.col * sizeof(dtype));
+        }
+    }
+
+    static void project(const vector<PNode> &nodes, Param &W, Tensor2D &x, Tensor2D &y) {
+        int count = nodes.size();
+        x.init(count, W.inDim());
+        for (int idx = 0; idx < count; idx++) {
+            memcpy(x[idx], nodes[idx]->val.v, x.col * sizeof(dtype));
+        }
+        y.init(count, W.outDim());
+        y.mat() = x.mat() * W.val.mat().transpose();
+    }
+
+    static void projectBackward(const vector<PNode> &nodes, Param &W, const Tensor2D &x, const Tensor2D &ly) {
+        W.grad.mat() += ly.mat().transpose() * x.mat();
+        Tensor2D lx;
+        lx.init(x.row, x.col);
+        lx.mat() = ly.mat() * W.val.mat();
+        for (size_t idx = 0; idx < nodes.size(); idx++) {
+            nodes[idx]->loss.tmat() += Mat(lx[idx], 1, lx.col);
+        }
+    }
+
+    void attend(Group &g) {
+        int nq = g.queries.size(), n = g.keys.size();
+        int model = param->model_dim, head_dim = param->headDim();
+        dtype scale = 1.0 / sqrt((dtype)head_dim);
+        gather(q, g.queries, g.q);
+        gather(k, g.keys, g.k);
+        gather(v, g.values, g.v);
+        g.probs.init(param->heads * nq, n);
+
+        Tensor2D out;
+        out.init(nq, model);
+        for (int h = 0; h < param->heads; h++) {
+            int col = h * head_dim;
+            for (int r = 0; r < nq; r += block) {
+                int rows = std::min(block, nq - r);
+                Mat p(g.probs[h * nq + r], rows, n);
+                p.noalias() = scale * Mat(g.q[r], rows, model).middleCols(col, head_dim) *
+                    Mat(g.k.v, n, model).middleCols(col, head_dim).transpose();
+                // max subtracted softmax over the keys of each query
+                Matrix<dtype, Dynamic, 1> max_scores = p.rowwise().maxCoeff();
+                p.colwise() -= max_scores;
+                p = p.array().exp().matrix();
+                Matrix<dtype, Dynamic, 1> sums = p.rowwise().sum();
+                p.array().colwise() /= sums.array();
+                Mat(out[r], rows, model).middleCols(col, head_dim).noalias() =
+                    p * Mat(g.v.v, n, model).middleCols(col, head_dim);
+            }
+        }
+        for (int i = 0; i < nq; i++) {
+            memcpy(o[g.queries[i]], out[i], model * sizeof(dtype));
+        }
+    }
+
+    void attendBackward(Group &g, const Tensor2D &lo, Tensor2D &lq, Tensor2D &lk, Tensor2D &lv) {
+        int nq = g.queries.size(), n = g.keys.size();
+        int model = param->model_dim, head_dim = param->headDim();
+        dtype scale = 1.0 / sqrt((dtype)head_dim);
+        Tensor2D glo, glq, glk, glv, dp;
+        gather(lo, g.queries, glo);
+        glq.init(nq, model);
+        glk.init(n, model);
+        glv.init(n, model);
+        dp.init(std::min(block, nq), n);
+
+        for (int h = 0; h < param->heads; h++) {
+            int col = h * head_dim;
+            for (int r = 0; r < nq; r += block) {
+                int rows = std::min(block, nq - r);
+                Mat p(g.probs[h * nq + r], rows, n);
+                Mat ls(dp.v, rows, n);
+                ls.noalias() = Mat(glo[r], rows, model).middleCols(col, head_dim) *
+                    Mat(g.v.v, n, model).middleCols(col, head_dim).transpose();
+                Mat(glv.v, n, model).middleCols(col, head_dim).noalias() +=
+                    p.transpose() * Mat(glo[r], rows, model).middleCols(col, head_dim);
+                // softmax backward, p * (lp - sum(p * lp)) for each query
+                Matrix<dtype, Dynamic, 1> weighted = p.cwiseProduct(ls).rowwise().sum();
+                ls.colwise() -= weighted;
+                ls = scale * ls.cwiseProduct(p);
+                Mat(glq[r], rows, model).middleCols(col, head_dim).noalias() =
+                    ls * Mat(g.k.v, n, model).middleCols(col, head_dim);
+                Mat(glk.v, n, model).middleCols(col, head_dim).noalias() +=
+                    ls.transpose() * Mat(g.q[r], rows, model).middleCols(col, head_dim);
+            }
+        }
+
+        for (int i = 0; i < nq; i++) {
+            Mat(lq[g.queries[i]], 1, model) += Mat(glq[i], 1, model);
+        }
+        for (int j = 0; j < n; j++) {
+            Mat(lk[g.keys[j]], 1, model) += Mat(glk[j], 1, model);
+            Mat(lv[g.values[j]], 1, model) += Mat(glv[j], 1, model);
+        }
+    }
+};
+
+inline PExecute MultiHeadAttentionNode::generate(bool bTrain, dtype cur_drop_factor) {
+    MultiHeadAttentionExecute* exec = new MultiHeadAttentionExecute();
+    exec->batch.push_back(this);
+    exec->bTrain = bTrain;
+    exec->drop_factor = cur_drop_factor;
+    exec->param = param;
+    return exec;
+}
+
+// every position attends over the whole sentence
+class MultiHeadSelfAttentionBuilder {
+  public:
+    int _nSize;
+    int _outDim;
+    dtype _dropout;
+
+    vector<MultiHeadAttentionNode*> _hiddens;
+
+    MultiHeadAttentionParams* _param;
+
+  public:
+    MultiHeadSelfAttentionBuilder() {
+        clear();
+    }
+
+    ~MultiHeadSelfAttentionBuilder() {
+        clear();
+    }
+
+  public:
+    inline void clear() {
+        _hiddens.clear();
+    }
+
+  public:
+    inline void init(MultiHeadAttentionParams* paramInit, dtype dropout = -1) {
+        _param = paramInit;
+        _outDim = _param->W_o.outDim();
+        _dropout = dropout;
+    }
+
+  public:
+    inline void forward(Graph *cg, const vector<PNode>& x) {
+        if (x.size() == 0) {
+            std::cout << "empty inputs for multi head attention operation" << std::endl;
+            return;
+        }
+        _nSize = x.size();
+        _hiddens.resize(_nSize);
+        for (int idx = 0; idx < _nSize; idx++) {
+            _hiddens[idx] = cg->newNode<MultiHeadAttentionNode>(_outDim, _dropout);
+            _hiddens[idx]->setParam(_param);
+            _hiddens[idx]->forward(cg, x[idx], x);
+        }
+    }
+};
+
+#endif
+
+#endif
@@ -13,6 +13,7 @@
 #include <ctime>
 #include <cfloat>
 #include <cstring>
+#include <cstdint>
 #include <sstream>
 #include <unordered_map>
 #include <unordered_set>
@@ -28,6 +29,15 @@ using namespace Eigen;
 
 typedef long long blong;
 
+// marks an API kept for old callers, the compiler warns where it is used
+#if defined(__GNUC__)
+#define N3LDG_DEPRECATED __attribute__((deprecated))
+#elif defined(_MSC_VER)
+#define N3LDG_DEPRECATED __declspec(deprecated)
+#else
+#define N3LDG_DEPRECATED
+#endif
+
 const static dtype minlogvalue = -1000;
 const static dtype d_zero = 0.0;
 const static dtype d_one = 1.0;
@@ -182,6 +192,30 @@ inline int mod(int v1, int v2) {
     }
 }
 
+// 64 bit hash of len chars, by 8 bytes as strings are mostly short
+// features, used by frozen alphabets and hashed features, so it must not
+// change, the value depends on the byte order of the machine
+inline uint64_t hash_string(const char* str, size_t len) {
+    const uint64_t K = 0x9e3779b97f4a7c15ULL;
+    uint64_t h = len * K, w;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&w, str + i, 8);
+        h = (h ^ w) * K;
+        h ^= h >> 29;
+    }
+    w = 0;
+    memcpy(&w, str + i, len - i);
+    h = (h ^ w) * K;
+    h ^= h >> 32;
+    h *= K;
+    return h ^ (h >> 29);
+}
+
+inline uint64_t hash_string(const string& str) {
+    return hash_string(str.data(), str.size());
+}
+
 inline void ones(dtype* p, int length) {
     for (int idx = 0; idx < length; idx++) {
         p[idx] = 1.0;
@@ -356,6 +390,23 @@ inline void str2int_vec(const vector<string> &vecStr, vector<int> &vecInt) {
     }
 }
 
+// converts strings to ids once, at any depth of nesting (e.g. the words of
+// the sentences of a corpus), idOf is e.g. a lambda calling
+// LookupTable::getElemId or SparseParams::getFeatureId, so that the graphs
+// of every epoch are built by the forward overloads taking ids
+template<typename IdOf>
+inline void str2id(const string &str, int &id, IdOf idOf) {
+    id = idOf(str);
+}
+
+template<typename Strings, typename Ids, typename IdOf>
+inline void str2id(const vector<Strings> &strs, vector<Ids> &ids, IdOf idOf) {
+    ids.resize(strs.size());
+    for (size_t i = 0; i < strs.size(); i++) {
+        str2id(strs[i], ids[i], idOf);
+    }
+}
+
 template<typename A>
 inline string obj2string(const A& a) {
     ostringstream out;
@@ -14,22 +14,20 @@ namespace n3ldg_cpu {
 struct Tensor1D {
   private:
     size_t memsize;
+    bool attached;
   public:
     dtype *v;
     int dim;
 
     Tensor1D() {
         memsize = 0;
+        attached = false;
         dim = 0;
         v = NULL;
     }
 
     ~Tensor1D() {
-        if (v) {
-            delete[] v;
-        }
-        v = NULL;
-        memsize = 0;
+        release();
         dim = 0;
     }
 
@@ -38,10 +36,42 @@ struct Tensor1D {
     inline void init(int ndim) {
         dim = ndim;
         v = new dtype[dim];
+        attached = false;
         memsize = dim * sizeof(dtype);
         zero();
     }
 
+    // use a buffer owned by someone else (e.g. a BufferPool), dim is kept
+    // the buffer must hold at least dim elements and is never freed here
+    inline void attach(dtype *buffer) {
+        release();
+        v = buffer;
+        attached = true;
+        memsize = dim * sizeof(dtype);
+    }
+
+    inline void detach() {
+        if (attached) {
+            v = NULL;
+            attached = false;
+            memsize = 0;
+        }
+    }
+
+    // free the memory (if owned) but keep dim, init(dim) allocates it again
+    inline void release() {
+        if (v && !attached) {
+            delete[] v;
+        }
+        v = NULL;
+        attached = false;
+        memsize = 0;
+    }
+
+    inline bool isAttached() const {
+        return attached;
+    }
+
     inline void zero() {
         if(v)memset((void*)v, 0, memsize);;
     }
@@ -81,6 +111,7 @@ struct Tensor1D {
     }
 
     inline Tensor1D& operator=(const dtype &a) { // assign a to every element
+        if (!v) return *this; // released by a MemoryPlanner
         for (int i = 0; i < dim; i++)
             v[i] = a;
         return *this;
@@ -135,23 +166,21 @@ struct Tensor1D {
 struct Tensor2D {
   private:
     size_t memsize;
+    bool attached;
   public:
     dtype *v;
     int col, row, size;
 
     Tensor2D() {
         memsize = 0;
+        attached = false;
         col = row = 0;
         size = 0;
         v = NULL;
     }
 
     ~Tensor2D() {
-        if (v) {
-            delete[] v;
-        }
-        v = NULL;
-        memsize = 0;
+        release();
         col = row = 0;
         size = 0;
     }
@@ -163,6 +192,7 @@ struct Tensor2D {
         col = ncol;
         size = col * row;
         v = new dtype[size];
+        attached = false;
         memsize = size * sizeof(dtype);
         zero();
     }
@@ -171,6 +201,29 @@ struct Tensor2D {
         if(v)memset((void*)v, 0, memsize);
     }
 
+    // only the shape of rows stored elsewhere (e.g. by a MappedTable), no
+    // element is held, so size is 0 and operator[] must not be used
+    inline void setShape(int nrow, int ncol) {
+        release();
+        row = nrow;
+        col = ncol;
+        size = 0;
+    }
+
+    // frees the storage (if owned) but keeps the shape, e.g. of a quantized param
+    inline void release() {
+        if (v && !attached) {
+            delete[] v;
+        }
+        v = NULL;
+        attached = false;
+        memsize = 0;
+    }
+
+    inline bool isAttached() const {
+        return attached;
+    }
+
     const Mat mat() const {
         return Mat(v, row, col);
     }
@@ -191,12 +244,12 @@ struct Tensor2D {
     //use it carefully, first col, then row, because rows are allocated successively
     inline dtype* operator[](const int irow) {
         assert(irow < row);
-        return &(v[irow*col]);  // no boundary check?
+        return &(v[(size_t)irow*col]);  // no boundary check?
     }
 
     inline const dtype* operator[](const int irow) const {
         assert(irow < row);
-        return &(v[irow*col]);  // no boundary check?
+        return &(v[(size_t)irow*col]);  // no boundary check?
     }
 
     //use it carefully
@@ -21,6 +21,7 @@
 #include "Concat.h"
 #include "Windowlized.h"
 #include "UniOP.h"
+#include "Conv1D.h"
 #include "BiOP.h"
 #include "TriOP.h"
 #include "FourOP.h"
@@ -30,9 +31,11 @@
 #include "TransferOP.h"
 #include "AttentionHelp.h"
 #include "Attention.h"
+#include "MultiHeadAttention.h"
 #include "APOP.h"
 #include "SparseOP.h"
 #include "ActionOP.h"
 #include "LogSoftMax.h"
+#include "StatePool.h"
 
 #endif
@@ -26,6 +26,20 @@ using n3ldg_cpu::Tensor2D;
 #endif
 
 class Execute;
+class Node;
+
+#if !USE_GPU
+class FusedGroup;
+
+// what an elementwise node computes, read by the fusion pass of Fusion.h
+struct ElementwiseOp {
+    enum Kind { ADD, SUB, MULTI, DOT, ACTIVATE };
+    Kind kind;
+    std::vector<Node*> ins;
+    dtype(*activate)(const dtype&);
+    dtype(*derivate)(const dtype&, const dtype&);
+};
+#endif
 
 #if USE_GPU
 struct NodeInfo {
@@ -198,6 +212,14 @@ class Node {
     Tensor1D drop_mask;
     dtype drop_value;
 
+    // see Checkpoint.h, 0 means the node is in no segment
+    int segment;
+    bool reuse_drop_mask;
+#if !USE_GPU
+    // see Fusion.h, set for the roots of fused groups only
+    FusedGroup *fused_group;
+#endif
+
   public:
     Node() {
         dim = 0;
@@ -205,6 +227,11 @@ class Node {
         parents.clear();
         node_type = "interface";
         drop_value = -1;
+        segment = 0;
+        reuse_drop_mask = false;
+#if !USE_GPU
+        fused_group = NULL;
+#endif
     }
 
     virtual ~Node() = default;
@@ -229,12 +256,16 @@ class Node {
         n3ldg_cuda::Memset(val.value, dim, 0.0f);
         n3ldg_cuda::Memset(loss.value, dim, 0.0f);
 #endif
+        setDropValue(dropout);
+        parents.clear();
+    }
+
+    inline void setDropValue(dtype dropout) {
         if (dropout > 0 && dropout <= 1) {
             drop_value = dropout;
         } else {
             drop_value = -1;
         }
-        parents.clear();
     }
 
     virtual void generate_dropmask(dtype drop_factor) {
@@ -253,7 +284,9 @@ class Node {
         if (drop_value > 0) {
             if (bTrain) {
 #if !TEST_CUDA
-                generate_dropmask(drop_factor);
+                if (!reuse_drop_mask) {
+                    generate_dropmask(drop_factor);
+                }
 #endif
             } else {
                 drop_mask = 1 - drop_value * drop_factor;
@@ -295,6 +328,38 @@ class Node {
             (std::hash<int>{}((int)(10000 * drop_value)) << 1);
     }
 
+    // nodes whose val is filled in when the graph is built (e.g. BucketNode)
+    // keep their own storage when a MemoryPlanner is active
+    virtual bool keepsValue() const {
+        return false;
+    }
+
+    // a node standing for the concatenation of other nodes (e.g. WindowNode)
+    // returns them, executes of readsViews() nodes read and write them
+    // in place with gatherVal/scatterLoss instead of the val of the view
+    virtual const vector<Node*> *viewOf() const {
+        return NULL;
+    }
+
+    virtual bool readsViews() const {
+        return false;
+    }
+
+#if !USE_GPU
+    // elementwise nodes fill op and return true, see Fusion.h
+    virtual bool toElementwise(ElementwiseOp &) const {
+        return false;
+    }
+#endif
+
+#if !USE_GPU
+    // allocate own storage again for buffers released by a MemoryPlanner
+    inline void ensureStorage() {
+        if (val.v == NULL) val.init(dim);
+        if (loss.v == NULL) loss.init(dim);
+    }
+#endif
+
   public:
     virtual inline void addParent(Node* parent) {
         if (degree >= 0) {
@@ -313,6 +378,50 @@ class Node {
 
 typedef  Node* PNode;
 
+#if !USE_GPU
+// copies the val of in (or of the nodes it is a view of) to dst[i * stride]
+inline void gatherVal(PNode in, dtype *dst, int stride = 1) {
+    const vector<PNode> *pieces = in->viewOf();
+    if (pieces != NULL) {
+        for (PNode piece : *pieces) {
+            gatherVal(piece, dst, stride);
+            dst += piece->dim * stride;
+        }
+    } else if (stride == 1) {
+        memcpy(dst, in->val.v, in->dim * sizeof(dtype));
+    } else {
+        for (int idx = 0; idx < in->dim; idx++) {
+            dst[idx * stride] = in->val.v[idx];
+        }
+    }
+}
+
+// adds src[i * stride] to the loss of in (or of the nodes it is a view of)
+inline void scatterLoss(PNode in, const dtype *src, int stride = 1) {
+    const vector<PNode> *pieces = in->viewOf();
+    if (pieces != NULL) {
+        for (PNode piece : *pieces) {
+            scatterLoss(piece, src, stride);
+            src += piece->dim * stride;
+        }
+    } else {
+        for (int idx = 0; idx < in->dim; idx++) {
+            in->loss.v[idx] += src[idx * stride];
+        }
+    }
+}
+
+// nodes reading the val of node, through views as well
+inline void collectReaders(PNode node, vector<PNode> &readers) {
+    for (PNode parent : node->parents) {
+        readers.push_back(parent);
+        if (parent->viewOf() != NULL) {
+            collectReaders(parent, readers);
+        }
+    }
+}
+#endif
+
 
 #if USE_GPU
 void clearNodes(std::vector<Node*> &nodes, int dim) {
@@ -367,6 +476,12 @@ public:
         return drop_factor * batch.at(0)->drop_value;
     }
 
+    // estimated forward flops, for statistics (see GraphStats.h), one per
+    // output value unless the op models its own
+    virtual double flops() const {
+        return (double)batch.size() * batch.at(0)->dim;
+    }
+
     dtype initialDropValue() const {
         return batch.at(0)->drop_value;
     }
@@ -380,6 +495,13 @@ public:
         }
     }
 #endif
+
+protected:
+    // flops of the products of every node of the batch by weights of
+    // inDim x outDim, for the ops that override flops
+    double weightFlops(int inDim, int outDim) const {
+        return 2.0 * batch.size() * inDim * outDim;
+    }
 };
 
 typedef  Execute* PExecute;
@@ -0,0 +1,67 @@
+#ifndef N3LDG_NODE_POOL_H
+#define N3LDG_NODE_POOL_H
+
+/*
+*  NodePool.h:
+*  nodes of builders are taken from the graph on demand
+*  (1) nodes are kept by type and dim, a node is created and inited the first
+*      time only, later acquires get a node given back before
+*  (2) every node handed out goes back to the pool in Graph::clearValue, so
+*      builders must not keep using them after the graph is cleared
+*  (3) memory grows with the longest input seen by the graph instead of a
+*      maxsize preallocated by every builder
+*  A pool belongs to one graph and is not thread safe, use a graph per thread.
+*/
+
+#include "Node.h"
+#include <map>
+#include <memory>
+#include <typeindex>
+#include <utility>
+#include <vector>
+
+class NodePool {
+  public:
+    // the node is inited with dim and dropout, but params and functions of
+    // its last user are left as they were, set them again
+    template<typename T>
+    T *acquire(int dim, dtype dropout) {
+        std::vector<PNode> &free_list =
+            free_nodes[std::make_pair(std::type_index(typeid(T)), dim)];
+        T *node;
+        if (free_list.empty()) {
+            node = new T;
+            node->init(dim, dropout);
+            owned.push_back(std::unique_ptr<Node>(node));
+        } else {
+            node = static_cast<T*>(free_list.back());
+            free_list.pop_back();
+            node->setDropValue(dropout);
+        }
+        used.push_back(std::make_pair(&free_list, (PNode)node));
+        return node;
+    }
+
+    // nodes must be cleared already, called by Graph::clearValue
+    void recycle() {
+        for (auto &it : used) {
+            it.first->push_back(it.second);
+        }
+        used.clear();
+    }
+
+    // nodes created so far
+    int size() const {
+        return owned.size();
+    }
+
+  private:
+    typedef std::pair<std::type_index, int> Key;
+
+    // the vectors of a std::map stay where they are when keys are inserted
+    std::map<Key, std::vector<PNode>> free_nodes;
+    std::vector<std::pair<std::vector<PNode>*, PNode>> used;
+    std::vector<std::unique_ptr<Node>> owned;
+};
+
+#endif
@@ -277,6 +277,14 @@ public:
         }
     }
 
+#if !USE_GPU
+    bool toElementwise(ElementwiseOp &op) const override {
+        op.kind = ElementwiseOp::ADD;
+        op.ins = ins;
+        return true;
+    }
+#endif
+
 
 public:
     inline PExecute generate(bool bTrain, dtype cur_drop_factor);
@@ -298,6 +306,9 @@ public:
 
 class PAddExecute : public Execute {
 public:
+#if !USE_GPU
+    static const int BLOCK = 512;
+#endif
     int in_count;
     int dim;
     Tensor2D drop_mask;
@@ -352,11 +363,45 @@ public:
 #endif
     }
 #else
+    // the inputs of the batch make a pointer table of count rows by in_count,
+    // each output is accumulated a block at a time, so that the block stays
+    // in cache while the inputs stream by
     void  forward() {
         int count = batch.size();
-        //#pragma omp parallel for
+        std::vector<const dtype*> in_vals(count * in_count);
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->compute();
+            PAddNode *ptr = static_cast<PAddNode*>(batch[idx]);
+            for (int i = 0; i < in_count; i++) {
+                in_vals[idx * in_count + i] = ptr->ins[i]->val.v;
+            }
+        }
+
+        for (int idx = 0; idx < count; idx++) {
+            dtype *y = batch[idx]->val.v;
+            const dtype **x = in_vals.data() + idx * in_count;
+            // the buffer of an input may be handed over to the output by
+            // MemoryPlanner, then it holds that input already
+            int first = 0;
+            for (int i = 0; i < in_count; i++) {
+                if (x[i] == y) {
+                    first = i;
+                }
+            }
+            for (int begin = 0; begin < dim; begin += BLOCK) {
+                int end = std::min(dim, begin + BLOCK);
+                if (x[first] != y) {
+                    memcpy(y + begin, x[first] + begin, (end - begin) * sizeof(dtype));
+                }
+                for (int i = 0; i < in_count; i++) {
+                    if (i == first) {
+                        continue;
+                    }
+                    const dtype *xi = x[i];
+                    for (int j = begin; j < end; j++) {
+                        y[j] += xi[j];
+                    }
+                }
+            }
             batch[idx]->forward_drop(bTrain, drop_factor);
         }
     }
@@ -401,10 +446,16 @@ public:
 #else
     void backward() {
         int count = batch.size();
-        //#pragma omp parallel for
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->backward_drop();
-            batch[idx]->backward();
+            PAddNode *ptr = static_cast<PAddNode*>(batch[idx]);
+            ptr->backward_drop();
+            const dtype *ly = ptr->loss.v;
+            for (int i = 0; i < in_count; i++) {
+                dtype *lx = ptr->ins[i]->loss.v;
+                for (int j = 0; j < dim; j++) {
+                    lx[j] += ly[j];
+                }
+            }
         }
     }
 #endif
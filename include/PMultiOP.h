@@ -50,6 +50,14 @@ class PMultiNode : public Node {
         in2->loss.vec() += loss.vec() * in1->val.vec();
     }
 
+#if !USE_GPU
+    bool toElementwise(ElementwiseOp &op) const override {
+        op.kind = ElementwiseOp::MULTI;
+        op.ins = {in1, in2};
+        return true;
+    }
+#endif
+
   public:
     // better to rewrite for deep understanding
     inline bool typeEqual(PNode other) {
@@ -67,8 +75,6 @@ public:
     std::vector<dtype*> vals;
     int dim;
 public:
-    Tensor1D y, x1, x2;
-    int sumDim;
     bool bTrain;
 
 public:
@@ -102,34 +108,17 @@ public:
 #endif
     }
 #else
+    // reads the inputs and writes the outputs in place, nothing is packed
     void  forward() {
         int count = batch.size();
-        //#pragma omp parallel for
-        sumDim = 0;
-        for (int idx = 0; idx < count; idx++) {
-            sumDim += batch[idx]->dim;
-        }
-        y.init(sumDim);
-        x1.init(sumDim);
-        x2.init(sumDim);
-        int offset = 0;
-        for (int idx = 0; idx < count; idx++) {
-            PMultiNode* ptr = (PMultiNode*)batch[idx];
-            for (int idy = 0; idy < ptr->dim; idy++) {
-                x1[offset + idy] = ptr->in1->val[idy];
-                x2[offset + idy] = ptr->in2->val[idy];
-            }
-            offset += ptr->dim;
-        }
-        y.vec() = x1.vec() * x2.vec();
-
-        offset = 0;
         for (int idx = 0; idx < count; idx++) {
             PMultiNode* ptr = (PMultiNode*)batch[idx];
+            const dtype *x1 = ptr->in1->val.v;
+            const dtype *x2 = ptr->in2->val.v;
+            dtype *y = ptr->val.v;
             for (int idy = 0; idy < ptr->dim; idy++) {
-                ptr->val[idy] = y[offset + idy];
+                y[idy] = x1[idy] * x2[idy];
             }
-            offset += ptr->dim;
             ptr->forward_drop(bTrain,1);
         }
     }
@@ -171,30 +160,20 @@ public:
 #else
     void backward() {
         int count = batch.size();
-        //#pragma omp parallel for
-        Tensor1D ly, lx1, lx2;
-        ly.init(sumDim);
-        lx1.init(sumDim);
-        lx2.init(sumDim);
-        int offset = 0;
         for (int idx = 0; idx < count; idx++) {
             PMultiNode* ptr = (PMultiNode*)batch[idx];
             ptr->backward_drop();
+            const dtype *ly = ptr->loss.v;
+            const dtype *x1 = ptr->in1->val.v;
+            const dtype *x2 = ptr->in2->val.v;
+            dtype *lx1 = ptr->in1->loss.v;
+            dtype *lx2 = ptr->in2->loss.v;
             for (int idy = 0; idy < ptr->dim; idy++) {
-                ly[offset + idy] = ptr->loss[idy];
+                lx1[idy] += ly[idy] * x2[idy];
             }
-            offset += ptr->dim;
-        }
-        lx1.vec() = ly.vec() * x2.vec();
-        lx2.vec() = ly.vec() * x1.vec();
-        offset = 0;
-        for (int idx = 0; idx < count; idx++) {
-            PMultiNode* ptr = (PMultiNode*)batch[idx];
             for (int idy = 0; idy < ptr->dim; idy++) {
-                ptr->in1->loss[idy] += lx1[offset + idy];
-                ptr->in2->loss[idy] += lx2[offset + idy];
+                lx2[idy] += ly[idy] * x1[idy];
             }
-            offset += ptr->dim;
         }
     }
 #endif
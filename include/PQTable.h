@@ -0,0 +1,214 @@
+#ifndef N3LDG_PQTABLE_H
+#define N3LDG_PQTABLE_H
+
+/*
+*  PQTable.h:
+*  product quantized copy of an embedding table for inference, see
+*  LookupTable::compress and tools/pq_embedding.cpp
+*  (1) a row of dim values is split into subspaces of dim / subspaces
+*      values, each subspace has a codebook of up to 256 centroids learned
+*      by k-means, a row keeps one uint8 code per subspace
+*  (2) rows are decoded by copying the centroids of their codes, the
+*      codebooks take 256 x dim values whatever the number of rows
+*  (3) with 4 byte values, a row takes 4 x dim / subspaces times less,
+*      e.g. dim 300 with 50 subspaces is 24 times smaller
+*/
+
+#include "MyTensor.h"
+#include <vector>
+#include <random>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#if !USE_GPU
+
+class PQTable {
+  public:
+    static const int CENTROIDS = 256;
+
+    int row = 0;
+    int col = 0;
+    int subspaces = 0;
+    int sub_dim = 0;
+    int centroids = 0; // per subspace, min(256, row)
+
+    // learns the codebooks from at most sample rows of the row major matrix
+    // m of row x col by k-means, then encodes all rows
+    void train(const dtype *m, int nRow, int nCol, int nSubspaces, int iterations = 16,
+            int sample = 65536) {
+        if (nSubspaces <= 0 || nCol % nSubspaces != 0) {
+            std::cout << "PQTable: dim " << nCol << " is not a multiple of subspaces " <<
+                nSubspaces << std::endl;
+            abort();
+        }
+        row = nRow;
+        col = nCol;
+        subspaces = nSubspaces;
+        sub_dim = col / subspaces;
+        centroids = std::min(CENTROIDS, row);
+        codebook.assign(subspaces * centroids * sub_dim, 0);
+        codes.assign((size_t)row * subspaces, 0);
+
+        std::mt19937 rng(0);
+        std::vector<int> picked(row);
+        for (int i = 0; i < row; i++) {
+            picked[i] = i;
+        }
+        std::shuffle(picked.begin(), picked.end(), rng);
+        picked.resize(std::min(row, std::max(sample, centroids)));
+
+        for (int s = 0; s < subspaces; s++) {
+            kmeans(m, s, picked, iterations, rng);
+        }
+#pragma omp parallel for schedule(static)
+        for (int i = 0; i < row; i++) {
+            for (int s = 0; s < subspaces; s++) {
+                codes[(size_t)i * subspaces + s] = nearest(m + (size_t)i * col + s * sub_dim, s);
+            }
+        }
+    }
+
+    inline bool empty() const {
+        return codes.empty();
+    }
+
+    inline void clear() {
+        std::vector<dtype>().swap(codebook);
+        std::vector<uint8_t>().swap(codes);
+        row = col = subspaces = sub_dim = centroids = 0;
+    }
+
+    inline size_t bytes() const {
+        return codebook.size() * sizeof(dtype) + codes.size() * sizeof(uint8_t);
+    }
+
+    inline const uint8_t *code(int i) const {
+        return codes.data() + (size_t)i * subspaces;
+    }
+
+    // out = the first n values of row i
+    inline void decode(int i, dtype *out, int n) const {
+        const uint8_t *c = code(i);
+        const dtype *book = codebook.data();
+        int full = std::min(subspaces, n / sub_dim);
+        int step = centroids * sub_dim;
+        // short copies are plain loops, memcpy calls would cost more
+        for (int s = 0; s < full; s++) {
+            const dtype *centroid = book + s * step + c[s] * sub_dim;
+            dtype *o = out + s * sub_dim;
+            for (int j = 0; j < sub_dim; j++) {
+                o[j] = centroid[j];
+            }
+        }
+        if (full < subspaces && full * sub_dim < n) {
+            const dtype *centroid = book + full * step + c[full] * sub_dim;
+            for (int j = full * sub_dim; j < n; j++) {
+                out[j] = centroid[j - full * sub_dim];
+            }
+        }
+    }
+
+    inline void save(std::ofstream &os) const {
+        os << row << " " << col << " " << subspaces << " " << centroids << std::endl;
+        for (size_t k = 0; k < codebook.size(); k++) {
+            os << (k == 0 ? "" : " ") << codebook[k];
+        }
+        os << std::endl;
+        for (int i = 0; i < row; i++) {
+            for (int s = 0; s < subspaces; s++) {
+                os << (s == 0 ? "" : " ") << (int)codes[(size_t)i * subspaces + s];
+            }
+            os << std::endl;
+        }
+    }
+
+    inline void load(std::ifstream &is) {
+        is >> row >> col >> subspaces >> centroids;
+        sub_dim = subspaces > 0 ? col / subspaces : 0;
+        codebook.resize(subspaces * centroids * sub_dim);
+        for (size_t k = 0; k < codebook.size(); k++) {
+            is >> codebook[k];
+        }
+        codes.resize((size_t)row * subspaces);
+        for (size_t k = 0; k < codes.size(); k++) {
+            int c;
+            is >> c;
+            codes[k] = c;
+        }
+    }
+
+  private:
+    std::vector<dtype> codebook; // subspace major, centroids x sub_dim each
+    std::vector<uint8_t> codes; // row major, row x subspaces
+
+    inline dtype distance(const dtype *x, const dtype *c) const {
+        dtype d = 0;
+        for (int j = 0; j < sub_dim; j++) {
+            dtype diff = x[j] - c[j];
+            d += diff * diff;
+        }
+        return d;
+    }
+
+    inline int nearest(const dtype *x, int s) const {
+        const dtype *c = codebook.data() + s * centroids * sub_dim;
+        int best = 0;
+        dtype best_d = std::numeric_limits<dtype>::max();
+        for (int k = 0; k < centroids; k++) {
+            dtype d = distance(x, c + k * sub_dim);
+            if (d < best_d) {
+                best_d = d;
+                best = k;
+            }
+        }
+        return best;
+    }
+
+    // Lloyd iterations on the sample, seeded by distinct sampled rows, an
+    // empty centroid takes a random sampled row again
+    void kmeans(const dtype *m, int s, const std::vector<int> &picked, int iterations,
+            std::mt19937 &rng) {
+        dtype *c = codebook.data() + s * centroids * sub_dim;
+        int n = picked.size();
+        for (int k = 0; k < centroids; k++) {
+            memcpy(c + k * sub_dim, m + (size_t)picked[k] * col + s * sub_dim,
+                    sub_dim * sizeof(dtype));
+        }
+        std::vector<int> assign(n);
+        std::vector<double> sums(centroids * sub_dim);
+        std::vector<int> counts(centroids);
+        for (int it = 0; it < iterations; it++) {
+#pragma omp parallel for schedule(static)
+            for (int p = 0; p < n; p++) {
+                assign[p] = nearest(m + (size_t)picked[p] * col + s * sub_dim, s);
+            }
+            std::fill(sums.begin(), sums.end(), 0);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (int p = 0; p < n; p++) {
+                const dtype *x = m + (size_t)picked[p] * col + s * sub_dim;
+                double *sum = sums.data() + assign[p] * sub_dim;
+                for (int j = 0; j < sub_dim; j++) {
+                    sum[j] += x[j];
+                }
+                counts[assign[p]]++;
+            }
+            for (int k = 0; k < centroids; k++) {
+                if (counts[k] == 0) {
+                    int p = rng() % n;
+                    memcpy(c + k * sub_dim, m + (size_t)picked[p] * col + s * sub_dim,
+                            sub_dim * sizeof(dtype));
+                    continue;
+                }
+                for (int j = 0; j < sub_dim; j++) {
+                    c[k * sub_dim + j] = sums[k * sub_dim + j] / counts[k];
+                }
+            }
+        }
+    }
+};
+
+#endif
+
+#endif
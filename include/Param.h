@@ -10,6 +10,8 @@
 
 #include "Eigen/Dense"
 #include "BaseParam.h"
+#include "Int8Mat.h"
+#include "HalfMat.h"
 #if USE_GPU
 #include "n3ldg_cuda.h"
 #endif
@@ -20,6 +22,10 @@ class Param : public BaseParam {
     Tensor2D aux_square;
     Tensor2D aux_mean;
     int iter;
+#if !USE_GPU
+    Int8Mat qval; // see quantize
+    HalfMat hval; // see toHalf
+#endif
 
     // allow sparse and dense parameters have different parameter initialization methods
     inline void initial(int outDim, int inDim) {
@@ -51,6 +57,7 @@ class Param : public BaseParam {
     }
 
     inline void clearGrad() {
+        checkMutable("clearGrad");
 #if USE_GPU
         n3ldg_cuda::Memset(grad.value, grad.size, 0.0f);
 #if TEST_CUDA
@@ -63,6 +70,7 @@ class Param : public BaseParam {
     }
 
     void updateAdagrad(dtype alpha, dtype reg, dtype eps) {
+        checkMutable("updateAdagrad");
 #if USE_GPU
         n3ldg_cuda::UpdateAdagrad(val.value, grad.value, val.row, val.col,
                 aux_square.value, alpha, reg, eps);
@@ -80,6 +88,7 @@ class Param : public BaseParam {
     }
 
     void updateAdam(dtype belta1, dtype belta2, dtype alpha, dtype reg, dtype eps) {
+        checkMutable("updateAdam");
 #if USE_GPU
 #if TEST_CUDA
         n3ldg_cuda::Assert(val.verify("Param adam begin val"));
@@ -155,6 +164,7 @@ class Param : public BaseParam {
     }
 
     inline void rescaleGrad(dtype scale) {
+        checkMutable("rescaleGrad");
 #if USE_GPU
         n3ldg_cuda::Rescale(grad.value, grad.size, scale);
 #if TEST_CUDA
@@ -166,7 +176,83 @@ class Param : public BaseParam {
 #endif
     }
 
+#if !USE_GPU
+    // converts val to per row symmetric int8 for inference, the executes of
+    // UniNode, BiNode, TriNode, FourNode and their linear forms multiply by
+    // qval from then on, see Int8Mat.h
+    // the param becomes frozen, val, grad and the optimizer state are freed
+    // unless keepVal, which is needed when other nodes read val as well
+    inline void quantize(bool keepVal = false) {
+        if (val.v == NULL) {
+            std::cout << "Param::quantize: val is already freed" << std::endl;
+            abort();
+        }
+        qval.quantize(val.v, val.row, val.col);
+        freeze();
+        if (!keepVal) {
+            val.release();
+            grad.release();
+            aux_square.release();
+            aux_mean.release();
+        }
+    }
+
+    inline bool isQuantized() const {
+        return !qval.empty();
+    }
+
+    // converts val to 16 bits for inference, the same executes as quantize
+    // multiply by hval from then on, widened to dtype block by block, see
+    // HalfMat.h, val is freed unless keepVal as with quantize
+    inline void toHalf(HalfMat::Format format = HalfMat::BF16, bool keepVal = false) {
+        if (val.v == NULL) {
+            std::cout << "Param::toHalf: val is already freed" << std::endl;
+            abort();
+        }
+        hval.store(val.v, val.row, val.col, format);
+        freeze();
+        if (!keepVal) {
+            val.release();
+            grad.release();
+            aux_square.release();
+            aux_mean.release();
+        }
+    }
+
+    inline bool isHalf() const {
+        return !hval.empty();
+    }
+
+    // val is not what multiply reads
+    inline bool isCompressed() const {
+        return isQuantized() || isHalf();
+    }
+
+    // y = val x, or y += val x when accumulate, x holds count columns
+    inline void multiply(const dtype *x, int count, dtype *y, bool accumulate) {
+        if (isQuantized()) {
+            qval.multiply(x, count, y, accumulate);
+            return;
+        }
+        if (isHalf()) {
+            hval.multiply(x, count, y, accumulate);
+            return;
+        }
+        Mat xm(const_cast<dtype*>(x), val.col, count);
+        Mat ym(y, val.row, count);
+        if (accumulate) {
+            ym += val.mat() * xm;
+        } else {
+            ym = val.mat() * xm;
+        }
+    }
+#endif
+
     inline void save(std::ofstream &os)const {
+        if (val.v == NULL) {
+            std::cout << "Param::save: val is freed by quantize or toHalf" << std::endl;
+            abort();
+        }
         val.save(os);
         aux_square.save(os);
         aux_mean.save(os);
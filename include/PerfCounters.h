@@ -0,0 +1,198 @@
+#ifndef N3LDG_PERFCOUNTERS_H
+#define N3LDG_PERFCOUNTERS_H
+
+/*
+*  PerfCounters.h:
+*  hardware counters of the calling thread read through perf_event_open,
+*  see benchmark/op_benchmark.cpp
+*  (1) cycles, instructions, cache misses (the last level cache on most
+*      PMUs) and branch misses, in user space only, so that the default
+*      perf_event_paranoid allows them
+*  (2) the counters are one group, read by a single read(), a counter that
+*      cannot be opened is left out and reported unavailable, none are when
+*      there is no PMU (e.g. most VMs and containers) or perf is forbidden
+*  (3) when the PMU multiplexes the group, deltas are scaled by the ratio
+*      of the time enabled to the time running
+*  Linux only, elsewhere no counter is ever available.
+*/
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+class PerfCounters {
+  public:
+    enum Counter {
+        CYCLES = 0,
+        INSTRUCTIONS = 1,
+        CACHE_MISSES = 2,
+        BRANCH_MISSES = 3
+    };
+
+    static const int COUNTERS = 4;
+
+    // a perf event (perf_event_attr type and config) per counter
+    struct Event {
+        uint32_t type;
+        uint64_t config;
+    };
+
+    // counters at a point in time, subtract two to count a region
+    struct Sample {
+        uint64_t value[COUNTERS] = {};
+        uint64_t enabled = 0;
+        uint64_t running = 0;
+    };
+
+    // counts of a region, valid[c] is false when c is unavailable
+    struct Counts {
+        double value[COUNTERS] = {};
+        bool valid[COUNTERS] = {};
+
+        double ipc() const {
+            return valid[CYCLES] && valid[INSTRUCTIONS] && value[CYCLES] > 0 ?
+                value[INSTRUCTIONS] / value[CYCLES] : 0;
+        }
+    };
+
+    static const char *name(int counter) {
+        static const char *names[COUNTERS] = {"cycles", "instructions", "cache_misses",
+            "branch_misses"};
+        return names[counter];
+    }
+
+    ~PerfCounters() {
+        close();
+    }
+
+    // opens the hardware counters, returns whether any is available
+    bool open() {
+#if defined(__linux__)
+        Event events[COUNTERS] = {
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+            {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}
+        };
+        return open(events);
+#else
+        error = "perf counters are only read on Linux";
+        return false;
+#endif
+    }
+
+    // opens the given events in place of the hardware ones (e.g. software
+    // events where there is no PMU)
+    bool open(const Event events[COUNTERS]) {
+        close();
+#if defined(__linux__)
+        for (int c = 0; c < COUNTERS; c++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = events[c].type;
+            attr.config = events[c].config;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                PERF_FORMAT_TOTAL_TIME_RUNNING;
+            attr.disabled = leader < 0; // the group starts with its leader
+            int fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fd < 0) {
+                if (error.empty()) {
+                    error = std::string(name(c)) + ": " + strerror(errno);
+                }
+                continue;
+            }
+            if (leader < 0) {
+                leader = fd;
+            }
+            fds.push_back(fd);
+            slots.push_back(c);
+        }
+        if (leader >= 0) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+        buffer.resize(3 + fds.size());
+#endif
+        return leader >= 0;
+    }
+
+    void close() {
+#if defined(__linux__)
+        for (int fd : fds) {
+            ::close(fd);
+        }
+#endif
+        fds.clear();
+        slots.clear();
+        leader = -1;
+        error.clear();
+    }
+
+    inline bool available(int counter) const {
+        for (int slot : slots) {
+            if (slot == counter) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline bool any() const {
+        return leader >= 0;
+    }
+
+    // why the first counter that failed could not be opened
+    const std::string &why() const {
+        return error;
+    }
+
+    inline void read(Sample &sample) {
+#if defined(__linux__)
+        if (leader < 0) {
+            return;
+        }
+        // nr, time enabled, time running, then a value per counter
+        size_t bytes = buffer.size() * sizeof(uint64_t);
+        if (::read(leader, buffer.data(), bytes) != (ssize_t)bytes) {
+            return;
+        }
+        sample.enabled = buffer[1];
+        sample.running = buffer[2];
+        for (size_t k = 0; k < slots.size(); k++) {
+            sample.value[slots[k]] = buffer[3 + k];
+        }
+#endif
+    }
+
+    // counts between two samples, scaled if the group was multiplexed
+    Counts counts(const Sample &begin, const Sample &end) const {
+        Counts result;
+        uint64_t running = end.running - begin.running;
+        double scale = running > 0 ? (double)(end.enabled - begin.enabled) / running : 1;
+        for (int slot : slots) {
+            result.valid[slot] = true;
+            result.value[slot] = (end.value[slot] - begin.value[slot]) * scale;
+        }
+        return result;
+    }
+
+  private:
+    int leader = -1;
+    std::vector<int> fds;
+    std::vector<int> slots; // counter of each value in the group, in order
+    std::vector<uint64_t> buffer;
+    std::string error;
+};
+
+#endif
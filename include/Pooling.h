@@ -16,6 +16,43 @@
 #include "n3ldg_cuda.h"
 #endif
 #include "profiler.h"
+#include <functional>
+
+#if !USE_GPU
+// running arg max (or min, as told by better) over the inputs, read a row at
+// a time, so that the loop over dim is vectorized instead of jumping across
+// the inputs for every dim, the first input wins on ties
+// the loop is kept free of branches, or compilers won't vectorize it
+template<typename Better>
+inline void reduceRows(const vector<PNode> &ins, int dim, dtype *best, int *masks, Better better) {
+    memcpy(best, ins[0]->val.v, dim * sizeof(dtype));
+    for (int idx = 0; idx < dim; idx++) {
+        masks[idx] = 0;
+    }
+    int nSize = ins.size();
+    for (int i = 1; i < nSize; ++i) {
+        const dtype *x = ins[i]->val.v;
+        for (int idx = 0; idx < dim; idx++) {
+            int hit = better(x[idx], best[idx]);
+            masks[idx] += hit * (i - masks[idx]);
+            best[idx] = better(best[idx], x[idx]) ? best[idx] : x[idx];
+        }
+    }
+}
+
+// out = scale x the sum of the inputs, a row at a time
+inline void addRows(const vector<PNode> &ins, int dim, dtype *out, dtype scale) {
+    Vec sum(out, dim);
+    sum = ins[0]->val.vec();
+    int nSize = ins.size();
+    for (int i = 1; i < nSize; ++i) {
+        sum += ins[i]->val.vec();
+    }
+    if (scale != 1) {
+        sum = sum * scale;
+    }
+}
+#endif
 
 class PoolNode : public Node {
   public:
@@ -77,8 +114,6 @@ class PoolNode : public Node {
 
 
   public:
-    inline PExecute generate(bool bTrain, dtype cur_drop_factor);
-
     // better to rewrite for deep understanding
     inline bool typeEqual(PNode other) {
         return Node::typeEqual(other);
@@ -88,12 +123,13 @@ class PoolNode : public Node {
     virtual inline void setMask() = 0;
 
     inline void compute() {
-        int nSize = ins.size();
         setMask();
+#if USE_GPU
+        // on CPU, setMask writes val as it goes
         for(int i = 0; i < dim; i++) {
-            int mask_i = masks.at(i);
-            val[i] = ins.at(mask_i)->val[i];
+            val[i] = ins[masks[i]]->val[i];
         }
+#endif
     }
 
     void backward() {
@@ -193,20 +229,12 @@ class MaxPoolNode : public PoolNode {
         node_type = "max-pooling";
     }
 
+    // val is used as the running max
     void setMask() {
-        int nSize = ins.size();
-
-        for (int idx = 0; idx < dim; idx++) {
-            int maxIndex = -1;
-            for (int i = 0; i < nSize; ++i) {
-                if (maxIndex == -1 || ins[i]->val[idx] > ins[maxIndex]->val[idx]) {
-                    maxIndex = i;
-                }
-            }
-            masks[idx] = maxIndex;
-        }
+        reduceRows(ins, dim, val.v, masks.data(), std::greater<dtype>());
     }
 
+    inline PExecute generate(bool bTrain, dtype cur_drop_factor);
 };
 #endif
 
@@ -302,18 +330,12 @@ class MinPoolNode : public PoolNode {
   public:
     //Be careful that the row is the dim of input vector, and the col is the number of input vectors
     //Another point is that we change the input vectors directly.
+    // val is used as the running min
     void setMask() {
-        int nSize = ins.size();
-        for (int idx = 0; idx < dim; idx++) {
-            int minIndex = -1;
-            for (int i = 0; i < nSize; ++i) {
-                if (minIndex == -1 || ins[i]->val[idx] < ins[minIndex]->val[idx]) {
-                    minIndex = i;
-                }
-            }
-            masks[idx] = minIndex;
-        }
+        reduceRows(ins, dim, val.v, masks.data(), std::less<dtype>());
     }
+
+    inline PExecute generate(bool bTrain, dtype cur_drop_factor);
 };
 #endif
 
@@ -509,34 +531,63 @@ PExecute MinPoolNode::generate(bool bTrain, dtype cur_drop_factor) {
 }
 #endif
 
-class PoolExecute : public Execute {
+#if !USE_GPU
+// max (or min, as told by Better) pooling of a whole batch, the arg max of
+// all nodes is kept in hits for backward, the masks of the nodes are left
+// to their own compute
+template<typename Better>
+class MaxMinPoolExecute : public Execute {
   public:
-    virtual void  forward() {
+    vector<int> hits; // the dims of every node one after another
+
+    void forward() {
         int count = batch.size();
-        //#pragma omp parallel for
+        int total = 0;
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->compute();
-            batch[idx]->forward_drop(bTrain, drop_factor);
+            total += batch[idx]->dim;
+        }
+        hits.resize(total);
+        int *hit = hits.data();
+        for (int idx = 0; idx < count; idx++) {
+            PoolNode *n = static_cast<PoolNode*>(batch[idx]);
+            reduceRows(n->ins, n->dim, n->val.v, hit, Better());
+            n->forward_drop(bTrain, drop_factor);
+            hit += n->dim;
         }
     }
 
-    virtual void backward() {
+    void backward() {
         int count = batch.size();
-        //#pragma omp parallel for
+        const int *hit = hits.data();
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->backward_drop();
-            batch[idx]->backward();
+            PoolNode *n = static_cast<PoolNode*>(batch[idx]);
+            n->backward_drop();
+            PNode *ins = n->ins.data();
+            const dtype *loss = n->loss.v;
+            for (int i = 0; i < n->dim; i++) {
+                ins[hit[i]]->loss.v[i] += loss[i];
+            }
+            hit += n->dim;
         }
     }
 };
 
-inline PExecute PoolNode::generate(bool bTrain, dtype cur_drop_factor) {
-    PoolExecute* exec = new PoolExecute();
+inline PExecute MaxPoolNode::generate(bool bTrain, dtype cur_drop_factor) {
+    MaxMinPoolExecute<std::greater<dtype>> *exec = new MaxMinPoolExecute<std::greater<dtype>>;
+    exec->batch.push_back(this);
+    exec->bTrain = bTrain;
+    exec->drop_factor = cur_drop_factor;
+    return exec;
+}
+
+inline PExecute MinPoolNode::generate(bool bTrain, dtype cur_drop_factor) {
+    MaxMinPoolExecute<std::less<dtype>> *exec = new MaxMinPoolExecute<std::less<dtype>>;
     exec->batch.push_back(this);
     exec->bTrain = bTrain;
     exec->drop_factor = cur_drop_factor;
     return exec;
 }
+#endif
 
 
 
@@ -762,22 +813,14 @@ class SumPoolNode : public Node {
 
   public:
     inline void compute() {
-        int nSize = ins.size();
-        val.zero();
-        for (int i = 0; i < nSize; ++i) {
-            for (int idx = 0; idx < dim; idx++) {
-                val[idx] += ins[i]->val[idx];
-            }
-        }
+        addRows(ins, dim, val.v, 1);
     }
 
 
     void backward() {
         int nSize = ins.size();
         for (int i = 0; i < nSize; ++i) {
-            for (int idx = 0; idx < dim; idx++) {
-                ins[i]->loss[idx] += loss[idx];
-            }
+            ins[i]->loss.vec() += loss.vec();
         }
     }
 
@@ -875,23 +918,28 @@ public:
     }
 };
 #else
+// the sum of the inputs of a whole batch, the rows are read where they
+// are, no node is called
 class SumPoolExecute : public Execute {
   public:
-    inline void  forward() {
+    inline void forward() {
         int count = batch.size();
-        //#pragma omp parallel for
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->compute();
-            batch[idx]->forward_drop(bTrain, drop_factor);
+            SumPoolNode *n = static_cast<SumPoolNode*>(batch[idx]);
+            addRows(n->ins, n->dim, n->val.v, 1);
+            n->forward_drop(bTrain, drop_factor);
         }
     }
 
     inline void backward() {
         int count = batch.size();
-        //#pragma omp parallel for
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->backward_drop();
-            batch[idx]->backward();
+            SumPoolNode *n = static_cast<SumPoolNode*>(batch[idx]);
+            n->backward_drop();
+            int nSize = n->ins.size();
+            for (int i = 0; i < nSize; ++i) {
+                n->ins[i]->loss.vec() += n->loss.vec();
+            }
         }
     }
 };
@@ -1132,23 +1180,15 @@ class AvgPoolNode : public Node {
 
   public:
     inline void compute() {
-        int nSize = ins.size();
-        val.zero();
-        for (int i = 0; i < nSize; ++i) {
-            for (int idx = 0; idx < dim; idx++) {
-                val[idx] += ins[i]->val[idx] * 1.0 / nSize;
-            }
-        }
-
+        addRows(ins, dim, val.v, (dtype)(1.0 / ins.size()));
     }
 
 
     void backward() {
         int nSize = ins.size();
+        dtype scale = 1.0 / nSize;
         for (int i = 0; i < nSize; ++i) {
-            for (int idx = 0; idx < dim; idx++) {
-                ins[i]->loss[idx] += loss[idx] * 1.0 / nSize;
-            }
+            ins[i]->loss.vec() += loss.vec() * scale;
         }
     }
 
@@ -1246,23 +1286,29 @@ public:
     }
 };
 #else
+// the mean of the inputs of a whole batch, the rows are read where they
+// are, no node is called
 class AvgPoolExecute : public Execute {
   public:
-    inline void  forward() {
+    inline void forward() {
         int count = batch.size();
-        //#pragma omp parallel for
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->compute();
-            batch[idx]->forward_drop(bTrain, drop_factor);
+            AvgPoolNode *n = static_cast<AvgPoolNode*>(batch[idx]);
+            addRows(n->ins, n->dim, n->val.v, (dtype)(1.0 / n->ins.size()));
+            n->forward_drop(bTrain, drop_factor);
         }
     }
 
     inline void backward() {
         int count = batch.size();
-        //#pragma omp parallel for
         for (int idx = 0; idx < count; idx++) {
-            batch[idx]->backward_drop();
-            batch[idx]->backward();
+            AvgPoolNode *n = static_cast<AvgPoolNode*>(batch[idx]);
+            n->backward_drop();
+            int nSize = n->ins.size();
+            dtype scale = 1.0 / nSize;
+            for (int i = 0; i < nSize; ++i) {
+                n->ins[i]->loss.vec() += n->loss.vec() * scale;
+            }
         }
     }
 };
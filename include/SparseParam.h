@@ -9,6 +9,10 @@
 #define SPARSEPARAM_H_
 
 #include "BaseParam.h"
+#include "HalfMat.h"
+#include "MappedTable.h"
+#include <memory>
+#include <unordered_map>
 
 // Notice: aux_square is an aux_squareiliary variable to help parameter updating
 // The in-out dimension definiation is different with dense parameters.
@@ -18,6 +22,10 @@ class SparseParam : public BaseParam {
     Tensor2D aux_mean;
     NRVec<bool> indexers;
     NRVec<int> last_update;
+#if !USE_GPU
+    HalfMat hval; // see toHalf
+    MappedTable mapped; // see initialMapped
+#endif
 #if USE_GPU
     n3ldg_cuda::BoolArray dIndexers;
     n3ldg_cuda::IntArray dIters;
@@ -61,7 +69,122 @@ class SparseParam : public BaseParam {
 #endif
     }
 
+#if !USE_GPU
+    // as initial, but val, aux_square, aux_mean and last_update live in the
+    // file at path (see MappedTable.h), for tables larger than memory
+    // (1) an existing file of the same shape is reopened as it is, with its
+    //     values and optimizer state, so it is also how the param is loaded,
+    //     a file of another shape aborts rather than being overwritten
+    // (2) the optimizer state of rows never updated is never written, so
+    //     it takes no memory or disk, grad rows are allocated by gradRow
+    //     for the rows used since clearGrad only
+    // (3) about cacheRows rows are kept in the process, updated rows are
+    //     written back after every update
+    // returns whether the file existed
+    // values are drawn from [-bound, bound], sqrt(6 / (outDim + inDim)) when
+    // bound is not positive as with initial
+    inline bool initialMapped(int outDim, int inDim, const std::string &path,
+            size_t cacheRows = 1 << 16, dtype bound = -1) {
+        std::vector<size_t> widths = {outDim * sizeof(dtype), outDim * sizeof(dtype),
+            outDim * sizeof(dtype), sizeof(int)};
+        bool existed = mapped.open(path, inDim, widths, cacheRows);
+        val.setShape(inDim, outDim);
+        indexers.resize(inDim);
+        indexers = false;
+        grad_rows.clear();
+        if (!existed) {
+            if (bound <= 0) {
+                bound = sqrt(6.0 / (outDim + inDim));
+            }
+            for (int i = 0; i < inDim; i++) {
+                randomRow(i, bound);
+            }
+            mapped.flush();
+        }
+        return existed;
+    }
+
+    inline bool isMapped() const {
+        return mapped.isOpen();
+    }
+
+    // rewrites row i with values in [-bound, bound], e.g. to initialize a
+    // mapped table row by row
+    inline void randomRow(int i, dtype bound) {
+        if (isMapped()) {
+            mapped.use(i);
+            mapped.dirty(0, i);
+        }
+        dtype *row = valRow(i);
+        for (int j = 0; j < val.col; j++) {
+            row[j] = (dtype(rand()) / RAND_MAX) * 2 * bound - bound;
+        }
+    }
+
+    // called once a mapped param is changed outside of the updates
+    inline void flush(bool sync = false) {
+        if (isMapped()) {
+            mapped.flush(sync);
+        }
+    }
+
+    // row featId of a mapped param is read, kept in the LRU of the hot rows
+    // unless frozen, as a frozen param may be read by several threads
+    inline void use(int featId) {
+        if (isMapped() && !frozen) {
+            mapped.use(featId);
+        }
+    }
+#endif
+
+    // row featId of val, in the file of a mapped param
+    inline dtype *valRow(int featId) {
+#if !USE_GPU
+        if (isMapped()) {
+            return (dtype*)mapped.at(0, featId);
+        }
+#endif
+        return val[featId];
+    }
+
+    // row major values, those of the file of a mapped param, NULL once
+    // freed by toHalf
+    inline dtype *valData() {
+#if !USE_GPU
+        if (isMapped()) {
+            return (dtype*)mapped.at(0, 0);
+        }
+#endif
+        return val.v;
+    }
+
+    // the grad row of a mapped param is allocated on its first use since
+    // clearGrad, so gradRow is not thread safe then
+    inline dtype *gradRow(int featId) {
+#if !USE_GPU
+        if (isMapped()) {
+            return mappedGradRow(featId);
+        }
+#endif
+        return grad[featId];
+    }
+
+#if !USE_GPU
+    inline dtype *squareRow(int featId) {
+        return isMapped() ? (dtype*)mapped.at(1, featId) : aux_square[featId];
+    }
+
+    inline dtype *meanRow(int featId) {
+        return isMapped() ? (dtype*)mapped.at(2, featId) : aux_mean[featId];
+    }
+
+    inline int &lastUpdate(int featId) {
+        return isMapped() ? *(int*)mapped.at(3, featId) : last_update[featId];
+    }
+#endif
+
     inline void clearGrad() {
+        checkMutable("clearGrad");
 #if USE_GPU
         n3ldg_cuda::Memset(grad.value, grad.size, 0.0f);
         n3ldg_cuda::Memset(dIndexers.value, grad.row, false);
@@ -79,6 +202,11 @@ class SparseParam : public BaseParam {
 #endif
 #else
         int inDim = indexers.size();
+        if (isMapped()) {
+            grad_rows.clear();
+            indexers = false;
+            return;
+        }
         for (int index = 0; index < inDim; index++) {
             if (!indexers[index]) continue;
             for (int idx = 0; idx < grad.col; idx++) {
@@ -98,6 +226,7 @@ class SparseParam : public BaseParam {
     }
 
     inline void updateAdagrad(dtype alpha, dtype reg, dtype eps) {
+        checkMutable("updateAdagrad");
 #if USE_GPU
         n3ldg_cuda::UpdateAdagrad(val.value, grad.value, indexers.size(),
                 grad.col, aux_square.value, dIndexers.value, alpha, reg, eps);
@@ -118,16 +247,20 @@ class SparseParam : public BaseParam {
         int inDim = indexers.size();
         for (int index = 0; index < inDim; index++) {
             if (!indexers[index]) continue;
-            for (int idx = 0; idx < grad.col; idx++) {
-                grad[index][idx] = grad[index][idx] + val[index][idx] * reg;
-                aux_square[index][idx] = aux_square[index][idx] + grad[index][idx] * grad[index][idx];
-                val[index][idx] = val[index][idx] - grad[index][idx] * alpha / sqrt(aux_square[index][idx] + eps);
+            dtype *g = gradRow(index), *v = valRow(index), *square = squareRow(index);
+            for (int idx = 0; idx < val.col; idx++) {
+                g[idx] = g[idx] + v[idx] * reg;
+                square[idx] = square[idx] + g[idx] * g[idx];
+                v[idx] = v[idx] - g[idx] * alpha / sqrt(square[idx] + eps);
             }
+            updated(index);
         }
+        flush();
 #endif
     }
 
     inline void updateAdam(dtype belta1, dtype belta2, dtype alpha, dtype reg, dtype eps) {
+        checkMutable("updateAdam");
 #if USE_GPU
         n3ldg_cuda::UpdateAdam(val.value, grad.value, indexers.size(),
                 grad.col,
@@ -162,15 +295,20 @@ class SparseParam : public BaseParam {
         int inDim = indexers.size();
         for (int index = 0; index < inDim; index++) {
             if (!indexers[index]) continue;
-            for (int idx = 0; idx < grad.col; idx++) {
-                grad[index][idx] = grad[index][idx] + val[index][idx] * reg;
-                aux_mean[index][idx] = belta1 * aux_mean[index][idx] + (1 - belta1) * grad[index][idx];
-                aux_square[index][idx] = belta2 * aux_square[index][idx] + (1 - belta2) * grad[index][idx] * grad[index][idx];
-                lr_t = alpha * sqrt(1 - pow(belta2, last_update[index] + 1)) / (1 - pow(belta1, last_update[index] + 1));
-                val[index][idx] = val[index][idx] - aux_mean[index][idx] * lr_t / sqrt(aux_square[index][idx] + eps);
+            dtype *g = gradRow(index), *v = valRow(index);
+            dtype *mean = meanRow(index), *square = squareRow(index);
+            int &last = lastUpdate(index);
+            for (int idx = 0; idx < val.col; idx++) {
+                g[idx] = g[idx] + v[idx] * reg;
+                mean[idx] = belta1 * mean[idx] + (1 - belta1) * g[idx];
+                square[idx] = belta2 * square[idx] + (1 - belta2) * g[idx] * g[idx];
+                lr_t = alpha * sqrt(1 - pow(belta2, last + 1)) / (1 - pow(belta1, last + 1));
+                v[idx] = v[idx] - mean[idx] * lr_t / sqrt(square[idx] + eps);
             }
-            last_update[index]++;
+            last++;
+            updated(index);
         }
+        flush();
 #endif
     }
 
@@ -225,8 +363,9 @@ class SparseParam : public BaseParam {
         int inDim = indexers.size();
         for (int index = 0; index < inDim; index++) {
             if (!indexers[index]) continue;
+            const dtype *g = gradRow(index);
             for (int idx = 0; idx < val.col; idx++) {
-                sumNorm += grad[index][idx] * grad[index][idx];
+                sumNorm += g[idx] * g[idx];
             }
         }
 
@@ -235,6 +374,7 @@ class SparseParam : public BaseParam {
     }
 
     inline void rescaleGrad(dtype scale) {
+        checkMutable("rescaleGrad");
 #if USE_GPU
         n3ldg_cuda::Rescale(grad.value, grad.size, scale);
 #if TEST_CUDA
@@ -250,19 +390,54 @@ class SparseParam : public BaseParam {
         int inDim = indexers.size();
         for (int index = 0; index < inDim; index++) {
             if (!indexers[index]) continue;
+            dtype *g = gradRow(index);
             for (int idx = 0; idx < val.col; idx++) {
-                grad[index][idx] = grad[index][idx] * scale;
+                g[idx] = g[idx] * scale;
             }
         }
 #endif
     }
 
+#if !USE_GPU
+    // converts val to 16 bits for inference, rows are widened to dtype when
+    // read by value and LookupExecute, see HalfMat.h
+    // the param becomes frozen, val, grad and the optimizer state are freed
+    // unless keepVal, which is needed when other nodes read val as well,
+    // e.g. ActionNode, training keeps val in dtype and never calls this
+    inline void toHalf(HalfMat::Format format = HalfMat::BF16, bool keepVal = false) {
+        if (valData() == NULL) {
+            std::cout << "SparseParam::toHalf: val is already freed" << std::endl;
+            abort();
+        }
+        hval.store(valData(), val.row, val.col, format);
+        freeze();
+        if (!keepVal) {
+            val.release();
+            grad.release();
+            aux_square.release();
+            aux_mean.release();
+        }
+    }
+
+    inline bool isHalf() const {
+        return !hval.empty();
+    }
+#endif
+
     inline void value(const int& featId, Tensor1D& out) {
         if (out.dim != val.col) {
             std::cout << "warning: output dim not equal lookup param dim." << std::endl;
         }
+#if !USE_GPU
+        if (isHalf()) {
+            hval.decode(featId, out.v, std::min(out.dim, val.col));
+            return;
+        }
+        use(featId);
+#endif
+        const dtype *v = valRow(featId);
         for (int idx = 0; idx < val.col; idx++) {
-            out[idx] = val[featId][idx];
+            out[idx] = v[idx];
         }
     }
 
@@ -274,23 +449,34 @@ class SparseParam : public BaseParam {
         int featId;
         for (int i = 0; i < featNum; i++) {
             featId = featIds[i];
+#if !USE_GPU
+            if (isHalf()) {
+                hval.add(featId, out.v, std::min(out.dim, val.col));
+                continue;
+            }
+            use(featId);
+#endif
+            const dtype *v = valRow(featId);
             for (int idx = 0; idx < val.col; idx++) {
-                out[idx] += val[featId][idx];
+                out[idx] += v[idx];
             }
         }
     }
 
     inline void loss(const int& featId, const Tensor1D& loss) {
+        checkMutable("loss");
         if (loss.dim != val.col) {
             std::cout << "warning: loss dim not equal lookup param dim." << std::endl;
         }
         indexers[featId] = true;
+        dtype *g = gradRow(featId);
         for (int idx = 0; idx < val.col; idx++) {
-            grad[featId][idx] += loss[idx];
+            g[idx] += loss[idx];
         }
     }
 
     inline void loss(const vector<int>& featIds, const Tensor1D& loss) {
+        checkMutable("loss");
         if (loss.dim != val.col) {
             std::cout << "warning: loss dim not equal lookup param dim." << std::endl;
         }
@@ -299,13 +485,24 @@ class SparseParam : public BaseParam {
         for (int i = 0; i < featNum; i++) {
             featId = featIds[i];
             indexers[featId] = true;
+            dtype *g = gradRow(featId);
             for (int idx = 0; idx < val.col; idx++) {
-                grad[featId][idx] += loss[idx];
+                g[idx] += loss[idx];
             }
         }
     }
 
     inline void save(std::ofstream &os)const {
+#if !USE_GPU
+        if (mapped.isOpen()) {
+            std::cout << "SparseParam::save: a mapped param is kept by its file, see initialMapped" << std::endl;
+            abort();
+        }
+#endif
+        if (val.v == NULL) {
+            std::cout << "SparseParam::save: val is freed by toHalf" << std::endl;
+            abort();
+        }
         val.save(os);
         aux_square.save(os);
         aux_mean.save(os);
@@ -327,6 +524,38 @@ class SparseParam : public BaseParam {
         }
     }
 
+#if !USE_GPU
+  private:
+    static const int GRAD_BLOCK_ROWS = 256;
+    // grad rows of a mapped param, blocks keep their addresses
+    std::unordered_map<int, dtype*> grad_rows;
+    std::vector<std::unique_ptr<dtype[]>> grad_blocks;
+
+    inline dtype *mappedGradRow(int featId) {
+        auto it = grad_rows.find(featId);
+        if (it != grad_rows.end()) {
+            return it->second;
+        }
+        size_t block = grad_rows.size() / GRAD_BLOCK_ROWS;
+        if (block == grad_blocks.size()) {
+            grad_blocks.push_back(std::unique_ptr<dtype[]>(new dtype[GRAD_BLOCK_ROWS * val.col]));
+        }
+        dtype *row = grad_blocks[block].get() + grad_rows.size() % GRAD_BLOCK_ROWS * val.col;
+        memset(row, 0, val.col * sizeof(dtype));
+        grad_rows[featId] = row;
+        mapped.use(featId);
+        return row;
+    }
+
+    inline void updated(int featId) {
+        if (isMapped()) {
+            mapped.use(featId);
+            for (int region = 0; region < 4; region++) {
+                mapped.dirty(region, featId);
+            }
+        }
+    }
+#endif
 };
 
 #endif /* SPARSEPARAM_H_ */
@@ -0,0 +1,98 @@
+#ifndef N3LDG_STATE_POOL_H
+#define N3LDG_STATE_POOL_H
+
+/*
+*  StatePool.h:
+*  read-only inference with one model shared by many threads
+*  (1) once the model is loaded, call ModelUpdate::freeze() on its params,
+*      a frozen param aborts on any update, APParam averages are finalized
+*      and the alphabets of frozen params are only looked up, never grown
+*  (2) everything a request writes (a Graph, the builders and their nodes)
+*      lives in a state object taken from a StatePool, each thread keeps its
+*      own free list, so requests never share nodes and no lock is taken
+*  (3) graphs of such requests are cleared with bTrain = false, backward
+*      aborts on them
+*/
+
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+template<typename State>
+class StatePool {
+  public:
+    typedef std::function<State*()> Factory;
+
+    explicit StatePool(const Factory &factory) : factory(factory), id(nextId()) {}
+
+    // a state released earlier on this thread, or a new one
+    State *acquire() {
+        std::vector<State*> &free_states = freeStates();
+        if (free_states.empty()) {
+            return factory();
+        }
+        State *state = free_states.back();
+        free_states.pop_back();
+        return state;
+    }
+
+    void release(State *state) {
+        freeStates().push_back(state);
+    }
+
+    // gives the state back when leaving the scope of a request
+    class Lease {
+      public:
+        explicit Lease(StatePool &pool) : pool(pool), state(pool.acquire()) {}
+
+        ~Lease() {
+            pool.release(state);
+        }
+
+        Lease(const Lease &) = delete;
+        Lease &operator=(const Lease &) = delete;
+
+        State &operator*() const {
+            return *state;
+        }
+
+        State *operator->() const {
+            return state;
+        }
+
+      private:
+        StatePool &pool;
+        State *state;
+    };
+
+  private:
+    // states are deleted when their thread exits
+    struct ThreadStates {
+        std::unordered_map<int, std::vector<State*>> free_states;
+
+        ~ThreadStates() {
+            for (auto &it : free_states) {
+                for (State *state : it.second) {
+                    delete state;
+                }
+            }
+        }
+    };
+
+    std::vector<State*> &freeStates() {
+        thread_local ThreadStates states;
+        return states.free_states[id];
+    }
+
+    // pools are told apart by id rather than by address, which may be reused
+    static int nextId() {
+        static std::atomic<int> counter(0);
+        return counter++;
+    }
+
+    Factory factory;
+    int id;
+};
+
+#endif
@@ -0,0 +1,362 @@
+#ifndef N3LDG_TRACER_H
+#define N3LDG_TRACER_H
+
+/*
+*  Tracer.h:
+*  a profiler cheap enough to be left enabled, e.g. to sample production
+*  graphs, Graph::compute and Graph::backward record every execute
+*  (1) events are ids interned once from their names (e.g. the node types),
+*      a record is a few integers, no string is built when tracing
+*  (2) each thread writes its own ring of the last RING records and its
+*      own totals per event, so threads never contend, the totals are
+*      complete even once the ring wraps
+*  (3) events nest, the time of an event minus that of its children is
+*      its self time
+*  (4) writeChromeTrace writes the rings as the JSON of chrome://tracing
+*      (or Perfetto), writeTable the totals as a table
+*  (5) times are read from the TSC on x86 when it is invariant (half the
+*      cost of the clock), they are scaled to the steady clock when reported
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define N3LDG_TRACER_TSC 1
+#endif
+
+class Tracer {
+  public:
+    enum Phase {
+        SCOPE = 0, // a user or graph scope
+        FORWARD = 1, // Execute::forward, tagged by node type, batch and dim
+        BACKWARD = 2
+    };
+
+    static const int PHASES = 3;
+    static const int RING = 1 << 16; // records kept per thread
+
+    static Tracer &ins() {
+        // never destroyed, as threads may still trace at exit
+        static Tracer *t = new Tracer;
+        return *t;
+    }
+
+    // the id of an event name, the same for every thread, call it once
+    // per name (e.g. keep it in a static)
+    int intern(const std::string &name) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        int id = names.size();
+        names.push_back(name);
+        ids[name] = id;
+        return id;
+    }
+
+    // as intern, from a cache of the calling thread, for names known only
+    // when tracing (e.g. node types)
+    int internCached(const std::string &name) {
+        static thread_local std::unordered_map<std::string, int> cache;
+        auto it = cache.find(name);
+        if (it != cache.end()) {
+            return it->second;
+        }
+        int id = intern(name);
+        cache[name] = id;
+        return id;
+    }
+
+    inline bool enabled() const {
+        return on.load(std::memory_order_relaxed);
+    }
+
+    void setEnabled(bool enabled) {
+        on = enabled;
+    }
+
+    inline void begin(int event, Phase phase = SCOPE, int batch = 0, int dim = 0) {
+        ThreadTrace &t = thread();
+        Open open;
+        open.event = event;
+        open.phase = phase;
+        open.batch = batch;
+        open.dim = dim;
+        open.children = 0;
+        open.begin = now();
+        t.open.push_back(open);
+    }
+
+    inline void end() {
+        ThreadTrace &t = thread();
+        if (t.open.empty()) {
+            std::cout << "Tracer::end: no event began" << std::endl;
+            abort();
+        }
+        int64_t end = now();
+        Open open = t.open.back();
+        t.open.pop_back();
+        int64_t duration = end - open.begin;
+        if (!t.open.empty()) {
+            t.open.back().children += duration;
+        }
+
+        std::lock_guard<std::mutex> guard(t.lock);
+        Record &r = t.ring[t.written % RING];
+        r.event = open.event;
+        r.phase = open.phase;
+        r.depth = t.open.size();
+        r.batch = open.batch;
+        r.dim = open.dim;
+        r.begin = open.begin;
+        r.duration = duration;
+        t.written++;
+
+        size_t slot = (size_t)open.event * PHASES + open.phase;
+        if (slot >= t.totals.size()) {
+            t.totals.resize(slot + 1);
+        }
+        Total &total = t.totals[slot];
+        total.count++;
+        total.time += duration;
+        total.self += duration - open.children;
+        total.batch += open.batch;
+        if (t.open.empty()) {
+            t.root += duration;
+        }
+    }
+
+    // forgets the records and totals of all threads
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock);
+        for (auto &t : threads) {
+            std::lock_guard<std::mutex> thread_guard(t->lock);
+            t->written = 0;
+            t->totals.clear();
+            t->root = 0;
+        }
+    }
+
+    void writeChromeTrace(std::ostream &os) {
+        static const char *categories[PHASES] = {"scope", "forward", "backward"};
+        double scale = nsPerTick() / 1e3; // to us
+        std::lock_guard<std::mutex> guard(lock);
+        os << "{\"traceEvents\":[";
+        bool first = true;
+        for (auto &t : threads) {
+            std::lock_guard<std::mutex> thread_guard(t->lock);
+            uint64_t from = t->written > RING ? t->written - RING : 0;
+            for (uint64_t k = from; k < t->written; k++) {
+                const Record &r = t->ring[k % RING];
+                os << (first ? "\n" : ",\n") << "{\"name\":\"" << escape(names[r.event]) <<
+                    "\",\"cat\":\"" << categories[r.phase] << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" <<
+                    t->id << std::fixed << std::setprecision(3) << ",\"ts\":" << r.begin * scale <<
+                    ",\"dur\":" << r.duration * scale << std::defaultfloat;
+                if (r.phase != SCOPE) {
+                    os << ",\"args\":{\"batch\":" << r.batch << ",\"dim\":" << r.dim << "}";
+                }
+                os << "}";
+                first = false;
+            }
+        }
+        os << "\n]}" << std::endl;
+    }
+
+    // events of all threads by total time, self time excludes the nested
+    // events, share is of the time of the outermost events
+    void writeTable(std::ostream &os) {
+        static const char *labels[PHASES] = {"", " (forward)", " (backward)"};
+        struct Row {
+            std::string name;
+            Total total;
+        };
+        double ms = nsPerTick() / 1e6;
+        std::vector<Row> rows;
+        std::vector<Total> sums;
+        int64_t root = 0;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto &t : threads) {
+                std::lock_guard<std::mutex> thread_guard(t->lock);
+                if (t->totals.size() > sums.size()) {
+                    sums.resize(t->totals.size());
+                }
+                for (size_t slot = 0; slot < t->totals.size(); slot++) {
+                    sums[slot].count += t->totals[slot].count;
+                    sums[slot].time += t->totals[slot].time;
+                    sums[slot].self += t->totals[slot].self;
+                    sums[slot].batch += t->totals[slot].batch;
+                }
+                root += t->root;
+            }
+            for (size_t slot = 0; slot < sums.size(); slot++) {
+                if (sums[slot].count > 0) {
+                    Row row;
+                    row.name = names[slot / PHASES] + labels[slot % PHASES];
+                    row.total = sums[slot];
+                    rows.push_back(row);
+                }
+            }
+        }
+        std::sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) {
+            return a.total.time > b.total.time;
+        });
+        os << std::left << std::setw(40) << "event" << std::right << std::setw(10) << "count" <<
+            std::setw(12) << "total ms" << std::setw(12) << "self ms" << std::setw(12) <<
+            "avg us" << std::setw(10) << "batch" << std::setw(8) << "share" << std::endl;
+        os << std::fixed;
+        for (const Row &row : rows) {
+            const Total &t = row.total;
+            os << std::left << std::setw(40) << row.name << std::right << std::setw(10) <<
+                t.count << std::setprecision(3) << std::setw(12) << t.time * ms <<
+                std::setw(12) << t.self * ms << std::setprecision(2) << std::setw(12) <<
+                t.time * ms * 1e3 / t.count << std::setprecision(1) << std::setw(10) <<
+                (double)t.batch / t.count << std::setw(7) <<
+                (root > 0 ? 100.0 * t.time / root : 0) << "%" << std::endl;
+        }
+        os << std::defaultfloat;
+    }
+
+  private:
+    struct Record {
+        int32_t event;
+        int16_t phase;
+        int16_t depth;
+        int32_t batch;
+        int32_t dim;
+        int64_t begin; // ticks since the tracer was created
+        int64_t duration;
+    };
+
+    struct Open {
+        int event;
+        Phase phase;
+        int batch;
+        int dim;
+        int64_t begin;
+        int64_t children; // time of the nested events
+    };
+
+    struct Total {
+        uint64_t count = 0;
+        int64_t time = 0;
+        int64_t self = 0;
+        uint64_t batch = 0;
+    };
+
+    struct ThreadTrace {
+        int id;
+        std::vector<Open> open; // only touched by its thread
+        std::mutex lock; // of the rest, against the writers of the reports
+        std::vector<Record> ring;
+        uint64_t written = 0;
+        std::vector<Total> totals; // by event * PHASES + phase
+        int64_t root = 0; // time of the outermost events
+    };
+
+    std::chrono::steady_clock::time_point epoch;
+    int64_t epoch_ticks = 0;
+    bool tsc = false;
+    std::atomic<bool> on{false};
+    std::mutex lock; // of names, ids and threads
+    std::vector<std::string> names;
+    std::unordered_map<std::string, int> ids;
+    std::vector<std::shared_ptr<ThreadTrace>> threads;
+
+    Tracer() {
+#if N3LDG_TRACER_TSC
+        unsigned a, b, c, d;
+        // invariant TSC, CPUID 0x80000007 EDX bit 8
+        tsc = __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1 << 8));
+#endif
+        epoch = std::chrono::steady_clock::now();
+        epoch_ticks = ticks();
+    }
+
+    inline int64_t ticks() const {
+#if N3LDG_TRACER_TSC
+        if (tsc) {
+            return __rdtsc();
+        }
+#endif
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    inline int64_t now() const {
+        return ticks() - epoch_ticks;
+    }
+
+    // ns per tick, from the ticks and the steady clock elapsed since the
+    // tracer was created
+    double nsPerTick() const {
+        if (!tsc) {
+            return 1;
+        }
+        double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - epoch).count();
+        int64_t elapsed = now();
+        return elapsed > 0 ? ns / elapsed : 1;
+    }
+
+    // the trace of the calling thread, registered on its first event and
+    // kept after the thread exits, for the reports
+    inline ThreadTrace &thread() {
+        static thread_local ThreadTrace *mine = NULL;
+        if (mine == NULL) {
+            std::shared_ptr<ThreadTrace> t = std::make_shared<ThreadTrace>();
+            t->ring.resize(RING);
+            std::lock_guard<std::mutex> guard(lock);
+            t->id = threads.size();
+            threads.push_back(t);
+            mine = t.get();
+        }
+        return *mine;
+    }
+
+    static std::string escape(const std::string &s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '"' || c == '\\') {
+                out += '\\';
+            }
+            out += c;
+        }
+        return out;
+    }
+};
+
+// traces its lifetime when the tracer is enabled at its construction
+class TraceScope {
+  public:
+    TraceScope(int event, Tracer::Phase phase = Tracer::SCOPE, int batch = 0, int dim = 0) {
+        Tracer &tracer = Tracer::ins();
+        traced = tracer.enabled();
+        if (traced) {
+            tracer.begin(event, phase, batch, dim);
+        }
+    }
+
+    ~TraceScope() {
+        if (traced) {
+            Tracer::ins().end();
+        }
+    }
+
+  private:
+    bool traced;
+};
+
+#endif
@@ -44,6 +44,9 @@ class TransferParams {
     }
 
     inline int getElemId(const string& strFeat) {
+        if (nVSize > 0 && W[0].frozen) {
+            return elems->find(strFeat);
+        }
         return elems->from_string(strFeat);
     }
 
@@ -72,7 +75,7 @@ class TransferNode : public Node {
         in = NULL;
         xid = -1;
         param = NULL;
-
+        node_type = "transfer";
     }
 
 
@@ -88,13 +91,20 @@ class TransferNode : public Node {
 
   public:
     void forward(Graph *cg, PNode x, const string& strNorm) {
-        in = x;
-        xid = param->getElemId(strNorm);
-        if (xid < 0) {
+        int id = param->getElemId(strNorm);
+        if (id < 0) {
             std::cout << "TransferNode warning: could find the label: " << strNorm << std::endl;
         }
+        forward(cg, x, id);
+    }
+
+    // id is that of getElemId (e.g. converted once by str2id)
+    void forward(Graph *cg, PNode x, int id) {
+        in = x;
+        xid = id;
         degree = 0;
         in->addParent(this);
+        cg->addNode(this);
     }
 
   public:
@@ -114,7 +124,7 @@ class TransferNode : public Node {
   public:
     inline PExecute generate(bool bTrain, dtype cur_drop_factor);
 
-    // better to rewrite for deep understanding
+    // nodes of all labels are batched, TransferExecute groups them by xid
     inline bool typeEqual(PNode other) {
         bool result = Node::typeEqual(other);
         if (!result) return false;
@@ -123,16 +133,18 @@ class TransferNode : public Node {
         if (param != conv_other->param) {
             return false;
         }
-        if (xid != conv_other->xid) {
-            return false;
-        }
 
         return true;
     }
 
+    size_t typeHashCode() const override {
+        return Node::typeHashCode() ^ ::typeHashCode(param);
+    }
+
 };
 
 
+#if USE_GPU
 class TransferExecute :public Execute {
   public:
     inline void  forward() {
@@ -153,12 +165,96 @@ class TransferExecute :public Execute {
         }
     }
 };
+#else
+// nodes are sorted by xid and their inputs packed in that order, a row per
+// node, so that the nodes of a label are the rows [begin, end) of a group
+// and cost one GEMM with W[xid]
+class TransferExecute :public Execute {
+  public:
+    TransferParams* param;
+    std::vector<PNode> sorted;
+    std::vector<std::pair<int, int>> groups; // xid and end row
+    Tensor2D x;
+
+    inline void  forward() {
+        int count = batch.size();
+        // counting sort by xid, nodes with an unknown label are left out
+        std::vector<int> starts(param->nVSize + 1, 0);
+        for (int idx = 0; idx < count; idx++) {
+            int xid = ((TransferNode*)batch[idx])->xid;
+            if (xid >= 0) starts[xid + 1]++;
+        }
+        for (int xid = 0; xid < param->nVSize; xid++) {
+            if (starts[xid + 1] > 0) {
+                groups.push_back(std::make_pair(xid, starts[xid] + starts[xid + 1]));
+            }
+            starts[xid + 1] += starts[xid];
+        }
+        sorted.resize(starts[param->nVSize]);
+        for (int idx = 0; idx < count; idx++) {
+            int xid = ((TransferNode*)batch[idx])->xid;
+            if (xid >= 0) sorted[starts[xid]++] = batch[idx];
+        }
+
+        int total = sorted.size();
+        x.init(total, param->nInSize);
+        for (int idx = 0; idx < total; idx++) {
+            memcpy(x[idx], ((TransferNode*)sorted[idx])->in->val.v, x.col * sizeof(dtype));
+        }
+        Tensor2D y;
+        y.init(total, param->nOutSize);
+        int begin = 0;
+        for (auto &group : groups) {
+            int rows = group.second - begin;
+            Mat(y[begin], rows, y.col).noalias() = Mat(x[begin], rows, x.col) *
+                param->W[group.first].val.mat().transpose();
+            begin = group.second;
+        }
+        for (int idx = 0; idx < total; idx++) {
+            memcpy(sorted[idx]->val.v, y[idx], y.col * sizeof(dtype));
+        }
+
+        for (int idx = 0; idx < count; idx++) {
+            batch[idx]->forward_drop(bTrain, drop_factor);
+        }
+    }
+
+    inline void backward() {
+        int count = batch.size();
+        for (int idx = 0; idx < count; idx++) {
+            batch[idx]->backward_drop();
+        }
+
+        int total = sorted.size();
+        Tensor2D ly, lx;
+        ly.init(total, param->nOutSize);
+        lx.init(total, param->nInSize);
+        for (int idx = 0; idx < total; idx++) {
+            memcpy(ly[idx], sorted[idx]->loss.v, ly.col * sizeof(dtype));
+        }
+        int begin = 0;
+        for (auto &group : groups) {
+            int rows = group.second - begin;
+            Param &W = param->W[group.first];
+            W.grad.mat() += Mat(ly[begin], rows, ly.col).transpose() * Mat(x[begin], rows, x.col);
+            Mat(lx[begin], rows, lx.col).noalias() = Mat(ly[begin], rows, ly.col) * W.val.mat();
+            begin = group.second;
+        }
+        for (int idx = 0; idx < total; idx++) {
+            ((TransferNode*)sorted[idx])->in->loss.tmat() += Mat(lx[idx], 1, lx.col);
+        }
+    }
+};
+#endif
 
 inline PExecute TransferNode::generate(bool bTrain, dtype cur_drop_factor) {
     TransferExecute* exec = new TransferExecute();
     exec->batch.push_back(this);
     exec->bTrain = bTrain;
     exec->drop_factor = cur_drop_factor;
+#if !USE_GPU
+    exec->param = param;
+#endif
     return exec;
 };
 
@@ -49,6 +49,27 @@ public:
         }
     }
 
+#if !USE_GPU
+    // int8 weights for inference, the bias stays as it is, see Param::quantize
+    inline void quantize(bool keepVal = false) {
+        W1.quantize(keepVal);
+        W2.quantize(keepVal);
+        W3.quantize(keepVal);
+    }
+
+    // 16 bit weights for inference, see Param::toHalf
+    inline void toHalf(HalfMat::Format format = HalfMat::BF16, bool keepVal = false) {
+        W1.toHalf(format, keepVal);
+        W2.toHalf(format, keepVal);
+        W3.toHalf(format, keepVal);
+    }
+
+    // the executes multiply by Param::multiply rather than by val
+    inline bool isCompressed() const {
+        return W1.isCompressed() || W2.isCompressed() || W3.isCompressed();
+    }
+#endif
+
     inline void save(std::ofstream &os) const {
         os << bUseB << std::endl;
         W1.save(os);
@@ -269,6 +290,10 @@ public:
 
 
 public:
+    double flops() const override {
+        return weightFlops(inDim1 + inDim2 + inDim3, outDim);
+    }
+
     inline void  forward() {
         int count = batch.size();
         x1.init(inDim1, count);
@@ -370,6 +395,10 @@ public:
     TriParams* param;
 
 public:
+    double flops() const override {
+        return weightFlops(inDim1 + inDim2 + inDim3, outDim);
+    }
+
     inline void  forward() {
         count = batch.size();
         x1.init(inDim1, count);
@@ -581,6 +610,10 @@ public:
 
 
 public:
+    double flops() const override {
+        return weightFlops(inDim1 + inDim2 + inDim3, outDim);
+    }
+
     inline void  forward() {
         int count = batch.size();
         x1.init(inDim1, count);
@@ -608,7 +641,13 @@ public:
             }
         }
 
-        ty.mat() = param->W1.val.mat() * x1.mat() + param->W2.val.mat() * x2.mat() + param->W3.val.mat() * x3.mat();
+        if (param->isCompressed()) {
+            param->W1.multiply(x1.v, count, ty.v, false);
+            param->W2.multiply(x2.v, count, ty.v, true);
+            param->W3.multiply(x3.v, count, ty.v, true);
+        } else {
+            ty.mat() = param->W1.val.mat() * x1.mat() + param->W2.val.mat() * x2.mat() + param->W3.val.mat() * x3.mat();
+        }
 
         if (param->bUseB) {
             ty.vec() = ty.vec() + b.vec();
@@ -682,6 +721,10 @@ public:
     TriParams* param;
 
 public:
+    double flops() const override {
+        return weightFlops(inDim1 + inDim2 + inDim3, outDim);
+    }
+
     inline void  forward() {
         count = batch.size();
         x1.init(inDim1, count);
@@ -709,7 +752,13 @@ public:
             }
         }
 
-        y.mat() = param->W1.val.mat() * x1.mat() + param->W2.val.mat() * x2.mat() + param->W3.val.mat() * x3.mat();
+        if (param->isCompressed()) {
+            param->W1.multiply(x1.v, count, y.v, false);
+            param->W2.multiply(x2.v, count, y.v, true);
+            param->W3.multiply(x3.v, count, y.v, true);
+        } else {
+            y.mat() = param->W1.val.mat() * x1.mat() + param->W2.val.mat() * x2.mat() + param->W3.val.mat() * x3.mat();
+        }
 
         if (param->bUseB) {
             y.vec() += b.vec();
@@ -45,6 +45,23 @@ class UniParams {
         }
     }
 
+#if !USE_GPU
+    // int8 weights for inference, the bias stays as it is, see Param::quantize
+    inline void quantize(bool keepVal = false) {
+        W.quantize(keepVal);
+    }
+
+    // 16 bit weights for inference, see Param::toHalf
+    inline void toHalf(HalfMat::Format format = HalfMat::BF16, bool keepVal = false) {
+        W.toHalf(format, keepVal);
+    }
+
+    // the executes multiply by Param::multiply rather than by val
+    inline bool isCompressed() const {
+        return W.isCompressed();
+    }
+#endif
+
     inline void save(std::ofstream &os) const {
         os << bUseB << std::endl;
         W.save(os);
@@ -161,6 +178,13 @@ class UniNode : public Node {
             (::typeHashCode(de) << 1);
     }
 
+#if !USE_GPU
+    // UniExecute packs the input with gatherVal
+    bool readsViews() const override {
+        return true;
+    }
+#endif
+
 #if USE_GPU
     void toNodeInfo(NodeInfo &info) const override {
         Node::toNodeInfo(info);
@@ -207,7 +231,11 @@ class LinearUniNode : public Node {
 
   public:
     inline void compute() {
+#if !USE_GPU
+        param->W.multiply(in->val.v, 1, val.v, false);
+#else
         val.mat() = param->W.val.mat() * in->val.mat();
+#endif
         if (param->bUseB) {
             val.vec() += param->b.val.vec();
         }
@@ -305,6 +333,13 @@ class LinearNode : public Node {
         return Node::typeHashCode() ^ ::typeHashCode(param);
     }
 
+#if !USE_GPU
+    // LinearExecute packs the input with gatherVal
+    bool readsViews() const override {
+        return true;
+    }
+#endif
+
 #if USE_GPU
     void toNodeInfo(NodeInfo &info) const override {
         Node::toNodeInfo(info);
@@ -324,6 +359,10 @@ class UniExecute :public Execute {
     dtype(*derivate)(const dtype&, const dtype&);  // derivation function of activation function
     Tensor2D drop_mask;
 
+    double flops() const override {
+        return weightFlops(inDim, outDim);
+    }
+
     inline void  forward() {
         int count = batch.size();
         ty.init(outDim, count);
@@ -411,9 +450,7 @@ class UniExecute :public Execute {
 #else
         for (int idx = 0; idx < count; idx++) {
             UniNode* ptr = (UniNode*)batch[idx];
-            for (int idy = 0; idy < inDim; idy++) {
-                x[idy][idx] = ptr->in->val[idy];
-            }
+            gatherVal(ptr->in, x.v + idx, count);
             if (param->bUseB) {
                 for (int idy = 0; idy < outDim; idy++) {
                     b[idy][idx] = param->b.val.v[idy];
@@ -421,7 +458,7 @@ class UniExecute :public Execute {
             }
         }
 
-        ty.mat() = param->W.val.mat() * x.mat();
+        param->W.multiply(x.v, count, ty.v, false);
 
         if (param->bUseB) {
             ty.vec() = ty.vec() + b.vec();
@@ -554,9 +591,7 @@ class UniExecute :public Execute {
 
         for (int idx = 0; idx < count; idx++) {
             UniNode* ptr = (UniNode*)batch[idx];
-            for (int idy = 0; idy < inDim; idy++) {
-                ptr->in->loss[idy] += lx[idy][idx];
-            }
+            scatterLoss(ptr->in, lx.v + idx, count);
         }
 #endif
     }
@@ -577,6 +612,12 @@ inline PExecute UniNode::generate(bool bTrain, dtype cur_drop_factor) {
 
 class LinearUniExecute :public Execute {
   public:
+    // the nodes of a batch share their param
+    double flops() const override {
+        UniParams *param = static_cast<LinearUniNode*>(batch.at(0))->param;
+        return weightFlops(param->W.inDim(), param->W.outDim());
+    }
+
     inline void  forward() {
         int count = batch.size();
         //#pragma omp parallel for
@@ -611,6 +652,10 @@ public:
     int inDim, outDim, count;
     UniParams* param;
 
+    double flops() const override {
+        return weightFlops(inDim, outDim);
+    }
+
     void  forward() {
         int count = batch.size();
 
@@ -742,6 +787,10 @@ class LinearExecute :public Execute {
     int inDim, outDim, count;
     UniParams* param;
 
+    double flops() const override {
+        return weightFlops(inDim, outDim);
+    }
+
     inline void  forward() {
         count = batch.size();
         x.init(inDim, count);
@@ -749,12 +798,10 @@ class LinearExecute :public Execute {
 
         for (int idx = 0; idx < count; idx++) {
             LinearNode* ptr = (LinearNode*)batch[idx];
-            for (int idy = 0; idy < inDim; idy++) {
-                x[idy][idx] = ptr->in->val[idy];
-            }
+            gatherVal(ptr->in, x.v + idx, count);
         }
 
-        y.mat() = param->W.val.mat() * x.mat();
+        param->W.multiply(x.v, count, y.v, false);
 
         for (int idx = 0; idx < count; idx++) {
             LinearNode* ptr = (LinearNode*)batch[idx];
@@ -784,9 +831,7 @@ class LinearExecute :public Execute {
 
         for (int idx = 0; idx < count; idx++) {
             LinearNode* ptr = (LinearNode*)batch[idx];
-            for (int idy = 0; idy < inDim; idy++) {
-                ptr->in->loss[idy] += lx[idy][idx];
-            }
+            scatterLoss(ptr->in, lx.v + idx, count);
         }
     }
 };
@@ -4,6 +4,7 @@
 /*
 *  Windowlized.h:
 *  a contextual builder, concatenate x[-c]...x[0]...x[c] together
+*  on CPU the concatenation is a WindowNode view, built only when needed
 *
 *  Created on: Apr 22, 2017
 *      Author: mszhang
@@ -14,6 +15,104 @@
 #include "Concat.h"
 #include "Graph.h"
 
+#if !USE_GPU
+// the concatenation of a window of nodes as a view, nothing is copied for
+// parents reading views (UniNode, LinearNode, ConcatNode), whose executes
+// gather the neighbours straight into their input matrices, im2col like,
+// the val is built only if some other parent (or the caller) reads it
+class WindowNode : public Node {
+  public:
+    vector<PNode> ins;
+    bool materialized;
+
+  public:
+    WindowNode() : Node() {
+        materialized = false;
+        node_type = "window";
+    }
+
+    inline void clearValue() {
+        Node::clearValue();
+        ins.clear();
+        materialized = false;
+    }
+
+    const vector<PNode> *viewOf() const override {
+        return &ins;
+    }
+
+    bool readsViews() const override {
+        return true;
+    }
+
+  public:
+    void forward(Graph *cg, const vector<PNode>& x) {
+        int curDim = 0;
+        for (PNode p : x) {
+            curDim += p->dim;
+        }
+        if (x.size() == 0 || curDim != dim) {
+            std::cout << "window dim " << curDim << " does not match " << dim << std::endl;
+            abort();
+        }
+        ins = x;
+        degree = 0;
+        for (PNode p : ins) {
+            p->addParent(this);
+        }
+        cg->addNode(this);
+    }
+
+  public:
+    inline void compute() {
+        // a window without parents is an output read by the caller
+        materialized = parents.empty();
+        for (PNode parent : parents) {
+            if (!parent->readsViews()) {
+                materialized = true;
+            }
+        }
+        if (materialized) {
+            gatherVal(this, val.v);
+        }
+    }
+
+    // parents reading the view have added their losses to ins already
+    inline void backward() {
+        if (materialized) {
+            scatterLoss(this, loss.v);
+        }
+    }
+
+    inline PExecute generate(bool bTrain, dtype cur_drop_factor);
+};
+
+class WindowExecute : public Execute {
+  public:
+    inline void  forward() {
+        int count = batch.size();
+        for (int idx = 0; idx < count; idx++) {
+            batch[idx]->compute();
+        }
+    }
+
+    inline void backward() {
+        int count = batch.size();
+        for (int idx = 0; idx < count; idx++) {
+            batch[idx]->backward();
+        }
+    }
+};
+
+inline PExecute WindowNode::generate(bool bTrain, dtype cur_drop_factor) {
+    WindowExecute* exec = new WindowExecute();
+    exec->batch.push_back(this);
+    exec->bTrain = bTrain;
+    exec->drop_factor = cur_drop_factor;
+    return exec;
+}
+#endif
+
 class WindowBuilder {
   public:
     int _context;
@@ -22,7 +121,11 @@ class WindowBuilder {
     int _inDim;
     int _outDim;
 
-    vector<ConcatNode> _outputs;
+#if USE_GPU
+    vector<ConcatNode*> _outputs;
+#else
+    vector<WindowNode*> _outputs;
+#endif
     BucketNode _bucket;
 
 
@@ -36,10 +139,6 @@ class WindowBuilder {
     }
 
 
-    inline void resize(int maxsize) {
-        _outputs.resize(maxsize);
-    }
-
     inline void clear() {
         _outputs.clear();
         _context = 0;
@@ -55,13 +154,13 @@ class WindowBuilder {
         _window = 2 * _context + 1;
         _inDim = inDim;
         _outDim = _window * _inDim;
-        int maxsize = _outputs.size();
-        for (int idx = 0; idx < maxsize; idx++) {
-            _outputs[idx].init(_outDim, -1); // dropout is not supported here
-        }
         _bucket.init(_inDim, -1);
     }
 
+    // no-op, forward takes the nodes from Graph::newNode
+    N3LDG_DEPRECATED inline void resize(int) {
+    }
+
 
 
   public:
@@ -74,6 +173,7 @@ class WindowBuilder {
         _nSize = x.size();
 
         vector<PNode> in_nodes(_window);
+        _outputs.resize(_nSize);
         _bucket.forward(cg, 0);
         for (int idx = 0; idx < _nSize; idx++) {
             int offset = 0;
@@ -82,7 +182,12 @@ class WindowBuilder {
                 in_nodes[offset++] = idx - j >= 0 ? x[idx - j] : &_bucket;
                 in_nodes[offset++] = idx + j < _nSize ? x[idx + j] : &_bucket;
             }
-            _outputs[idx].forward(cg, in_nodes);
+#if USE_GPU
+            _outputs[idx] = cg->newNode<ConcatNode>(_outDim); // dropout is not supported here
+#else
+            _outputs[idx] = cg->newNode<WindowNode>(_outDim); // dropout is not supported here
+#endif
+            _outputs[idx]->forward(cg, in_nodes);
         }
     }
 
@@ -42,10 +42,8 @@ enum ProfilerMode {
 class Profiler {
 public:
     static Profiler &Ins() {
-        static Profiler *p = NULL;
-        if (p == NULL) {
-            p = new Profiler;
-        }
+        // initialized once even when graphs compute on several threads
+        static Profiler *p = new Profiler;
         return *p;
     }
 
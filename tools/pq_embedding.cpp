@@ -0,0 +1,104 @@
+/*
+*  pq_embedding.cpp:
+*  builds the product quantized form of a trained embedding table offline,
+*  see LookupTable::compress
+*  (1) the input is a table written by LookupTable::save, the output is
+*      read by LookupTable::loadCompressed in place of LookupTable::load,
+*      the alphabet is saved by the model as before
+*  (2) the reconstruction error and the sizes are written to stderr
+*
+*  usage: pq_embedding --input table --output table.pq --subspaces 50
+*                      [--iterations 16] [--sample 65536]
+*/
+
+#include "N3LDG.h"
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using std::string;
+
+void usage() {
+    std::cerr << "usage: pq_embedding --input table --output table.pq --subspaces 50"
+        " [--iterations 16] [--sample 65536]" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    string input, output;
+    int subspaces = 0, iterations = 16, sample = 65536;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) {
+            usage();
+            return arg == "--help" || arg == "-h" ? 0 : 1;
+        }
+        string value = argv[++i];
+        if (arg == "--input") {
+            input = value;
+        } else if (arg == "--output") {
+            output = value;
+        } else if (arg == "--subspaces") {
+            subspaces = atoi(value.c_str());
+        } else if (arg == "--iterations") {
+            iterations = atoi(value.c_str());
+        } else if (arg == "--sample") {
+            sample = atoi(value.c_str());
+        } else {
+            usage();
+            return 1;
+        }
+    }
+    if (input.empty() || output.empty() || subspaces <= 0) {
+        usage();
+        return 1;
+    }
+
+    std::ifstream is(input.c_str());
+    if (!is.is_open()) {
+        std::cerr << "cannot open " << input << std::endl;
+        return 1;
+    }
+    LookupTable table;
+    table.load(is, NULL);
+    is.close();
+    int rows = table.E.val.row, dim = table.E.val.col;
+    if (dim % subspaces != 0) {
+        std::cerr << "dim " << dim << " is not a multiple of subspaces " << subspaces << std::endl;
+        return 1;
+    }
+    std::cerr << "table of " << rows << " x " << dim << ", " << subspaces << " subspaces" << std::endl;
+    std::vector<dtype> original(table.E.val.v, table.E.val.v + rows * dim);
+    table.compress(subspaces, iterations, sample);
+
+    // relative squared error and cosine of the decoded rows
+    double error = 0, norm = 0, cosine = 0;
+    std::vector<dtype> row(dim);
+    for (int i = 0; i < rows; i++) {
+        table.pq.decode(i, row.data(), dim);
+        const dtype *x = original.data() + i * dim;
+        double dot = 0, xx = 0, yy = 0;
+        for (int j = 0; j < dim; j++) {
+            error += (row[j] - x[j]) * (row[j] - x[j]);
+            dot += row[j] * x[j];
+            xx += x[j] * x[j];
+            yy += row[j] * row[j];
+        }
+        norm += xx;
+        cosine += xx > 0 && yy > 0 ? dot / std::sqrt(xx * yy) : 1;
+    }
+    double bytes = (double)rows * dim * sizeof(dtype);
+    std::cerr << "relative squared error " << error / norm << ", mean cosine " <<
+        cosine / rows << std::endl;
+    std::cerr << "bytes " << bytes << " -> " << table.pq.bytes() << " (" <<
+        bytes / table.pq.bytes() << "x)" << std::endl;
+
+    std::ofstream os(output.c_str());
+    if (!os.is_open()) {
+        std::cerr << "cannot open " << output << std::endl;
+        return 1;
+    }
+    table.saveCompressed(os);
+    return 0;
+}